@@ -0,0 +1,459 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+//Microbenchmarks for every path that crosses between C++ and Lua.
+//Usage: kalalua-bench [output.json] [name filter]
+//Results go to the json file because KalaLua logs to stdout, redirect stdout
+//to a file or null device when timing the Initialize and LoadScript benchmarks
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <new>
+#include <span>
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+using KalaLua::Core::LuaState;
+using KalaLua::Core::LuaVar;
+using KalaLua::Core::LuaLibrary;
+using KalaLua::Core::LuaFunctionRef;
+
+using std::string;
+using std::string_view;
+using std::span;
+using std::to_string;
+using std::vector;
+using std::function;
+using std::sort;
+using std::atomic;
+using std::memory_order_relaxed;
+using std::malloc;
+using std::free;
+using std::bad_alloc;
+using std::ofstream;
+using std::ios;
+using std::snprintf;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+using u32 = uint32_t;
+using u64 = uint64_t;
+
+//every C++ heap allocation in the process, including the ones KalaLua makes per call
+static atomic<u64> cppAllocations{};
+
+void* operator new(size_t size)
+{
+	cppAllocations.fetch_add(1, memory_order_relaxed);
+
+	if (void* block = malloc(size ? size : 1)) return block;
+	throw bad_alloc();
+}
+
+void operator delete(void* block) noexcept
+{
+	free(block);
+}
+
+void operator delete(void* block, size_t) noexcept
+{
+	free(block);
+}
+
+struct BenchResult
+{
+	string name{};
+	u64 iterations{};
+
+	//median over every round, the min shows how much noise the median absorbed
+	double nsPerOp{};
+	double minNsPerOp{};
+
+	double cppAllocsPerOp{};
+	double luaAllocsPerOp{};
+};
+
+//Runs every benchmark for a fixed number of timed rounds after calibrating
+//how many iterations one round needs to last at least MIN_ROUND_NANOSECONDS
+class BenchRunner
+{
+public:
+	static constexpr u32 ROUNDS = 7;
+	static constexpr u64 MIN_ROUND_NANOSECONDS = 20000000;
+
+	explicit BenchRunner(string_view newFilter) : filter(newFilter) {}
+
+	//opsPerIteration is how many crossings one call of op makes,
+	//luaAllocations returns the running count of Lua allocations
+	void Run(
+		string_view name,
+		u64 opsPerIteration,
+		const function<void()>& op,
+		const function<u64()>& luaAllocations)
+	{
+		if (!filter.empty()
+			&& name.find(filter) == string_view::npos)
+		{
+			return;
+		}
+
+		//warm up caches and the Lua heap, then double until a round is long enough
+		op();
+
+		u64 iterations = 1;
+		for (;;)
+		{
+			u64 elapsed = _Time(op, iterations);
+			if (elapsed >= MIN_ROUND_NANOSECONDS
+				|| iterations >= (1ull << 30))
+			{
+				break;
+			}
+
+			iterations *= 2;
+		}
+
+		//reserved before counting starts, so the harness's own push_back is not counted
+		vector<double> roundNsPerOp{};
+		roundNsPerOp.reserve(ROUNDS);
+
+		u64 cppBefore = cppAllocations.load(memory_order_relaxed);
+		u64 luaBefore = luaAllocations();
+
+		for (u32 round = 0; round < ROUNDS; ++round)
+		{
+			u64 elapsed = _Time(op, iterations);
+			roundNsPerOp.push_back(scast<double>(elapsed) / scast<double>(iterations * opsPerIteration));
+		}
+
+		u64 cppCount = cppAllocations.load(memory_order_relaxed) - cppBefore;
+		u64 luaCount = luaAllocations() - luaBefore;
+
+		sort(roundNsPerOp.begin(), roundNsPerOp.end());
+
+		double totalOps = scast<double>(iterations * opsPerIteration * ROUNDS);
+
+		BenchResult result{};
+		result.name = string(name);
+		result.iterations = iterations * opsPerIteration;
+		result.nsPerOp = roundNsPerOp[ROUNDS / 2];
+		result.minNsPerOp = roundNsPerOp.front();
+		result.cppAllocsPerOp = scast<double>(cppCount) / totalOps;
+		result.luaAllocsPerOp = scast<double>(luaCount) / totalOps;
+
+		fprintf(stderr, "%-40s %12.1f ns/op %8.2f allocs/op\n",
+			result.name.c_str(),
+			result.nsPerOp,
+			result.cppAllocsPerOp + result.luaAllocsPerOp);
+
+		results.push_back(result);
+	}
+
+	bool WriteJson(const string& filePath) const
+	{
+		ofstream file(filePath, ios::trunc);
+		if (!file) return false;
+
+		file << "{\n";
+		file << "\t\"lua_version\": " << LUA_VERSION_RELEASE_NUM << ",\n";
+		file << "\t\"rounds\": " << ROUNDS << ",\n";
+		file << "\t\"benchmarks\":\n\t[\n";
+
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const BenchResult& r = results[i];
+
+			char line[512]{};
+			snprintf(line, sizeof(line),
+				"\t\t{ \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"min_ns_per_op\": %.2f, "
+				"\"cpp_allocs_per_op\": %.3f, \"lua_allocs_per_op\": %.3f }%s\n",
+				r.name.c_str(),
+				scast<unsigned long long>(r.iterations),
+				r.nsPerOp,
+				r.minNsPerOp,
+				r.cppAllocsPerOp,
+				r.luaAllocsPerOp,
+				i + 1 < results.size() ? "," : "");
+
+			file << line;
+		}
+
+		file << "\t]\n}\n";
+
+		return file.good();
+	}
+private:
+	string filter{};
+	vector<BenchResult> results{};
+
+	static u64 _Time(
+		const function<void()>& op,
+		u64 iterations)
+	{
+		auto start = steady_clock::now();
+		for (u64 i = 0; i < iterations; ++i) op();
+
+		return scast<u64>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+	}
+};
+
+//same function under each kind of namespace, plus targets for every arg count
+static constexpr const char* CALL_SCRIPT = R"(
+function noop() end
+function take1(a) end
+function take8(a, b, c, d, e, f, g, h) end
+
+flat = {}
+function flat.noop() end
+
+a = { b = { c = {} } }
+function a.b.c.noop() end
+
+function loop_native(kind, n)
+	local f = native[kind]
+	local s = 0
+	for i = 1, n do s = s + f(i) end
+	return s
+end
+)";
+
+static int NativeAddOne(int value)
+{
+	return value + 1;
+}
+
+//a script of roughly targetBytes made of small functions, like a real gameplay script
+static string MakeScript(size_t targetBytes)
+{
+	string result{};
+	for (u32 i = 0; result.size() < targetBytes; ++i)
+	{
+		string index = to_string(i);
+
+		result += "function f" + index + "(a, b)\n";
+		result += "\tlocal t = { x = a, y = b, n = " + index + " }\n";
+		result += "\tif t.x > t.y then return t.x - t.y + t.n end\n";
+		result += "\tfor i = 1, 3 do t.n = t.n + i * a end\n";
+		result += "\treturn t.n\n";
+		result += "end\n";
+	}
+
+	return result;
+}
+
+static LuaVar MakeArg(
+	string_view type,
+	int index)
+{
+	if (type == "int")    return LuaVar(index);
+	if (type == "float")  return LuaVar(scast<float>(index) + 0.5f);
+	if (type == "double") return LuaVar(scast<double>(index) + 0.25);
+	if (type == "bool")   return LuaVar(index % 2 == 0);
+
+	return LuaVar(string("value") + to_string(index));
+}
+
+static void BenchCalls(
+	BenchRunner& runner,
+	LuaState& state)
+{
+	auto lua_allocations = [&state]() { return state.GetMemoryStats().allocations; };
+
+	runner.Run("call/luavar/0", 1, [&]() { state.CallFunction("noop", ""); }, lua_allocations);
+
+	for (string_view type : { "int", "float", "double", "bool", "string" })
+	{
+		vector<LuaVar> one{ MakeArg(type, 1) };
+		vector<LuaVar> eight{};
+		for (int i = 0; i < 8; ++i) eight.push_back(MakeArg(type, i));
+
+		runner.Run("call/luavar/" + string(type) + "/1", 1,
+			[&]() { state.CallFunction("take1", "", one); },
+			lua_allocations);
+
+		runner.Run("call/luavar/" + string(type) + "/8", 1,
+			[&]() { state.CallFunction("take8", "", eight); },
+			lua_allocations);
+	}
+
+	//the typed overloads push each arg at compile time instead of building LuaVars
+	runner.Run("call/typed/0", 1, [&]() { state.CallFunction<void>("noop", ""); }, lua_allocations);
+	runner.Run("call/typed/int/1", 1, [&]() { state.CallFunction<void>("take1", "", 1); }, lua_allocations);
+	runner.Run("call/typed/double/1", 1, [&]() { state.CallFunction<void>("take1", "", 1.25); }, lua_allocations);
+	runner.Run("call/typed/string/1", 1, [&]() { state.CallFunction<void>("take1", "", "value"); }, lua_allocations);
+	runner.Run("call/typed/int/8", 1,
+		[&]() { state.CallFunction<void>("take8", "", 1, 2, 3, 4, 5, 6, 7, 8); },
+		lua_allocations);
+}
+
+static void BenchNamespaces(
+	BenchRunner& runner,
+	LuaState& state)
+{
+	auto lua_allocations = [&state]() { return state.GetMemoryStats().allocations; };
+
+	runner.Run("namespace/global", 1, [&]() { state.CallFunction<void>("noop", ""); }, lua_allocations);
+	runner.Run("namespace/flat", 1, [&]() { state.CallFunction<void>("noop", "flat"); }, lua_allocations);
+	runner.Run("namespace/dotted", 1, [&]() { state.CallFunction<void>("noop", "a.b.c"); }, lua_allocations);
+
+	//a resolved handle skips the namespace walk, the floor for the ones above
+	LuaFunctionRef dottedRef = state.GetFunctionRef("noop", "a.b.c");
+	runner.Run("namespace/dotted_ref", 1, [&]() { state.CallFunction<void>(dottedRef); }, lua_allocations);
+	state.ReleaseFunctionRef(dottedRef);
+}
+
+static void BenchTrampolines(
+	BenchRunner& runner,
+	LuaState& state)
+{
+	auto lua_allocations = [&state]() { return state.GetMemoryStats().allocations; };
+
+	//every op is one call from Lua into C++, the Lua loop around it is included
+	constexpr u64 CALLS = 1000;
+
+	state.RegisterFunction(
+		"functional",
+		"native",
+		function<int(int)>(NativeAddOne));
+
+	state.RegisterFunction(
+		"pointer",
+		"native",
+		NativeAddOne);
+
+	state.RegisterFunction<&NativeAddOne>(
+		"static",
+		"native");
+
+	state.RegisterFunction(
+		"custom",
+		"native",
+		function<int(lua_State*)>([](lua_State* callState)
+			{
+				lua_pushinteger(callState, lua_tointeger(callState, 1) + 1);
+				return 1;
+			}));
+
+	for (string_view kind : { "functional", "pointer", "static", "custom" })
+	{
+		string name(kind);
+
+		runner.Run("trampoline/" + name, CALLS,
+			[&]() { state.CallFunction<void>("loop_native", "", name, scast<int>(CALLS)); },
+			lua_allocations);
+	}
+}
+
+//Scripts are built in memory so only compiling and running them is timed, not file reads
+static void BenchLoadScript(
+	BenchRunner& runner,
+	LuaState& state)
+{
+	auto lua_allocations = [&state]() { return state.GetMemoryStats().allocations; };
+
+	for (size_t kilobytes : { 1, 16, 256 })
+	{
+		string name = "bench_" + to_string(kilobytes) + "kb";
+		string source = MakeScript(kilobytes * 1024);
+
+		runner.Run("load_script/" + to_string(kilobytes) + "kb", 1,
+			[&]()
+			{
+				state.LoadScriptFromBuffer(
+					name,
+					span<const char>(source.data(), source.size()));
+			},
+			lua_allocations);
+	}
+}
+
+static void BenchInitialize(BenchRunner& runner)
+{
+	struct LibrarySet
+	{
+		const char* name;
+		vector<LuaLibrary> libraries;
+	};
+
+	const vector<LibrarySet> sets =
+	{
+		{ "base",      {} },
+		{ "coroutine", { LuaLibrary::LUA_COROUTINE } },
+		{ "table",     { LuaLibrary::LUA_TABLE } },
+		{ "string",    { LuaLibrary::LUA_STRING } },
+		{ "math",      { LuaLibrary::LUA_MATH } },
+		{ "utf8",      { LuaLibrary::LUA_UTF8 } },
+		{ "package",   { LuaLibrary::LUA_PACKAGE } },
+		{ "io",        { LuaLibrary::LUA_IO } },
+		{ "os",        { LuaLibrary::LUA_OS } },
+		{ "debug",     { LuaLibrary::LUA_DEBUG } },
+		{ "all",       { LuaLibrary::LUA_ALL } }
+	};
+
+	LuaState state{};
+
+	//Shutdown resets the allocator stats, so the count is taken before every Shutdown
+	u64 initAllocations{};
+	auto lua_allocations = [&initAllocations]() { return initAllocations; };
+
+	for (const LibrarySet& set : sets)
+	{
+		runner.Run("initialize/" + string(set.name), 1,
+			[&]()
+			{
+				state.Initialize(set.libraries);
+				initAllocations += state.GetMemoryStats().allocations;
+				state.Shutdown();
+			},
+			lua_allocations);
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	string outputPath = argc > 1 ? argv[1] : "kalalua_bench.json";
+	string filter = argc > 2 ? argv[2] : "";
+
+	BenchRunner runner(filter);
+
+	{
+		LuaState state{};
+		state.Initialize({});
+		state.LoadScriptFromBuffer(
+			"bench",
+			span<const char>(CALL_SCRIPT, string_view(CALL_SCRIPT).size()));
+
+		BenchCalls(runner, state);
+		BenchNamespaces(runner, state);
+		BenchTrampolines(runner, state);
+		BenchLoadScript(runner, state);
+	}
+
+	BenchInitialize(runner);
+
+	if (!runner.WriteJson(outputPath))
+	{
+		fprintf(stderr, "Failed to write benchmark results to '%s'!\n", outputPath.c_str());
+		return 1;
+	}
+
+	fprintf(stderr, "Wrote benchmark results to '%s'.\n", outputPath.c_str());
+	return 0;
+}
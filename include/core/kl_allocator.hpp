@@ -0,0 +1,208 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "core_utils.hpp"
+
+namespace KalaLua::Core
+{
+	using std::array;
+	using std::vector;
+
+	using u8 = uint8_t;
+	using u64 = uint64_t;
+
+	enum class LuaAllocatorType : u8
+	{
+		//realloc and free, the same allocator luaL_newstate uses
+		ALLOCATOR_SYSTEM,
+
+		//size-class pools for small blocks, larger blocks go to realloc and free
+		ALLOCATOR_POOL,
+
+		//a user lua_Alloc, stats and the memory limit still apply on top of it
+		ALLOCATOR_CUSTOM
+	};
+
+	struct LuaAllocatorConfig
+	{
+		LuaAllocatorType type = LuaAllocatorType::ALLOCATOR_SYSTEM;
+
+		//hard cap on bytes Lua can have allocated, 0 is unlimited,
+		//allocations past it fail with a Lua memory error instead of reaching the panic handler
+		size_t memoryLimit{};
+
+		//only used by ALLOCATOR_CUSTOM
+		lua_Alloc customAlloc{};
+		void* customUserData{};
+	};
+
+	struct LuaMemoryStats
+	{
+		//bytes currently allocated by Lua
+		size_t bytesInUse{};
+		//highest bytesInUse since the state was initialized or the peak was reset
+		size_t peakBytes{};
+		//bytes held in pool slabs, used or not, only counted by ALLOCATOR_POOL
+		size_t reservedBytes{};
+
+		//new blocks Lua asked for
+		u64 allocations{};
+		//existing blocks Lua asked to grow or shrink
+		u64 reallocations{};
+		//requests that failed because of the memory limit or the underlying allocator
+		u64 failedAllocations{};
+
+		//new blocks per size class, in the same order as LuaAllocator::sizeClasses
+		array<u64, 12> sizeClassAllocations{};
+		//new blocks larger than the largest size class
+		u64 largeAllocations{};
+	};
+
+	//Allocator a LuaState hands to lua_newstate, tracks every block Lua allocates
+	//and enforces the memory limit, the pool type serves small blocks from
+	//per-size-class free lists carved out of fixed size slabs.
+	//Not thread safe, like the state that uses it
+	class LIB_API LuaAllocator
+	{
+	public:
+		//block sizes the pool serves, every request is rounded up to the next one
+		static constexpr array<size_t, 12> sizeClasses =
+		{
+			16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256
+		};
+
+		//requests larger than this bypass the pool
+		static constexpr size_t MAX_POOLED_SIZE = 256;
+
+		//bytes of each slab the pool carves blocks out of
+		static constexpr size_t SLAB_SIZE = 16384;
+
+		LuaAllocator() = default;
+		~LuaAllocator();
+
+		LuaAllocator(const LuaAllocator&) = delete;
+		LuaAllocator& operator=(const LuaAllocator&) = delete;
+		LuaAllocator(LuaAllocator&&) = delete;
+		LuaAllocator& operator=(LuaAllocator&&) = delete;
+
+		//Set the allocator type and memory limit, only valid while no lua_State uses this allocator
+		void Configure(const LuaAllocatorConfig& newConfig);
+
+		const LuaAllocatorConfig& GetConfig() const { return config; }
+
+		//Change the memory limit at any time, 0 is unlimited,
+		//lowering it below the bytes in use only stops further growth
+		void SetMemoryLimit(size_t memoryLimit) { config.memoryLimit = memoryLimit; }
+
+		//Let growth past the memory limit succeed while false. The limit is only enforced
+		//while Lua code runs inside a protected call, a memory error anywhere else would
+		//reach the panic handler or jump over C++ frames, use LuaLimitScope to switch it
+		void SetLimitEnforced(bool state) { isLimitEnforced = state; }
+
+		bool IsLimitEnforced() const { return isLimitEnforced; }
+
+		const LuaMemoryStats& GetStats() const { return stats; }
+
+		void ResetPeak() { stats.peakBytes = stats.bytesInUse; }
+
+		//Free every slab and reset the stats,
+		//only valid after the lua_State that used this allocator is closed
+		void Release();
+
+		//The allocator of a lua_State that was created by a LuaState
+		static LuaAllocator& FromLuaState(lua_State* luaState)
+		{
+			void* userData{};
+			lua_getallocf(luaState, &userData);
+
+			return *scast<LuaAllocator*>(userData);
+		}
+
+		//The lua_Alloc function, userData is the LuaAllocator
+		static void* Allocate(
+			void* userData,
+			void* block,
+			size_t oldSize,
+			size_t newSize);
+	private:
+		//index past the last size class, marks blocks that bypass the pool
+		static constexpr size_t LARGE_CLASS = sizeClasses.size();
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		LuaAllocatorConfig config{};
+		LuaMemoryStats stats{};
+		bool isLimitEnforced{};
+
+		array<FreeBlock*, sizeClasses.size()> freeLists{};
+		vector<void*> slabs{};
+
+		//heap blocks that shrank into a pooled size class while no pool block was free,
+		//while any are alive _PoolFree checks blocks against the slabs before pooling them
+		size_t keptHeapBlocks{};
+
+		void* _Reallocate(
+			void* block,
+			size_t oldSize,
+			size_t newSize);
+
+		void* _PoolReallocate(
+			void* block,
+			size_t oldSize,
+			size_t newSize);
+
+		void* _PoolAllocate(size_t sizeClass);
+
+		void _PoolFree(
+			void* block,
+			size_t sizeClass);
+
+		//Returns true if block was carved out of one of the slabs
+		bool _IsSlabBlock(const void* block) const;
+
+		//Get the index of the smallest size class that fits size, or LARGE_CLASS
+		static size_t _GetSizeClass(size_t size);
+	};
+
+	//Enforces or lifts the memory limit of a state while it lives and restores the previous
+	//setting after. Must not live across a Lua error, a longjmp skips the restore
+	class LuaLimitScope
+	{
+	public:
+		LuaLimitScope(
+			lua_State* luaState,
+			bool isEnforced)
+			: allocator(LuaAllocator::FromLuaState(luaState)),
+			wasEnforced(allocator.IsLimitEnforced())
+		{
+			allocator.SetLimitEnforced(isEnforced);
+		}
+
+		~LuaLimitScope() { allocator.SetLimitEnforced(wasEnforced); }
+
+		LuaLimitScope(const LuaLimitScope&) = delete;
+		LuaLimitScope& operator=(const LuaLimitScope&) = delete;
+		LuaLimitScope(LuaLimitScope&&) = delete;
+		LuaLimitScope& operator=(LuaLimitScope&&) = delete;
+	private:
+		LuaAllocator& allocator;
+		bool wasEnforced{};
+	};
+}
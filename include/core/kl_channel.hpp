@@ -0,0 +1,138 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::vector;
+	using std::unique_ptr;
+	using std::atomic;
+
+	using u32 = uint32_t;
+	using u64 = uint64_t;
+
+	//One or more values copied out of a Lua state into a flat byte buffer that belongs to no state,
+	//so it can cross threads and be pushed into any other state. Holds nil, booleans, integers,
+	//floats, strings and tables of those, table keys must be booleans, numbers or strings,
+	//metatables are not copied. The buffer keeps its capacity when the message is reused
+	class LIB_API LuaMessage
+	{
+		friend class LuaChannel;
+	public:
+		//Copy count values starting at index out of a Lua state, replaces what the message held,
+		//returns false and logs if a value can not be sent or tables nest too deep
+		bool Read(
+			lua_State* state,
+			int index,
+			int count);
+
+		//Push every value of the message to a Lua state in order,
+		//returns the number of values pushed or -1 if the Lua stack could not grow
+		int Push(lua_State* state) const;
+
+		//Append one C++ value, uint64_t keeps its bits as a Lua integer
+		void Add(const LuaVar& value);
+
+		//Copy every value into LuaVars, returns false if the message holds a nil or a table
+		bool ToVars(vector<LuaVar>& outValues) const;
+
+		void Clear();
+
+		u32 GetValueCount() const { return valueCount; }
+
+		size_t GetByteSize() const { return data.size(); }
+	private:
+		//tagged values back to back, tables hold their pair count followed by key value pairs
+		string data{};
+		u32 valueCount{};
+
+		//Read without logging, returns nullptr or the reason for a Lua error
+		const char* _Read(
+			lua_State* state,
+			int index,
+			int count);
+	};
+
+	//Bounded multi-producer multi-consumer queue of messages that any number of threads
+	//and Lua states can send to and receive from without a lock, each slot is claimed
+	//with one compare-and-swap and hands its buffer back so steady traffic does not allocate.
+	//Bind exposes it to a state as a global table:
+	//	name.send(...)        - send the values as one message, returns false if the channel is full
+	//	name.try_receive()    - returns true and the values of the next message, or false if empty
+	//	name.receive()        - returns the values of the next message, yields while the channel
+	//	                        is empty, so inside a scheduler task it checks once per Tick
+	//	name.size()           - messages waiting right now
+	//A channel must outlive every state it is bound to
+	class LIB_API LuaChannel
+	{
+	public:
+		//capacity is rounded up to a power of two, at least 2
+		explicit LuaChannel(u32 capacity = 1024);
+
+		//bound states hold a pointer to this object, so it can never move
+		LuaChannel(const LuaChannel&) = delete;
+		LuaChannel& operator=(const LuaChannel&) = delete;
+		LuaChannel(LuaChannel&&) = delete;
+		LuaChannel& operator=(LuaChannel&&) = delete;
+
+		//Move a message into the channel, on success message is left holding
+		//an empty buffer to reuse, returns false and leaves message untouched if full
+		bool TrySend(LuaMessage& message);
+
+		//Move the oldest message into outMessage, returns false if the channel is empty
+		bool TryReceive(LuaMessage& outMessage);
+
+		//Register the channel functions into an initialized state as the global table luaName
+		bool Bind(
+			LuaState& state,
+			string_view luaName);
+
+		u32 GetCapacity() const { return scast<u32>(mask + 1); }
+
+		//Messages waiting right now, only a snapshot while other threads send or receive
+		u32 GetSize() const;
+	private:
+		struct Slot
+		{
+			//equals the position a sender may claim or one past the position a receiver may claim
+			atomic<size_t> sequence{};
+			LuaMessage message{};
+		};
+
+		unique_ptr<Slot[]> slots{};
+		size_t mask{};
+
+		//senders and receivers each get their own cache line so they do not slow each other down
+		alignas(64) atomic<size_t> sendPosition{};
+		alignas(64) atomic<size_t> receivePosition{};
+
+		static int _LuaSend(lua_State* state);
+		static int _LuaTryReceive(lua_State* state);
+		static int _LuaReceive(lua_State* state);
+		static int _LuaReceiveContinue(
+			lua_State* state,
+			int status,
+			lua_KContext context);
+		static int _LuaSize(lua_State* state);
+	};
+}
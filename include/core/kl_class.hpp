@@ -0,0 +1,534 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::tuple;
+	using std::tuple_element_t;
+	using std::decay_t;
+	using std::is_class_v;
+	using std::is_const_v;
+	using std::is_base_of_v;
+	using std::is_member_object_pointer_v;
+	using std::is_member_function_pointer_v;
+	using std::remove_reference_t;
+	using std::invoke;
+	using std::invoke_result_t;
+	using std::index_sequence_for;
+	using std::forward;
+	using std::move;
+	using std::max;
+
+	//The address of key is unique per bound type and keys its metatable in the registry of each state
+	template<typename T>
+	struct LuaClassKey
+	{
+		static inline const char key{};
+	};
+
+	//Wraps a value that is moved into a new userdata owned by Lua,
+	//__gc destroys the value once Lua no longer references it
+	template<typename T>
+	struct LuaOwned
+	{
+		T value;
+	};
+
+	//Every instance userdata starts with a pointer to its object,
+	//owned instances store the object itself after that pointer
+	template<typename T>
+	struct LuaObjectLayout
+	{
+		//same as LUAI_MAXALIGN, the alignment lua_newuserdatauv guarantees
+		static constexpr size_t USERDATA_ALIGNMENT = max(
+			{
+				alignof(lua_Number),
+				alignof(lua_Integer),
+				alignof(void*),
+				alignof(long)
+			});
+
+		static constexpr size_t VALUE_OFFSET = (sizeof(T*) + alignof(T) - 1) / alignof(T) * alignof(T);
+		static constexpr size_t OWNED_SIZE = VALUE_OFFSET + sizeof(T);
+
+		static T* GetObject(void* userdata) { return *scast<T**>(userdata); }
+	};
+
+	//Pointer to an object of a bound class, pushed as a userdata that does not own the object,
+	//so the object must outlive every Lua reference to it, nullptr maps to nil.
+	//Classes that were never bound in the state are pushed as nil
+	template<typename T>
+		requires (is_class_v<T>
+		&& !is_const_v<T>)
+	struct LuaStack<T*>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, T* value)
+		{
+			if (!value
+				|| lua_rawgetp(state, LUA_REGISTRYINDEX, &LuaClassKey<T>::key) != LUA_TTABLE)
+			{
+				if (value) lua_pop(state, 1);
+				lua_pushnil(state);
+				return;
+			}
+
+			*scast<T**>(lua_newuserdatauv(state, sizeof(T*), 0)) = value;
+
+			//metatable below the userdata
+			lua_insert(state, -2);
+			lua_setmetatable(state, -2);
+		}
+
+		static bool Read(lua_State* state, int index, T*& out)
+		{
+			if (lua_isnil(state, index))
+			{
+				out = nullptr;
+				return true;
+			}
+
+			//owned and non-owned instances share the metatable, anything else has a different one
+			if (!lua_getmetatable(state, index)) return false;
+
+			lua_rawgetp(state, LUA_REGISTRYINDEX, &LuaClassKey<T>::key);
+			bool isInstance = lua_rawequal(state, -1, -2);
+			lua_pop(state, 2);
+
+			if (!isInstance) return false;
+
+			out = LuaObjectLayout<T>::GetObject(lua_touserdata(state, index));
+			return out != nullptr;
+		}
+	};
+
+	//Value of a bound class moved into a userdata that Lua owns,
+	//push only, read the instance back as a T* instead
+	template<typename T>
+		requires is_class_v<T>
+	struct LuaStack<LuaOwned<T>>
+	{
+		static_assert(
+			alignof(T) <= LuaObjectLayout<T>::USERDATA_ALIGNMENT,
+			"Over-aligned types cannot be owned by Lua");
+
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const LuaOwned<T>& value)
+		{
+			_Emplace(state, value.value);
+		}
+
+		static void Push(lua_State* state, LuaOwned<T>&& value)
+		{
+			_Emplace(state, move(value.value));
+		}
+
+		static bool Read(lua_State*, int, LuaOwned<T>&)
+		{
+			static_assert(
+				sizeof(T) == 0,
+				"LuaOwned can only be passed to Lua, read a pointer to the class instead");
+
+			return false;
+		}
+	private:
+		template<typename V>
+		static void _Emplace(lua_State* state, V&& value)
+		{
+			//without the metatable __gc would never run, so the value is not moved at all
+			if (lua_rawgetp(state, LUA_REGISTRYINDEX, &LuaClassKey<T>::key) != LUA_TTABLE)
+			{
+				lua_pop(state, 1);
+				lua_pushnil(state);
+				return;
+			}
+
+			char* memory = scast<char*>(lua_newuserdatauv(state, LuaObjectLayout<T>::OWNED_SIZE, 0));
+			T* object = new (memory + LuaObjectLayout<T>::VALUE_OFFSET) T(forward<V>(value));
+			*reinterpret_cast<T**>(memory) = object;
+
+			//the metatable is only set once the object exists, so __gc never sees a half built one
+			lua_insert(state, -2);
+			lua_setmetatable(state, -2);
+		}
+	};
+
+	//Return and arg types of a member function, stored as an empty tag
+	template<typename R, typename... Args>
+	struct LuaMethodSignature {};
+
+	template<typename M>
+	struct LuaMethodTraits;
+
+	template<typename C, typename R, typename... Args>
+	struct LuaMethodTraits<R (C::*)(Args...)>
+	{
+		using Class = C;
+		using Signature = LuaMethodSignature<R, Args...>;
+		using ArgTuple = tuple<Args...>;
+	};
+
+	template<typename C, typename R, typename... Args>
+	struct LuaMethodTraits<R (C::*)(Args...) const>
+		: LuaMethodTraits<R (C::*)(Args...)> {};
+
+	template<typename C, typename R, typename... Args>
+	struct LuaMethodTraits<R (C::*)(Args...) noexcept>
+		: LuaMethodTraits<R (C::*)(Args...)> {};
+
+	template<typename C, typename R, typename... Args>
+	struct LuaMethodTraits<R (C::*)(Args...) const noexcept>
+		: LuaMethodTraits<R (C::*)(Args...)> {};
+
+	//The part of class binding that does not depend on the bound type,
+	//builds the metatable and the method and property tables in the registry of one state
+	class LIB_API LuaClassBase
+	{
+	public:
+		LuaClassBase(const LuaClassBase&) = delete;
+		LuaClassBase& operator=(const LuaClassBase&) = delete;
+		LuaClassBase(LuaClassBase&&) = delete;
+		LuaClassBase& operator=(LuaClassBase&&) = delete;
+
+		//Returns false if the class could not be bound, every later addition is then ignored
+		bool IsValid() const;
+	protected:
+		//same value as LUA_NOREF in lauxlib.h
+		static constexpr int NO_REF = -2;
+
+		LuaClassBase(
+			LuaState& state,
+			string_view className,
+			string_view classNamespace,
+			const void* classKey,
+			lua_CFunction collect);
+
+		~LuaClassBase();
+
+		//Store a closure with the metatable as its only upvalue into the method table
+		void _AddMethod(
+			string_view methodName,
+			lua_CFunction trampoline);
+
+		//Store the getter and the optional setter of a property,
+		//both get the metatable as their only upvalue
+		void _AddProperty(
+			string_view propertyName,
+			lua_CFunction getter,
+			lua_CFunction setter);
+
+		//Register the constructor as 'new' into the class table
+		void _AddConstructor(lua_CFunction constructor);
+	private:
+		LuaState* owner{};
+		//stateGeneration of the owner when the class was bound
+		u32 ownerGeneration{};
+
+		string className{};
+		//namespace path of the class table that holds the constructor
+		string classPath{};
+
+		int metatableRef = NO_REF;
+		int methodsRef = NO_REF;
+		int gettersRef = NO_REF;
+		int settersRef = NO_REF;
+
+		bool _CanAdd(
+			string_view memberName,
+			string_view memberType) const;
+
+		//Replace the plain method table in __index with the property aware dispatch
+		void _CreatePropertyTables(lua_State* luaState);
+
+		//__index once properties exist: methods first, then the property getter
+		static int _Index(lua_State* luaState);
+
+		//__newindex once properties exist: the property setter or an error
+		static int _NewIndex(lua_State* luaState);
+	};
+
+	//Binds a C++ class to a Lua state. Methods and properties are added once into a metatable
+	//that every instance shares, instances are full userdata that either point to an object
+	//C++ owns (push a T*) or own a value moved into them (push a LuaOwned<T> or call new from Lua).
+	//Every method gets its own trampoline that knows the member function at compile time,
+	//so a call from Lua does one table lookup on the Lua side and no string work on the C++ side.
+	//	LuaClass<Enemy>(state, "Enemy")
+	//		.Constructor<string, int>()
+	//		.Method<&Enemy::TakeDamage>("take_damage")
+	//		.Property<&Enemy::health>("health")
+	//		.Property<&Enemy::GetName, &Enemy::SetName>("name");
+	//Binding the same class again gives instances pushed after it a fresh metatable
+	template<typename T>
+	class LuaClass : public LuaClassBase
+	{
+		static_assert(
+			is_class_v<T>
+			&& !is_const_v<T>,
+			"LuaClass can only bind non-const class types");
+	public:
+		//Create the metatable of the class in this state, empty namespace places the class table
+		//in the global namespace, dotted namespace allows nesting namespaces (my.name.space)
+		LuaClass(
+			LuaState& state,
+			string_view className,
+			string_view classNamespace = "")
+			: LuaClassBase(
+				state,
+				className,
+				classNamespace,
+				&LuaClassKey<T>::key,
+				_Collect) {}
+
+		//Add a member function of T or one of its bases, called as obj:name(...) from Lua
+		template<auto M>
+			requires is_member_function_pointer_v<decltype(M)>
+		LuaClass& Method(string_view methodName)
+		{
+			using Traits = LuaMethodTraits<decltype(M)>;
+
+			static_assert(
+				is_base_of_v<typename Traits::Class, T>,
+				"Method must be a member function of the bound class or one of its bases");
+
+			_AssertSignature(typename Traits::Signature{});
+
+			_AddMethod(methodName, _MethodTrampoline<M>);
+			return *this;
+		}
+
+		//Add a data member as a property read and written as obj.name from Lua,
+		//const members are read-only
+		template<auto Member>
+			requires is_member_object_pointer_v<decltype(Member)>
+		LuaClass& Property(string_view propertyName)
+		{
+			_AssertProperty<GetterValue<Member>>();
+
+			if constexpr (is_const_v<remove_reference_t<invoke_result_t<decltype(Member), T&>>>)
+			{
+				_AddProperty(propertyName, _GetterTrampoline<Member>, nullptr);
+			}
+			else
+			{
+				_AddProperty(propertyName, _GetterTrampoline<Member>, _SetterTrampoline<Member>);
+			}
+
+			return *this;
+		}
+
+		//Add a property backed by a getter and a setter member function
+		template<auto Getter, auto Setter>
+			requires is_member_function_pointer_v<decltype(Setter)>
+		LuaClass& Property(string_view propertyName)
+		{
+			_AssertProperty<GetterValue<Getter>>();
+			_AssertProperty<SetterValue<Setter>>();
+
+			_AddProperty(propertyName, _GetterTrampoline<Getter>, _SetterTrampoline<Setter>);
+			return *this;
+		}
+
+		//Add a property that Lua can only read, from a data member or a getter member function
+		template<auto Getter>
+		LuaClass& ReadOnlyProperty(string_view propertyName)
+		{
+			_AssertProperty<GetterValue<Getter>>();
+
+			_AddProperty(propertyName, _GetterTrampoline<Getter>, nullptr);
+			return *this;
+		}
+
+		//Let Lua create instances it owns through ClassName.new(args...)
+		template<typename... Args>
+		LuaClass& Constructor()
+		{
+			LuaState::_AssertRegisterSignature<void, Args...>();
+
+			_AddConstructor(_ConstructTrampoline<Args...>);
+			return *this;
+		}
+	private:
+		template<auto Getter>
+		using GetterValue = decay_t<invoke_result_t<decltype(Getter), T&>>;
+
+		template<auto Setter>
+		using SetterValue = decay_t<tuple_element_t<0, typename LuaMethodTraits<decltype(Setter)>::ArgTuple>>;
+
+		template<typename R, typename... Args>
+		static constexpr void _AssertSignature(LuaMethodSignature<R, Args...>)
+		{
+			LuaState::_AssertRegisterSignature<R, Args...>();
+		}
+
+		template<typename V>
+		static constexpr void _AssertProperty()
+		{
+			static_assert(
+				IsLuaStackCompatible<V>
+				&& LuaStack<V>::slots == 1,
+				"Property type must be a single value supported by LuaStack");
+		}
+
+		//Get the object behind arg 1, nullptr if it is not an instance of the metatable in upvalue 1
+		static T* _CheckSelf(lua_State* callState)
+		{
+			if (!lua_getmetatable(callState, 1)) return nullptr;
+
+			bool isInstance = lua_rawequal(callState, -1, lua_upvalueindex(1));
+			lua_pop(callState, 1);
+
+			return isInstance
+				? LuaObjectLayout<T>::GetObject(lua_touserdata(callState, 1))
+				: nullptr;
+		}
+
+		template<auto M>
+		static int _MethodTrampoline(lua_State* callState)
+		{
+			T* object = _CheckSelf(callState);
+			if (!object)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Method was called on a value that is not an instance of its class!");
+			}
+
+			//the remaining args start at 1 like they do for registered functions
+			lua_remove(callState, 1);
+
+			return _InvokeMethod<M>(
+				callState,
+				object,
+				typename LuaMethodTraits<decltype(M)>::Signature{});
+		}
+
+		template<auto M, typename R, typename... Args>
+		static int _InvokeMethod(
+			lua_State* callState,
+			T* object,
+			LuaMethodSignature<R, Args...>)
+		{
+			return LuaState::_InvokeFromStack<R, Args...>(
+				callState,
+				[object](Args&&... args) -> R
+				{
+					return (object->*M)(forward<Args>(args)...);
+				},
+				nullptr,
+				index_sequence_for<Args...>{});
+		}
+
+		template<auto Getter>
+		static int _GetterTrampoline(lua_State* callState)
+		{
+			T* object = _CheckSelf(callState);
+			if (!object)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Property was read from a value that is not an instance of its class!");
+			}
+
+			//the copy of the value must not be jumped over by a memory error
+			LuaLimitScope limitScope(callState, false);
+
+			LuaStack<GetterValue<Getter>>::Push(
+				callState,
+				invoke(Getter, *object));
+
+			return 1;
+		}
+
+		template<auto Setter>
+		static int _SetterTrampoline(lua_State* callState)
+		{
+			T* object = _CheckSelf(callState);
+			if (!object)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Property was written to a value that is not an instance of its class!");
+			}
+
+			bool isRead{};
+
+			//the value must be destroyed before luaL_error jumps out of this function
+			{
+				if constexpr (is_member_object_pointer_v<decltype(Setter)>)
+				{
+					GetterValue<Setter> value{};
+					isRead = LuaStack<GetterValue<Setter>>::Read(callState, 2, value);
+
+					if (isRead) invoke(Setter, *object) = move(value);
+				}
+				else
+				{
+					SetterValue<Setter> value{};
+					isRead = LuaStack<SetterValue<Setter>>::Read(callState, 2, value);
+
+					if (isRead) invoke(Setter, *object, move(value));
+				}
+			}
+
+			if (!isRead)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Value assigned to property has an unsupported type!");
+			}
+
+			return 0;
+		}
+
+		template<typename... Args>
+		static int _ConstructTrampoline(lua_State* callState)
+		{
+			return LuaState::_InvokeFromStack<LuaOwned<T>, Args...>(
+				callState,
+				[](Args&&... args) -> LuaOwned<T>
+				{
+					return LuaOwned<T>{ T(forward<Args>(args)...) };
+				},
+				nullptr,
+				index_sequence_for<Args...>{});
+		}
+
+		static int _Collect(lua_State* gcState)
+		{
+			//only owned instances are larger than the pointer to their object
+			if (lua_rawlen(gcState, 1) > sizeof(T*))
+			{
+				T*& object = *scast<T**>(lua_touserdata(gcState, 1));
+				if (object)
+				{
+					object->~T();
+					object = nullptr;
+				}
+			}
+
+			return 0;
+		}
+	};
+}
@@ -8,120 +8,168 @@
 #include <string>
 #include <functional>
 #include <vector>
-#include <variant>
-#include <type_traits>
 #include <utility>
-
-extern "C"
-{
-#include "lua.h"
-}
+#include <span>
 
 #include "core_utils.hpp"
-#include "log_utils.hpp"
 
-#include "core/kl_core.hpp"
+#include "core/kl_state.hpp"
 
 namespace KalaLua::Core
 {
-	using std::string;
 	using std::string_view;
 	using std::function;
 	using std::vector;
-	using std::variant;
-	using std::is_void_v;
-	using std::is_pointer_v;
-	using std::is_same_v;
-	using std::is_invocable_r_v;
-	using std::index_sequence;
-	using std::index_sequence_for;
-	using std::get;
-	using std::bad_variant_access;
-	using std::holds_alternative;
 	using std::forward;
-	using std::optional;
-	using std::nullopt;
+	using std::span;
+
+	//Static API over one process-wide default LuaState,
+	//create your own LuaState objects for more than one interpreter
+	class LIB_API Lua
+	{
+	public:
+		//Get the default state every static Lua function forwards to
+		static LuaState& GetDefaultState();
+
+		//Choose the allocator lua_newstate gets and its memory limit, only valid before Initialize,
+		//the default is the system allocator with no limit
+		static bool SetAllocator(const LuaAllocatorConfig& config)
+		{
+			return GetDefaultState().SetAllocator(config);
+		}
 
-	using u8 = uint8_t;
+		//Change the memory limit at any time, 0 is unlimited,
+		//Lua code that allocates past it gets a catchable 'not enough memory' error
+		static void SetMemoryLimit(size_t memoryLimit) { GetDefaultState().SetMemoryLimit(memoryLimit); }
 
-	using KalaHeaders::KalaLog::Log;
-	using KalaHeaders::KalaLog::LogType;
+		//Get bytes in use, peak bytes and allocation counts per size class
+		static const LuaMemoryStats& GetMemoryStats() { return GetDefaultState().GetMemoryStats(); }
 
-	enum class LuaLibrary : u8
-	{
-		//adds coroutine support.
-		//LUA_COLIBNAME / luaopen_coroutine
-		LUA_COROUTINE,
+		static void ResetMemoryPeak() { GetDefaultState().ResetMemoryPeak(); }
+
+		//Open the libraries passed to Initialize the first time a script touches their global
+		//instead of during Initialize, only valid before Initialize. Base functions are still
+		//opened right away, 'require' opens package and string methods open string
+		static bool SetLazyLibraries(bool enabled) { return GetDefaultState().SetLazyLibraries(enabled); }
 
-		//adds table utils.
-		//LUA_TABLIBNAME / luaopen_table
-		LUA_TABLE,
+		//Initialize KalaLua, does not load scripts or functions.
+		//Optionally add extra Lua libraries, base Lua functions (LUA_GNAME / luaopen_base) are always added.
+		static bool Initialize(const vector<LuaLibrary>& libs = {})
+		{
+			return GetDefaultState().Initialize(libs);
+		}
 
-		//adds string manipulation utils.
-		//LUA_STRLIBNAME / luaopen_string
-		LUA_STRING,
+		static bool IsInitialized() { return GetDefaultState().IsInitialized(); }
 
-		//adds extra math functions.
-		//LUA_MATHLIBNAME / luaopen_math
-		LUA_MATH,
+		//Get the libraries that are open right now, with lazy libraries
+		//only the ones that were touched so far, LUA_ALL is listed as each library
+		static const vector<LuaLibrary>& GetLoadedLibraries() { return GetDefaultState().GetLoadedLibraries(); }
 
-		//adds utf-8 string handling.
-		//LUA_UTF8LIBNAME / luaopen_utf8
-		LUA_UTF8,
+		//Get the pointer to lua state stored within KalaLua
+		//after it has initialized, recommended only for advanced users
+		static lua_State* GetLuaState() { return GetDefaultState().GetLuaState(); }
 
-		//adds modules and enables dynamic library loading.
-		//LUA_LOADLIBNAME / luaopen_package
-		LUA_PACKAGE,
+		//Switch to the incremental collector and set its parameters
+		static bool SetIncrementalGC(const LuaGCIncrementalParams& params = {})
+		{
+			return GetDefaultState().SetIncrementalGC(params);
+		}
 
-		//adds file I/O utils.
-		//LUA_IOLIBNAME / luaopen_io
-		LUA_IO,
+		//Switch to the generational collector and set its parameters
+		static bool SetGenerationalGC(const LuaGCGenerationalParams& params = {})
+		{
+			return GetDefaultState().SetGenerationalGC(params);
+		}
 
-		//adds OS interaction utils.
-		//LUA_OSLIBNAME / luaopen_os
-		LUA_OS,
+		//Stop automatic collection, the heap only shrinks through StepGCFor and CollectGarbage
+		static void StopGC() { GetDefaultState().StopGC(); }
 
-		//adds debugging utils.
-		//LUA_DBLIBNAME / luaopen_debug
-		LUA_DEBUG,
+		//Resume automatic collection
+		static void RestartGC() { GetDefaultState().RestartGC(); }
 
-		//adds all of the available lua libraries
-		LUA_ALL
-	};
+		//Do basic collection steps until the time budget runs out or the current cycle finishes,
+		//spend idle frame time here to keep collection out of hot frames,
+		//returns true if a cycle finished
+		static bool StepGCFor(u32 microseconds) { return GetDefaultState().StepGCFor(microseconds); }
 
-	using LuaVar = variant
-	<
-		int,
-		float,
-		double,
-		bool,
-		string
-	>;
-
-	//Returns false if variable not found in LuaVar is used
-	template<typename T>
-	constexpr bool IsLuaVarCompatible =
-		is_same_v<T, int> 
-		|| is_same_v<T, float>
-		|| is_same_v<T, double>
-		|| is_same_v<T, bool>
-		|| is_same_v<T, string>;
+		//Run a full collection cycle right now
+		static void CollectGarbage() { GetDefaultState().CollectGarbage(); }
 
-	class LIB_API Lua
-	{
-	public:
-		//Initialize KalaLua, does not load scripts or functions.
-		//Optionally add extra Lua libraries, base Lua functions (LUA_GNAME / luaopen_base) are always added.
-		static bool Initialize(const vector<LuaLibrary>& libs = {});
+		//Get the heap size, collector mode and time spent collecting
+		static LuaGCStats GetGCStats() { return GetDefaultState().GetGCStats(); }
 
-		static bool IsInitialized();
+		//Load and compile a lua script for use via CallFunction,
+		//the file is memory-mapped and compiled straight from the mapping,
+		//goes through the bytecode cache if one is set
+		static bool LoadScript(
+			string_view script,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY)
+		{
+			return GetDefaultState().LoadScript(
+				script,
+				mode);
+		}
 
-		//Get the pointer to lua state stored within KalaLua
-		//after it has initialized, recommended only for advanced users
-		static lua_State* GetLuaState();
+		//Load and compile a lua script from memory for use via CallFunction,
+		//for scripts stored in asset packs or generated at runtime,
+		//name is used as the chunk name in Lua errors and log messages,
+		//goes through the bytecode cache if one is set
+		static bool LoadScriptFromBuffer(
+			string_view name,
+			span<const char> buffer,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY)
+		{
+			return GetDefaultState().LoadScriptFromBuffer(
+				name,
+				buffer,
+				mode);
+		}
+
+		//Save compiled scripts into cacheDirectory and load them from there on later runs,
+		//entries are keyed by the chunk name, source content hash and Lua version so edited scripts
+		//and other Lua builds are recompiled, stripping debug info makes chunks smaller
+		//but removes line numbers from Lua errors, an empty directory disables the cache
+		static bool SetBytecodeCache(
+			string_view cacheDirectory,
+			bool stripDebugInfo = false)
+		{
+			return GetDefaultState().SetBytecodeCache(
+				cacheDirectory,
+				stripDebugInfo);
+		}
+
+		static const LuaBytecodeCacheStats& GetBytecodeCacheStats()
+		{
+			return GetDefaultState().GetBytecodeCacheStats();
+		}
+
+		static void ResetBytecodeCacheStats() { GetDefaultState().ResetBytecodeCacheStats(); }
+
+		//Watch every file loaded through LoadScript, nothing reloads until PollHotReload
+		static bool EnableHotReload() { return GetDefaultState().EnableHotReload(); }
+
+		static void DisableHotReload() { GetDefaultState().DisableHotReload(); }
+
+		static bool IsHotReloadEnabled() { return GetDefaultState().IsHotReloadEnabled(); }
+
+		//Recompile and rerun every watched script that changed since the last poll,
+		//a script that fails to compile keeps its previous version
+		static u32 PollHotReload() { return GetDefaultState().PollHotReload(); }
+
+		//Get the sampling profiler of the default state
+		static LuaProfiler& GetProfiler() { return GetDefaultState().GetProfiler(); }
+
+		//Get the per-function call metrics of the default state
+		static LuaMetrics& GetMetrics() { return GetDefaultState().GetMetrics(); }
+
+		//Set the budget every call from C++ and every script load of the default state runs under,
+		//a call that runs past it is aborted with a Lua error and fails like any other call
+		static void SetExecutionBudget(const LuaExecutionBudget& budget) { GetDefaultState().SetExecutionBudget(budget); }
 
-		//Load and compile a lua script for use via CallFunction
-		static bool LoadScript(string_view script);
+		static const LuaExecutionBudget& GetExecutionBudget() { return GetDefaultState().GetExecutionBudget(); }
+
+		//Abort the call into Lua that the default state is running right now, safe from any thread
+		static void Interrupt() { GetDefaultState().Interrupt(); }
 
 		//Call a function from one of the loaded lua scripts with N number of args,
 		//default void-only return type, cannot return any LuaVar types,
@@ -133,7 +181,7 @@ namespace KalaLua::Core
 			string_view functionNamespace,
 			const vector<LuaVar>& args = {})
 		{
-			_CallFunction(
+			GetDefaultState().CallFunction(
 				functionName,
 				functionNamespace,
 				args);
@@ -145,191 +193,254 @@ namespace KalaLua::Core
 		//no dot in namespace calls function in parent namespace,
 		//dotted namespace allows nesting namespace calls (my.name.space.function)
 		template<typename R>
+			requires IsLuaVarCompatible<R>
 		static optional<R> CallFunction(
 			string_view functionName,
 			string_view functionNamespace,
 			const vector<LuaVar>& args = {})
 		{
-			static_assert(
-				IsLuaVarCompatible<R>,
-				"Unsupported return type was passed to CallFunction");
+			return GetDefaultState().CallFunction<R>(
+				functionName,
+				functionNamespace,
+				args);
+		}
+
+		//Call a function from one of the loaded lua scripts with N number of typed args,
+		//each arg is pushed straight to the Lua stack without building a LuaVar vector,
+		//R can be void (returns true on success) or any LuaStack-compatible type,
+		//pass a tuple as R to receive multiple return values in one call,
+		//string_view and const char* returns stay valid until the next call that returns one,
+		//empty namespace calls function in global namespace,
+		//no dot in namespace calls function in parent namespace,
+		//dotted namespace allows nesting namespace calls (my.name.space.function)
+		template<typename R = void, typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		static LuaCallResult<R> CallFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			Args&&... args)
+		{
+			return GetDefaultState().CallFunction<R>(
+				functionName,
+				functionNamespace,
+				forward<Args>(args)...);
+		}
+
+		//Resolve a function from one of the loaded lua scripts once and
+		//return a handle to it that can be called any number of times,
+		//returns an invalid handle if the namespace or function does not exist,
+		//empty namespace resolves function in global namespace,
+		//no dot in namespace resolves function in parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space.function)
+		static LuaFunctionRef GetFunctionRef(
+			string_view functionName,
+			string_view functionNamespace)
+		{
+			return GetDefaultState().GetFunctionRef(
+				functionName,
+				functionNamespace);
+		}
+
+		//Release the registry slot held by a function handle and invalidate it
+		static void ReleaseFunctionRef(LuaFunctionRef& functionRef)
+		{
+			GetDefaultState().ReleaseFunctionRef(functionRef);
+		}
+
+		//Drop every cached namespace, replaced namespace tables are noticed on their next use
+		//without this, but the cache keeps them alive until then
+		static void InvalidateNamespaceCache() { GetDefaultState().InvalidateNamespaceCache(); }
+
+		//Call a function through a resolved handle with N number of args,
+		//default void-only return type, cannot return any LuaVar types
+		static void CallFunction(
+			LuaFunctionRef& functionRef,
+			const vector<LuaVar>& args = {})
+		{
+			GetDefaultState().CallFunction(
+				functionRef,
+				args);
+		}
+
+		//Call a function through a resolved handle with N number of args,
+		//returns void on failure, can return any LuaVar type
+		template<typename R>
+			requires IsLuaVarCompatible<R>
+		static optional<R> CallFunction(
+			LuaFunctionRef& functionRef,
+			const vector<LuaVar>& args = {})
+		{
+			return GetDefaultState().CallFunction<R>(
+				functionRef,
+				args);
+		}
+
+		//Call a function through a resolved handle with N number of typed args,
+		//each arg is pushed straight to the Lua stack without building a LuaVar vector,
+		//R can be void (returns true on success) or any LuaStack-compatible type,
+		//pass a tuple as R to receive multiple return values in one call,
+		//string_view and const char* returns stay valid until the next call that returns one
+		template<typename R = void, typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		static LuaCallResult<R> CallFunction(
+			LuaFunctionRef& functionRef,
+			Args&&... args)
+		{
+			return GetDefaultState().CallFunction<R>(
+				functionRef,
+				forward<Args>(args)...);
+		}
+
+		//Call one function from the loaded lua scripts once for every element of a contiguous range,
+		//an element is a single LuaStack-compatible arg or a tuple of args for several,
+		//the function is resolved once and stays on the stack for every call,
+		//results[i] gets the result of args[i] the same way the typed CallFunction returns it,
+		//a failing element is logged and leaves false or nullopt without aborting the batch,
+		//results can be empty to discard them, returns the number of calls that succeeded
+		template<typename R = void, typename Range>
+			requires contiguous_range<const Range>
+			&& IsLuaStackCompatible<range_value_t<Range>>
+		static size_t CallFunctionBatch(
+			string_view functionName,
+			string_view functionNamespace,
+			const Range& args,
+			span<LuaCallResult<R>> results = {})
+		{
+			return GetDefaultState().CallFunctionBatch<R>(
+				functionName,
+				functionNamespace,
+				args,
+				results);
+		}
 
-			LuaVar ret{};
-			if (!_CallFunction(
+		//Call one function from the loaded lua scripts count times with the args fill returns for each index,
+		//fill(index) returns a single LuaStack-compatible arg or a tuple of args,
+		//results behave the same as in the range overload
+		template<typename R = void, typename F>
+			requires IsLuaStackCompatible<invoke_result_t<F&, size_t>>
+		static size_t CallFunctionBatch(
+			string_view functionName,
+			string_view functionNamespace,
+			size_t count,
+			F&& fill,
+			span<LuaCallResult<R>> results = {})
+		{
+			return GetDefaultState().CallFunctionBatch<R>(
 				functionName,
 				functionNamespace,
+				count,
+				forward<F>(fill),
+				results);
+		}
+
+		//Call a function through a resolved handle once for every element of a contiguous range,
+		//behaves the same as the named range overload
+		template<typename R = void, typename Range>
+			requires contiguous_range<const Range>
+			&& IsLuaStackCompatible<range_value_t<Range>>
+		static size_t CallFunctionBatch(
+			LuaFunctionRef& functionRef,
+			const Range& args,
+			span<LuaCallResult<R>> results = {})
+		{
+			return GetDefaultState().CallFunctionBatch<R>(
+				functionRef,
 				args,
-				&ret))
-			{
-				return nullopt;
-			}
-
-			try
-			{
-				return ExtractLuaVar<R>(ret);
-			}
-			catch (...)
-			{
-				Log::Print(
-					"Unsupported variable type was passed to CallFunction function '" + string(functionName) + "'!",
-					"KALALUA_CALL_FUNCTION",
-					LogType::LOG_ERROR,
-					2);
-
-				return nullopt;
-			}
+				results);
+		}
+
+		//Call a function through a resolved handle count times with the args fill returns for each index,
+		//behaves the same as the named fill overload
+		template<typename R = void, typename F>
+			requires IsLuaStackCompatible<invoke_result_t<F&, size_t>>
+		static size_t CallFunctionBatch(
+			LuaFunctionRef& functionRef,
+			size_t count,
+			F&& fill,
+			span<LuaCallResult<R>> results = {})
+		{
+			return GetDefaultState().CallFunctionBatch<R>(
+				functionRef,
+				count,
+				forward<F>(fill),
+				results);
 		}
 
 		//Register a function into KalaLua for lua to use externally,
-		//this overload accepts functionals and targetFunction can return LuaVar or nothing,
+		//this overload accepts functionals and targetFunction can return LuaVar,
+		//a tuple of them for multiple return values, or nothing,
 		//accepts N number of any args defined in LuaVar,
 		//empty namespace moves function to global namespace,
 		//no dot in namespace moves function to parent namespace,
-		//dotted namespace allows nesting namespaces (my.name.space)
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
 		template<typename... Args, typename R>
-		static inline void RegisterFunction(
+		static inline bool RegisterFunction(
 			string_view functionName,
 			string_view functionNamespace,
 			const function<R(Args...)>& targetFunction)
 		{
-			static_assert(
-				(IsLuaVarCompatible<Args> && ...),
-				"Unsupported argument type was passed to RegisterFunction");
-
-			static_assert(
-				is_void_v<R>
-				|| IsLuaVarCompatible<R>,
-				"Unsupported return type was passed to RegisterFunction");
-
-			auto invoker = [functionName, targetFunction](const vector<LuaVar>& args) -> optional<LuaVar>
-				{
-					if (args.size() != sizeof...(Args))
-					{
-						Log::Print(
-							"Argument count mismatch when invoking function '" + string(functionName) + "'!",
-							"KALALUA_REGISTER_FUNCTION",
-							LogType::LOG_ERROR,
-							2);
-
-						return nullopt;
-					}
-
-					if constexpr (is_void_v<R>)
-					{
-						InvokeTyped(
-							targetFunction,
-							args,
-							index_sequence_for<Args...>{});
-
-						return nullopt;
-					}
-					else
-					{
-						R result = InvokeTypedReturn(
-							targetFunction,
-							args,
-							index_sequence_for<Args...>{});
-
-						return LuaVar{ result };
-					}
-				};
-
-			_RegisterFunction(
+			return GetDefaultState().RegisterFunction(
 				functionName,
 				functionNamespace,
-				invoker);
+				targetFunction);
 		}
 
 		//Register a function into KalaLua for lua to use externally,
-		//this overload accepts free functions and targetFunction can return LuaVar or nothing,,
+		//this overload accepts free functions and targetFunction can return LuaVar,
+		//a tuple of them for multiple return values, or nothing,
 		//accepts N number of any args defined in LuaVar,
 		//empty namespace moves function to global namespace,
 		//no dot in namespace moves function to parent namespace,
-		//dotted namespace allows nesting namespaces (my.name.space)
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
 		template<typename... Args, typename R>
-		static inline void RegisterFunction(
+		static inline bool RegisterFunction(
 			string_view functionName,
 			string_view functionNamespace,
 			R (*func)(Args...))
 		{
-			RegisterFunction(
+			return GetDefaultState().RegisterFunction(
 				functionName,
 				functionNamespace,
-				function<R(Args...)>(func));
+				func);
 		}
 
 		//Register a function into KalaLua for lua to use externally,
-		//this overload accepts custom lua functions, recommended only for advanced users,
+		//this overload takes the free function as a template argument (RegisterFunction<&MyFunction>)
+		//and calls it directly from its trampoline with no functional or upvalue in between,
 		//empty namespace moves function to global namespace,
 		//no dot in namespace moves function to parent namespace,
-		//dotted namespace allows nesting namespaces (my.name.space)
-		static void RegisterFunction(
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		template<auto F>
+		static inline bool RegisterFunction(
 			string_view functionName,
-			string_view functionNamespace,
-			const function<int(lua_State*)>& targetFunction);
-
-		//Shut down KalaLua and the Lua runtime
-		static void Shutdown();
-	private:
-		template<typename... Args, size_t... I>
-		static inline void InvokeTyped(
-			const function<void(Args...)>& targetFunction,
-			const vector<LuaVar>& args,
-			index_sequence<I...>)
-		{
-			targetFunction(ExtractLuaVar<Args>(args[I])...);
-		}
-
-		template<typename... Args, size_t... I, typename R>
-		static inline R InvokeTypedReturn(
-			const function<R(Args...)>& targetFunction,
-			const vector<LuaVar>& args,
-			index_sequence<I...>)
+			string_view functionNamespace)
 		{
-			return targetFunction(ExtractLuaVar<Args>(args[I])...);
-		}
-
-		//Numeric extraction helper to help lua cast into int/float/double correctly
-		template<typename T>
-		static T ExtractLuaVar(const LuaVar& v)
-		{
-			if constexpr (is_same_v<T, int>)
-			{
-				if (holds_alternative<int>(v))     return get<int>(v);
-				if (holds_alternative<double>(v))  return scast<int>(get<double>(v));
-				if (holds_alternative<float>(v))   return scast<int>(get<float>(v));
-			}
-			else if constexpr (is_same_v<T, float>)
-			{
-				if (holds_alternative<float>(v))   return get<float>(v);
-				if (holds_alternative<double>(v))  return scast<float>(get<double>(v));
-				if (holds_alternative<int>(v))     return scast<float>(get<int>(v));
-			}
-			else if constexpr (is_same_v<T, double>)
-			{
-				if (holds_alternative<double>(v)) return get<double>(v);
-				if (holds_alternative<int>(v))    return scast<double>(get<int>(v));
-				if (holds_alternative<float>(v))  return scast<double>(get<float>(v));
-			}
-			else return get<T>(v);
-
-			KalaLuaCore::ForceClose(
-				"KalaLua type cast error",
-				"ExtractLuaVar failed to cast unsupported type!");
+			return GetDefaultState().RegisterFunction<F>(
+				functionName,
+				functionNamespace);
 		}
 
-		//The internal true function caller
-		static bool _CallFunction(
+		//Register a function into KalaLua for lua to use externally,
+		//this overload accepts custom lua functions, recommended only for advanced users,
+		//empty namespace moves function to global namespace,
+		//no dot in namespace moves function to parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		static bool RegisterFunction(
 			string_view functionName,
 			string_view functionNamespace,
-			const vector<LuaVar>& args,
-			LuaVar* outReturn = nullptr);
+			const function<int(lua_State*)>& targetFunction)
+		{
+			return GetDefaultState().RegisterFunction(
+				functionName,
+				functionNamespace,
+				targetFunction);
+		}
 
-		//The internal true register function that is used
-		//to register the function after parsing args
-		static bool _RegisterFunction(
-			string_view functionName,
-			string_view functionNamespace,
-			function<optional<LuaVar>(const vector<LuaVar>&)> invoker);
+		//Shut down KalaLua and the Lua runtime
+		static void Shutdown() { GetDefaultState().Shutdown(); }
 	};
-}
\ No newline at end of file
+}
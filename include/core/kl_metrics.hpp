@@ -0,0 +1,225 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <bit>
+#include <functional>
+#include <cstdint>
+
+#include "core_utils.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::vector;
+	using std::array;
+	using std::unordered_map;
+	using std::unique_ptr;
+	using std::mutex;
+	using std::atomic;
+	using std::memory_order_relaxed;
+	using std::hash;
+	using std::equal_to;
+	using std::bit_width;
+	using std::chrono::steady_clock;
+	using std::chrono::duration_cast;
+	using std::chrono::nanoseconds;
+
+	using u8 = uint8_t;
+	using u32 = uint32_t;
+	using u64 = uint64_t;
+
+	enum class LuaMetricsSource : u8
+	{
+		//a Lua function called from C++ through CallFunction or CallFunctionBatch
+		LUA_FUNCTION,
+
+		//a C++ function registered through RegisterFunction and called from Lua
+		REGISTERED_FUNCTION
+	};
+
+	//bucket 0 holds calls under 1ns, bucket i holds calls of [2^(i-1), 2^i) nanoseconds,
+	//the last bucket also holds everything slower than it
+	constexpr u32 LUA_LATENCY_BUCKETS = 32;
+
+	//A copy of the counters of one function taken at one point in time
+	struct LuaFunctionMetricsSnapshot
+	{
+		//namespaced name, for example "my.space.function"
+		string name{};
+		LuaMetricsSource source{};
+
+		u64 calls{};
+		//calls that raised a Lua error, they are included in calls and the latencies
+		u64 errors{};
+
+		u64 totalNanoseconds{};
+		u64 maxNanoseconds{};
+
+		array<u64, LUA_LATENCY_BUCKETS> latencyBuckets{};
+
+		u64 GetMeanNanoseconds() const { return calls ? totalNanoseconds / calls : 0; }
+
+		//The upper bound of the bucket the percentile (0 - 100) falls into
+		u64 GetPercentileNanoseconds(double percentile) const;
+	};
+
+	//Live counters of one function, only written by the thread that runs its state
+	//and read by any thread, so every counter is a relaxed atomic instead of a lock
+	class LuaFunctionMetrics
+	{
+		friend class LuaMetrics;
+	public:
+		//Returns the start time of a call or 0 if metrics are disabled
+		u64 BeginCall() const
+		{
+			if (!isEnabled.load(memory_order_relaxed)) return 0;
+
+			return _NowNanoseconds();
+		}
+
+		//Record a call that started at start, does nothing for calls that began while disabled
+		void EndCall(
+			u64 start,
+			bool failed)
+		{
+			if (start == 0) return;
+
+			u64 elapsed = _NowNanoseconds() - start;
+
+			calls.fetch_add(1, memory_order_relaxed);
+			if (failed) errors.fetch_add(1, memory_order_relaxed);
+
+			totalNanoseconds.fetch_add(elapsed, memory_order_relaxed);
+			if (elapsed > maxNanoseconds.load(memory_order_relaxed))
+			{
+				maxNanoseconds.store(elapsed, memory_order_relaxed);
+			}
+
+			u32 bucket = scast<u32>(bit_width(elapsed));
+			if (bucket >= LUA_LATENCY_BUCKETS) bucket = LUA_LATENCY_BUCKETS - 1;
+
+			latencyBuckets[bucket].fetch_add(1, memory_order_relaxed);
+		}
+	private:
+		LuaFunctionMetrics(
+			string_view newName,
+			LuaMetricsSource newSource,
+			const atomic<bool>& enabled)
+			: name(newName),
+			source(newSource),
+			isEnabled(enabled) {}
+
+		string name{};
+		LuaMetricsSource source{};
+
+		//the flag of the owning LuaMetrics, read on every call
+		const atomic<bool>& isEnabled;
+
+		atomic<u64> calls{};
+		atomic<u64> errors{};
+		atomic<u64> totalNanoseconds{};
+		atomic<u64> maxNanoseconds{};
+		array<atomic<u64>, LUA_LATENCY_BUCKETS> latencyBuckets{};
+
+		static u64 _NowNanoseconds()
+		{
+			return scast<u64>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+		}
+
+		LuaFunctionMetricsSnapshot _GetSnapshot() const;
+
+		void _Reset();
+	};
+
+	//Opt-in call counts, latency histograms and error counts of every Lua function called
+	//from C++ and every registered C++ function called from Lua in one LuaState.
+	//While disabled a call costs one relaxed atomic load, while enabled it adds two clock
+	//reads and a few relaxed atomic adds, Lua functions also pay one name lookup per call.
+	//Snapshots can be taken from any thread while the state keeps running.
+	//C++ functions that raise a Lua error themselves, such as custom lua_State* functions
+	//calling lua_error, leave without returning and are not recorded
+	class LIB_API LuaMetrics
+	{
+		friend class LuaState;
+	public:
+		LuaMetrics() = default;
+
+		//registered closures keep pointers to the function entries, so this never moves
+		LuaMetrics(const LuaMetrics&) = delete;
+		LuaMetrics& operator=(const LuaMetrics&) = delete;
+		LuaMetrics(LuaMetrics&&) = delete;
+		LuaMetrics& operator=(LuaMetrics&&) = delete;
+
+		void Enable() { isEnabled.store(true, memory_order_relaxed); }
+		void Disable() { isEnabled.store(false, memory_order_relaxed); }
+		bool IsEnabled() const { return isEnabled.load(memory_order_relaxed); }
+
+		//Copy the counters of one function, name is namespaced like "my.space.function",
+		//returns false if the function was never called or registered
+		bool GetSnapshot(
+			string_view name,
+			LuaMetricsSource source,
+			LuaFunctionMetricsSnapshot& outSnapshot) const;
+
+		//Copy the counters of every function that was called or registered, sorted by name
+		vector<LuaFunctionMetricsSnapshot> GetSnapshots() const;
+
+		//One line per function with calls, errors, mean, p50, p99 and max latency
+		string ExportText() const;
+
+		//Zero every counter, functions stay known
+		void Reset();
+	private:
+		struct NameHash
+		{
+			using is_transparent = void;
+
+			size_t operator()(string_view name) const { return hash<string_view>{}(name); }
+		};
+
+		using EntryMap = unordered_map<string, unique_ptr<LuaFunctionMetrics>, NameHash, equal_to<>>;
+
+		atomic<bool> isEnabled{};
+
+		//entries are only added by the thread that runs the state, which looks them up
+		//without locking, the lock keeps other threads from reading the maps mid-insert
+		mutable mutex entriesMutex{};
+		EntryMap luaFunctions{};
+		EntryMap registeredFunctions{};
+
+		//reused for joining namespace and name so a lookup does not allocate
+		string nameBuffer{};
+
+		//Find or create the entry of a function, always returns a valid entry
+		LuaFunctionMetrics* _GetEntry(
+			string_view functionName,
+			string_view functionNamespace,
+			LuaMetricsSource source);
+
+		//The entry of a Lua function about to be called, nullptr while disabled
+		LuaFunctionMetrics* _GetCallEntry(
+			string_view functionName,
+			string_view functionNamespace)
+		{
+			if (!IsEnabled()) return nullptr;
+
+			return _GetEntry(
+				functionName,
+				functionNamespace,
+				LuaMetricsSource::LUA_FUNCTION);
+		}
+	};
+}
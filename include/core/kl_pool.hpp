@@ -0,0 +1,242 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <latch>
+#include <deque>
+#include <atomic>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::function;
+	using std::vector;
+	using std::unique_ptr;
+	using std::make_unique;
+	using std::future;
+	using std::packaged_task;
+	using std::thread;
+	using std::mutex;
+	using std::condition_variable;
+	using std::latch;
+	using std::deque;
+	using std::atomic;
+	using std::tuple;
+	using std::apply;
+	using std::decay_t;
+	using std::conditional_t;
+	using std::is_same_v;
+	using std::invoke_result_t;
+	using std::forward;
+	using std::move;
+
+	using u64 = uint64_t;
+
+	struct LuaPoolConfig
+	{
+		//number of worker threads and states, 0 uses one per hardware thread
+		u32 workerCount{};
+
+		//libraries every worker state is initialized with
+		vector<LuaLibrary> libraries{};
+
+		//scripts every worker state loads in this order after initializing
+		vector<string> scripts{};
+
+		//allocator and memory limit of every worker state, the limit applies per state
+		LuaAllocatorConfig allocator{};
+
+		//bytecode cache every worker state loads its scripts through, empty disables it
+		string bytecodeCacheDirectory{};
+		bool stripBytecodeDebugInfo{};
+
+		//called on every worker thread after its scripts are loaded,
+		//register the same functions on each state here
+		function<bool(LuaState&)> onWorkerSetup{};
+	};
+
+	struct LuaWorkerStats
+	{
+		//jobs this worker finished, including stolen ones
+		u64 jobsExecuted{};
+		//jobs this worker took from another worker's queue
+		u64 jobsStolen{};
+		//time spent running jobs since the pool started or stats were reset
+		u64 busyNanoseconds{};
+		//time since the pool started or stats were reset
+		u64 elapsedNanoseconds{};
+		//busy time divided by elapsed time, 0 to 1
+		double utilization{};
+	};
+
+	//A pool of worker threads that each own an identically set up LuaState.
+	//Jobs go to the per-worker queues round-robin, idle workers steal from the back
+	//of busy workers' queues so uneven jobs still keep every worker running
+	class LIB_API LuaStatePool
+	{
+	public:
+		LuaStatePool() = default;
+		~LuaStatePool();
+
+		LuaStatePool(const LuaStatePool&) = delete;
+		LuaStatePool& operator=(const LuaStatePool&) = delete;
+		LuaStatePool(LuaStatePool&&) = delete;
+		LuaStatePool& operator=(LuaStatePool&&) = delete;
+
+		//Start the worker threads, returns after every worker state has initialized,
+		//loaded its scripts and run onWorkerSetup, fails if any worker failed to set up
+		bool Initialize(const LuaPoolConfig& config);
+
+		bool IsInitialized() const { return isInitialized; }
+
+		u32 GetWorkerCount() const { return scast<u32>(workers.size()); }
+
+		//Submit a job that calls a Lua function with N number of typed args on whichever worker
+		//gets to it first, args are copied into the job and pushed with the typed CallFunction,
+		//the future holds the same result the typed CallFunction returns
+		template<typename R = void, typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		future<LuaCallResult<R>> Submit(
+			string_view functionName,
+			string_view functionNamespace,
+			Args&&... args)
+		{
+			static_assert(
+				!IsLuaBorrowed<R>,
+				"Submit cannot return string_view or const char* because the worker moves on to other calls, return string instead");
+
+			return SubmitJob(
+				[
+					functionName = string(functionName),
+					functionNamespace = string(functionNamespace),
+					values = tuple<StoredArg<Args>...>(forward<Args>(args)...)
+				](LuaState& state) -> LuaCallResult<R>
+				{
+					return apply([&](const auto&... a)
+						{
+							return state.CallFunction<R>(
+								functionName,
+								functionNamespace,
+								a...);
+						}, values);
+				});
+		}
+
+		//Submit any job that runs against the state of whichever worker gets to it first,
+		//jobs submitted from inside a worker go to that worker's own queue
+		template<typename F>
+		future<invoke_result_t<F&, LuaState&>> SubmitJob(F&& job)
+		{
+			using R = invoke_result_t<F&, LuaState&>;
+
+			auto task = make_unique<LuaPoolTask<R, decay_t<F>>>(forward<F>(job));
+			future<R> result = task->task.get_future();
+
+			if (!isInitialized)
+			{
+				Log::Print(
+					"Failed to submit job because the Lua state pool is not initialized!",
+					"KALALUA_POOL",
+					LogType::LOG_ERROR,
+					2);
+
+				//the broken promise reaches the caller through the future
+				return result;
+			}
+
+			Enqueue(move(task));
+
+			return result;
+		}
+
+		//Get the job and utilization stats of every worker, in worker order
+		vector<LuaWorkerStats> GetWorkerStats() const;
+
+		//Restart utilization tracking from zero on every worker
+		void ResetWorkerStats();
+
+		//Finish every queued job, stop the workers and close their states
+		void Shutdown();
+	private:
+		//string literals and views are copied into the job because the caller's buffer may be gone by then
+		template<typename T>
+		using StoredArg = conditional_t<
+			is_same_v<decay_t<T>, const char*>
+			|| is_same_v<decay_t<T>, char*>
+			|| is_same_v<decay_t<T>, string_view>,
+			string,
+			decay_t<T>>;
+
+		struct LuaPoolJob
+		{
+			virtual ~LuaPoolJob() = default;
+			virtual void Run(LuaState& state) = 0;
+		};
+
+		template<typename R, typename F>
+		struct LuaPoolTask : LuaPoolJob
+		{
+			packaged_task<R(LuaState&)> task;
+
+			explicit LuaPoolTask(F&& job) : task(move(job)) {}
+			explicit LuaPoolTask(const F& job) : task(job) {}
+
+			void Run(LuaState& state) override { task(state); }
+		};
+
+		struct Worker
+		{
+			thread workerThread{};
+
+			mutex queueMutex{};
+			deque<unique_ptr<LuaPoolJob>> queue{};
+
+			atomic<u64> jobsExecuted{};
+			atomic<u64> jobsStolen{};
+			atomic<u64> busyNanoseconds{};
+		};
+
+		vector<unique_ptr<Worker>> workers{};
+		LuaPoolConfig config{};
+
+		atomic<bool> isInitialized{};
+		atomic<bool> isStopping{};
+
+		//queued jobs across all workers, idle workers sleep while this is zero
+		atomic<u64> pendingJobs{};
+		atomic<u32> nextWorker{};
+		mutex sleepMutex{};
+		condition_variable sleepCondition{};
+
+		atomic<u64> statsStartNanoseconds{};
+
+		void Enqueue(unique_ptr<LuaPoolJob> job);
+
+		//Pop from this worker's own queue or steal from another one
+		unique_ptr<LuaPoolJob> TakeJob(u32 workerIndex);
+
+		void WorkerLoop(
+			u32 workerIndex,
+			atomic<bool>* setupFailed,
+			latch* setupDone);
+	};
+}
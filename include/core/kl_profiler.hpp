@@ -0,0 +1,164 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "core_utils.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::vector;
+	using std::unordered_map;
+
+	using u8 = uint8_t;
+	using u32 = uint32_t;
+	using u64 = uint64_t;
+
+	class LuaState;
+
+	enum class LuaProfilerMode : u8
+	{
+		//sample every instructionInterval Lua VM instructions
+		PROFILE_INSTRUCTIONS,
+
+		//sample every sampleIntervalMicroseconds of Lua execution, the clock is checked every
+		//instructionInterval instructions and whenever a function returns, so C++ functions
+		//that run past a due sample are recorded as the leaf frame of it
+		PROFILE_TIME
+	};
+
+	struct LuaProfilerConfig
+	{
+		LuaProfilerMode mode = LuaProfilerMode::PROFILE_TIME;
+
+		u32 instructionInterval = 1000;
+		u32 sampleIntervalMicroseconds = 1000;
+
+		//frames past this depth are cut from the root side of a sample
+		u32 maxStackDepth = 64;
+
+		//samples past this are dropped until the profile is cleared
+		u32 maxSamples = 1000000;
+	};
+
+	struct LuaProfilerStats
+	{
+		//stacks recorded, a time sample that covers several intervals counts once here
+		//and once per interval in the exported profile
+		u64 samples{};
+		//samples that did not fit into maxSamples
+		u64 droppedSamples{};
+		//samples deeper than maxStackDepth
+		u64 truncatedSamples{};
+		//distinct functions seen across all samples
+		u32 uniqueFrames{};
+	};
+
+	//Sampling profiler of one LuaState. While running it installs a count hook that records
+	//the Lua call stack of whichever thread is executing, C++ functions registered through
+	//KalaLua show up with their namespaced names. Samples are stored as frame ids in one flat
+	//buffer and only turned into text by ExportCollapsedStacks, in the collapsed stack format
+	//flamegraph tools read. No hook is installed while stopped, so a stopped profiler costs nothing.
+	//Coroutines created before Start keep the hook they were created with and are not sampled
+	class LIB_API LuaProfiler
+	{
+		friend class LuaState;
+	public:
+		explicit LuaProfiler(LuaState& owner) : owner(owner) {}
+
+		LuaProfiler(const LuaProfiler&) = delete;
+		LuaProfiler& operator=(const LuaProfiler&) = delete;
+		LuaProfiler(LuaProfiler&&) = delete;
+		LuaProfiler& operator=(LuaProfiler&&) = delete;
+
+		//Start sampling or change the config of a running profiler, samples so far are kept
+		bool Start(const LuaProfilerConfig& config = {});
+
+		//Stop sampling and remove the hook, samples are kept for export
+		void Stop();
+
+		bool IsRunning() const { return isRunning; }
+
+		const LuaProfilerConfig& GetConfig() const { return config; }
+
+		LuaProfilerStats GetStats() const;
+
+		//Aggregate every sample into one "root;caller;leaf count" line per unique stack
+		string ExportCollapsedStacks() const;
+
+		//Write ExportCollapsedStacks to a file, for example to feed flamegraph.pl
+		bool SaveCollapsedStacks(string_view filePath) const;
+
+		//Drop every sample and frame name
+		void Clear();
+
+		//Give the function at index the name profiles show for it,
+		//functions registered through KalaLua are named automatically
+		static void NameFunction(
+			lua_State* luaState,
+			int index,
+			string_view name);
+	private:
+		//Lua functions are identified by their source and first line, so a collected
+		//and reallocated closure can never take over the name of another function,
+		//C functions by their closure which registered functions keep alive
+		struct FrameKey
+		{
+			const void* pointer{};
+			int line{};
+
+			bool operator==(const FrameKey& other) const = default;
+		};
+
+		struct FrameKeyHash
+		{
+			size_t operator()(const FrameKey& key) const;
+		};
+
+		LuaState& owner;
+		LuaProfilerConfig config{};
+		bool isRunning{};
+
+		u64 nextSampleNanoseconds{};
+		LuaProfilerStats stats{};
+
+		//every sample as its depth and weight followed by its frame ids, leaf first
+		vector<u32> sampleBuffer{};
+
+		vector<string> frameNames{};
+		unordered_map<FrameKey, u32, FrameKeyHash> frameIds{};
+
+		//Called by the dispatch hook of the owner on count and return events
+		void _OnHook(lua_State* luaState);
+
+		void _Sample(
+			lua_State* luaState,
+			u32 weight);
+
+		u32 _GetFrameId(
+			lua_State* luaState,
+			lua_Debug& debug);
+
+		//Find the function on top of the stack in _G or one of its namespace tables
+		static bool _FindGlobalName(
+			lua_State* luaState,
+			string& outName);
+
+		//Forget frame ids that point into a state that is being closed, names and samples stay
+		void _OnShutdown();
+	};
+}
@@ -0,0 +1,284 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <queue>
+#include <utility>
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::vector;
+	using std::unordered_map;
+	using std::priority_queue;
+	using std::greater;
+	using std::forward;
+
+	using u64 = uint64_t;
+
+	//Identifies a task for as long as it runs, ids of finished tasks are never reused
+	using LuaTaskID = u64;
+
+	struct LuaSchedulerConfig
+	{
+		//global table the wait functions are registered to
+		string luaNamespace = "scheduler";
+
+		//finished tasks give their thread back to a pool of this size for the next task
+		u32 maxPooledThreads = 1024;
+	};
+
+	struct LuaSchedulerStats
+	{
+		//tasks currently started and not yet finished
+		u32 activeTasks{};
+		//threads waiting in the pool for the next task
+		u32 pooledThreads{};
+
+		u64 tasksStarted{};
+		u64 tasksFinished{};
+		u64 tasksFailed{};
+		u64 tasksCancelled{};
+
+		//times any task was resumed, including the first run
+		u64 resumes{};
+		//tasks that got a pooled thread instead of creating a new one
+		u64 threadsReused{};
+	};
+
+	//Runs Lua functions as coroutines that yield back to C++ and resume later.
+	//Each task waits on a condition from Lua through the registered wait functions:
+	//	scheduler.wait_frames(n)    - resume after n calls to Tick, plain coroutine.yield waits one
+	//	scheduler.wait_signal(name) - resume on the Tick after Signal(name)
+	//	scheduler.wait_value(name)  - resume once SetValue(name) was called, returns the value
+	//	scheduler.signal(name)      - same as Signal(name) from C++
+	//Tasks run until their first wait inside Start, later resumes only happen inside Tick.
+	//Coroutine threads are recycled through a pool so thousands of short and long-lived
+	//tasks do not keep creating new threads, the scheduler must be shut down before its state
+	class LIB_API LuaScheduler
+	{
+	public:
+		LuaScheduler() = default;
+		~LuaScheduler();
+
+		//the wait functions hold a pointer to this object, so it can never move
+		LuaScheduler(const LuaScheduler&) = delete;
+		LuaScheduler& operator=(const LuaScheduler&) = delete;
+		LuaScheduler(LuaScheduler&&) = delete;
+		LuaScheduler& operator=(LuaScheduler&&) = delete;
+
+		//Attach to an initialized state and register the wait functions into it
+		bool Initialize(
+			LuaState& state,
+			const LuaSchedulerConfig& config = {});
+
+		bool IsInitialized() const { return owner != nullptr; }
+
+		//Start a function from one of the loaded lua scripts as a new task with N number of typed args
+		//and run it until it first waits, returns 0 if it could not be started,
+		//the task is already gone when this returns if the function never waited,
+		//empty namespace starts function in global namespace,
+		//no dot in namespace starts function in parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space.function)
+		template<typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		LuaTaskID Start(
+			string_view functionName,
+			string_view functionNamespace,
+			Args&&... args)
+		{
+			if (!_CanStart(functionName)) return 0;
+
+			lua_State* callState = owner->_PushFunction(
+				functionName,
+				functionNamespace);
+
+			if (!callState) return 0;
+
+			//the task thread and its args are created outside of the protected resume
+			LuaLimitScope limitScope(callState, false);
+
+			[[maybe_unused]] lua_State* thread = _BeginTask(functionName);
+			(LuaStack<decay_t<Args>>::Push(thread, forward<Args>(args)), ...);
+
+			return _EndTask(scast<int>((0 + ... + LuaStack<decay_t<Args>>::slots)));
+		}
+
+		//Start a function through a resolved handle as a new task with N number of typed args
+		//and run it until it first waits, returns 0 if it could not be started
+		template<typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		LuaTaskID Start(
+			LuaFunctionRef& functionRef,
+			Args&&... args)
+		{
+			if (!_CanStart(functionRef.GetFunctionName())) return 0;
+
+			lua_State* callState = owner->_PushFunctionRef(functionRef);
+			if (!callState) return 0;
+
+			//the task thread and its args are created outside of the protected resume
+			LuaLimitScope limitScope(callState, false);
+
+			[[maybe_unused]] lua_State* thread = _BeginTask(functionRef.GetFunctionName());
+			(LuaStack<decay_t<Args>>::Push(thread, forward<Args>(args)), ...);
+
+			return _EndTask(scast<int>((0 + ... + LuaStack<decay_t<Args>>::slots)));
+		}
+
+		//Advance one frame and resume every task whose wait condition is met
+		void Tick();
+
+		//Wake every task currently waiting for this signal on the next Tick
+		void Signal(string_view name);
+
+		//Store a value under name and wake every task waiting for it on the next Tick,
+		//later wait_value calls for the same name return it straight away
+		void SetValue(
+			string_view name,
+			const LuaVar& value);
+
+		//Forget a value so the next wait_value for it waits again
+		void ClearValue(string_view name);
+
+		//Stop a task without resuming it again, returns false if it is not running
+		bool Cancel(LuaTaskID task);
+
+		//Returns true if the task was started and has not finished, failed or been cancelled yet
+		bool IsRunning(LuaTaskID task) const;
+
+		//Frames counted by Tick since Initialize
+		u64 GetFrame() const { return frame; }
+
+		LuaSchedulerStats GetStats() const;
+
+		//Cancel every task and release every pooled thread
+		void Shutdown();
+	private:
+		enum class WaitType : u8
+		{
+			WAIT_NONE,
+			WAIT_FRAMES,
+			WAIT_SIGNAL,
+			WAIT_VALUE
+		};
+
+		struct Task
+		{
+			lua_State* thread{};
+			//registry slot that keeps the thread alive
+			int threadRef{};
+
+			//matches the upper half of the task id while the slot runs that task
+			u32 generation{};
+			bool isActive{};
+			//inside lua_resume right now, cancelling is deferred until it yields
+			bool isResuming{};
+			bool isCancelled{};
+
+			WaitType waitType = WaitType::WAIT_NONE;
+			string waitName{};
+
+			string functionName{};
+		};
+
+		//reference to a task slot that becomes stale once the slot runs another task
+		struct TaskHandle
+		{
+			u32 index{};
+			u32 generation{};
+		};
+
+		struct FrameWait
+		{
+			u64 frame{};
+			TaskHandle task{};
+
+			bool operator>(const FrameWait& other) const { return frame > other.frame; }
+		};
+
+		struct PooledThread
+		{
+			lua_State* thread{};
+			int threadRef{};
+		};
+
+		LuaState* owner{};
+		//stateGeneration of the owner when this scheduler attached to it
+		u32 ownerGeneration{};
+		LuaSchedulerConfig config{};
+
+		u64 frame{};
+
+		vector<Task> tasks{};
+		vector<u32> freeTaskSlots{};
+		vector<PooledThread> threadPool{};
+
+		//thread of every running task, so the wait functions can find their task
+		unordered_map<lua_State*, u32> threadTasks{};
+
+		priority_queue<FrameWait, vector<FrameWait>, greater<FrameWait>> frameWaits{};
+		unordered_map<string, vector<TaskHandle>> signalWaits{};
+		unordered_map<string, vector<TaskHandle>> valueWaits{};
+		unordered_map<string, LuaVar> values{};
+
+		//tasks woken by signals and values, resumed on the next Tick
+		vector<TaskHandle> readyTasks{};
+
+		LuaSchedulerStats stats{};
+
+		//task slot the next _EndTask fills in
+		u32 pendingTask{};
+
+		//Returns false if the owner state cannot start tasks right now
+		bool _CanStart(string_view functionName) const;
+
+		//Take a thread for a new task and move the pushed function onto it
+		lua_State* _BeginTask(string_view functionName);
+
+		//Run the new task until it first waits
+		LuaTaskID _EndTask(int argCount);
+
+		//Resume a task with argCount values already pushed onto its thread
+		void _Resume(
+			u32 index,
+			int argCount);
+
+		//Give the thread of a task back to the pool and free its slot
+		void _FinishTask(
+			u32 index,
+			bool isClean);
+
+		bool _IsCurrent(TaskHandle handle) const;
+
+		//Returns false once the owner state was shut down or initialized again
+		bool _IsStateAlive() const;
+
+		//Get the slot of the task running on a thread, false for threads the scheduler does not own
+		bool _FindTask(
+			lua_State* thread,
+			u32& outIndex) const;
+
+		void _WakeAll(vector<TaskHandle>& waiters);
+
+		static int _LuaWaitFrames(lua_State* thread);
+		static int _LuaWaitSignal(lua_State* thread);
+		static int _LuaWaitValue(lua_State* thread);
+		static int _LuaSignal(lua_State* thread);
+
+		static void _PushValue(
+			lua_State* thread,
+			const LuaVar& value);
+	};
+}
@@ -0,0 +1,564 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <tuple>
+#include <optional>
+#include <array>
+#include <utility>
+#include <vector>
+#include <span>
+#include <unordered_map>
+
+extern "C"
+{
+#include "lua.h"
+}
+
+#include "core_utils.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::decay_t;
+	using std::tuple;
+	using std::get;
+	using std::apply;
+	using std::optional;
+	using std::nullopt;
+	using std::array;
+	using std::index_sequence;
+	using std::index_sequence_for;
+	using std::vector;
+	using std::span;
+	using std::unordered_map;
+	using std::is_same_v;
+	using std::is_integral_v;
+
+	//Compile-time marshalling of a single C++ type to and from the Lua stack,
+	//every supported type specializes this with a Push and a Read function,
+	//Read writes straight into the caller's storage and returns false
+	//if the Lua value at that index is not of the expected type
+	template<typename T>
+	struct LuaStack
+	{
+		static constexpr bool isSupported = false;
+		static constexpr int slots = 0;
+	};
+
+	//Returns false if the type cannot be pushed to or read from the Lua stack directly
+	template<typename T>
+	constexpr bool IsLuaStackCompatible = LuaStack<decay_t<T>>::isSupported;
+
+	template<>
+	struct LuaStack<int>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, int value)
+		{
+			lua_pushinteger(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, int& out)
+		{
+			if (lua_type(state, index) != LUA_TNUMBER) return false;
+
+			int isInteger{};
+			lua_Integer n = lua_tointegerx(state, index, &isInteger);
+
+			//truncate floats the same way LuaVar extraction does
+			out = isInteger
+				? scast<int>(n)
+				: scast<int>(lua_tonumberx(state, index, nullptr));
+			return true;
+		}
+	};
+
+	//64-bit integers such as int64_t, uint64_t and lua_Integer map to Lua integers unchanged,
+	//unsigned values keep their bits so ids and hashes read back exactly as they were pushed.
+	//Floats are only read if they hold an integer exactly, so a value is never silently truncated
+	template<typename T>
+		requires (is_integral_v<T>
+			&& sizeof(T) == sizeof(lua_Integer))
+	struct LuaStack<T>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, T value)
+		{
+			lua_pushinteger(state, scast<lua_Integer>(value));
+		}
+
+		static bool Read(lua_State* state, int index, T& out)
+		{
+			int isInteger{};
+			lua_Integer n = lua_tointegerx(state, index, &isInteger);
+
+			//strings are left out to match the other number types
+			if (!isInteger
+				|| lua_type(state, index) != LUA_TNUMBER)
+			{
+				return false;
+			}
+
+			out = scast<T>(n);
+			return true;
+		}
+	};
+
+	template<>
+	struct LuaStack<float>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, float value)
+		{
+			lua_pushnumber(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, float& out)
+		{
+			if (lua_type(state, index) != LUA_TNUMBER) return false;
+
+			out = scast<float>(lua_tonumberx(state, index, nullptr));
+			return true;
+		}
+	};
+
+	template<>
+	struct LuaStack<double>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, double value)
+		{
+			lua_pushnumber(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, double& out)
+		{
+			if (lua_type(state, index) != LUA_TNUMBER) return false;
+
+			out = scast<double>(lua_tonumberx(state, index, nullptr));
+			return true;
+		}
+	};
+
+	template<>
+	struct LuaStack<bool>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, bool value)
+		{
+			lua_pushboolean(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, bool& out)
+		{
+			if (lua_type(state, index) != LUA_TBOOLEAN) return false;
+
+			out = lua_toboolean(state, index) != 0;
+			return true;
+		}
+	};
+
+	template<>
+	struct LuaStack<string>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const string& value)
+		{
+			lua_pushlstring(state, value.data(), value.size());
+		}
+
+		static bool Read(lua_State* state, int index, string& out)
+		{
+			if (lua_type(state, index) != LUA_TSTRING) return false;
+
+			size_t len{};
+			const char* str = lua_tolstring(state, index, &len);
+			out.assign(str, len);
+			return true;
+		}
+	};
+
+	//lets string literals be passed as args without building a string first,
+	//a read pointer is only valid while the value stays on the Lua stack
+	template<>
+	struct LuaStack<const char*>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const char* value)
+		{
+			lua_pushstring(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, const char*& out)
+		{
+			if (lua_type(state, index) != LUA_TSTRING) return false;
+
+			out = lua_tolstring(state, index, nullptr);
+			return true;
+		}
+	};
+
+	//strings without an owning copy in either direction, pushed with their length
+	//so embedded NULs and binary payloads survive, a read view points into the Lua string
+	//and is only valid while the value stays on the Lua stack or is otherwise referenced
+	template<>
+	struct LuaStack<string_view>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, string_view value)
+		{
+			lua_pushlstring(state, value.data(), value.size());
+		}
+
+		static bool Read(lua_State* state, int index, string_view& out)
+		{
+			if (lua_type(state, index) != LUA_TSTRING) return false;
+
+			size_t len{};
+			const char* str = lua_tolstring(state, index, &len);
+			out = string_view(str, len);
+			return true;
+		}
+	};
+
+	//A string the host owns and keeps alive and unchanged until the Lua state closes,
+	//value must be followed by a NUL. Lua 5.5 and newer use the buffer itself as the Lua string,
+	//older versions always copy pushed strings, so it is pushed with a single lua_pushlstring there
+	struct LuaExternalString
+	{
+		string_view value{};
+	};
+
+	template<>
+	struct LuaStack<LuaExternalString>
+	{
+		static constexpr bool isSupported = true;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const LuaExternalString& value)
+		{
+#if LUA_VERSION_NUM >= 505
+			//no free function, the host releases the buffer itself
+			lua_pushexternalstring(
+				state,
+				value.value.data(),
+				value.value.size(),
+				nullptr,
+				nullptr);
+#else
+			lua_pushlstring(state, value.value.data(), value.value.size());
+#endif
+		}
+
+		//a template so the assert only fires for code that actually reads one
+		template<typename T>
+		static bool Read(lua_State*, int, T&)
+		{
+			static_assert(
+				sizeof(T) == 0,
+				"LuaExternalString can only be passed to Lua, read a string_view instead");
+
+			return false;
+		}
+	};
+
+	//nil maps to nullopt, lets optional values and 'return nil, err' results be read
+	template<typename T>
+	struct LuaStack<optional<T>>
+	{
+		static constexpr bool isSupported =
+			IsLuaStackCompatible<T>
+			&& LuaStack<T>::slots == 1;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const optional<T>& value)
+		{
+			if (value) LuaStack<T>::Push(state, *value);
+			else lua_pushnil(state);
+		}
+
+		static bool Read(lua_State* state, int index, optional<T>& out)
+		{
+			if (lua_isnoneornil(state, index))
+			{
+				out = nullopt;
+				return true;
+			}
+
+			out.emplace();
+			return LuaStack<T>::Read(state, index, *out);
+		}
+	};
+
+	//multiple values, each element takes its own consecutive stack slots,
+	//so functions can return several values in one boundary crossing
+	template<typename... Ts>
+	struct LuaStack<tuple<Ts...>>
+	{
+		static constexpr bool isSupported = (IsLuaStackCompatible<Ts> && ...);
+		static constexpr int slots = (0 + ... + LuaStack<Ts>::slots);
+
+		static void Push(lua_State* state, const tuple<Ts...>& value)
+		{
+			apply([state](const Ts&... v)
+				{
+					(LuaStack<Ts>::Push(state, v), ...);
+				}, value);
+		}
+
+		static bool Read(lua_State* state, int index, tuple<Ts...>& out)
+		{
+			//elements may push temporaries while reading, so relative indexes would drift
+			return ReadElements(
+				state,
+				lua_absindex(state, index),
+				out,
+				index_sequence_for<Ts...>{});
+		}
+	private:
+		//stack offset of each element from the first slot of the tuple
+		static constexpr array<int, sizeof...(Ts)> offsets = []
+			{
+				array<int, sizeof...(Ts)> result{};
+				int slotCounts[] = { LuaStack<Ts>::slots..., 0 };
+
+				int offset{};
+				for (size_t i = 0; i < sizeof...(Ts); ++i)
+				{
+					result[i] = offset;
+					offset += slotCounts[i];
+				}
+
+				return result;
+			}();
+
+		template<size_t... I>
+		static bool ReadElements(
+			lua_State* state,
+			int index,
+			tuple<Ts...>& out,
+			index_sequence<I...>)
+		{
+			return (LuaStack<Ts>::Read(state, index + offsets[I], get<I>(out)) && ...);
+		}
+	};
+	//Returns true if reading T leaves it pointing into a Lua string instead of owning a copy
+	template<typename T>
+	constexpr bool IsLuaBorrowed =
+		is_same_v<T, const char*>
+		|| is_same_v<T, string_view>;
+
+	template<typename T>
+	constexpr bool IsLuaBorrowed<optional<T>> = IsLuaBorrowed<T>;
+
+	template<typename... Ts>
+	constexpr bool IsLuaBorrowed<tuple<Ts...>> = (IsLuaBorrowed<Ts> || ...);
+
+	//Returns true if T can be stored as a single table element or field,
+	//borrowed strings are left out because a read pointer dies with the popped element
+	template<typename T>
+	constexpr bool IsLuaTableElement =
+		IsLuaStackCompatible<T>
+		&& LuaStack<decay_t<T>>::slots == 1
+		&& !IsLuaBorrowed<decay_t<T>>;
+
+	//Shared table fast paths of the sequence and map specializations
+	struct LuaTable
+	{
+		//Push a presized array table filled with lua_rawseti
+		template<typename T, typename Sequence>
+		static void PushSequence(
+			lua_State* state,
+			const Sequence& values)
+		{
+			lua_createtable(state, scast<int>(values.size()), 0);
+
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				LuaStack<T>::Push(state, values[i]);
+				lua_rawseti(state, -2, scast<lua_Integer>(i + 1));
+			}
+		}
+
+		//Read the first values.size() elements of the array part of a table with lua_rawgeti
+		template<typename T, typename Sequence>
+		static bool ReadSequence(
+			lua_State* state,
+			int index,
+			Sequence& values)
+		{
+			//nested tables push one temporary per level
+			if (!lua_checkstack(state, 1)) return false;
+
+			for (size_t i = 0; i < values.size(); ++i)
+			{
+				lua_rawgeti(state, index, scast<lua_Integer>(i + 1));
+
+				bool isRead{};
+				if constexpr (is_same_v<T, bool>)
+				{
+					//vector<bool> hands out proxies instead of references
+					bool element{};
+					isRead = LuaStack<bool>::Read(state, -1, element);
+					values[i] = element;
+				}
+				else isRead = LuaStack<T>::Read(state, -1, values[i]);
+
+				lua_pop(state, 1);
+
+				if (!isRead) return false;
+			}
+
+			return true;
+		}
+	};
+
+	//array table, element i is stored at index i + 1
+	template<typename T>
+	struct LuaStack<vector<T>>
+	{
+		static constexpr bool isSupported = IsLuaTableElement<T>;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const vector<T>& value)
+		{
+			LuaTable::PushSequence<T>(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, vector<T>& out)
+		{
+			if (lua_type(state, index) != LUA_TTABLE) return false;
+
+			index = lua_absindex(state, index);
+
+			out.resize(scast<size_t>(lua_rawlen(state, index)));
+			return LuaTable::ReadSequence<T>(state, index, out);
+		}
+	};
+
+	//array table built straight from contiguous memory without copying it into a vector first,
+	//push only because a span cannot own what is read back
+	template<typename T>
+	struct LuaStack<span<const T>>
+	{
+		static constexpr bool isSupported = IsLuaTableElement<T>;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, span<const T> value)
+		{
+			LuaTable::PushSequence<T>(state, value);
+		}
+
+		static bool Read(lua_State*, int, span<const T>&)
+		{
+			static_assert(
+				sizeof(T) == 0,
+				"span can only be passed to Lua, read a vector instead");
+
+			return false;
+		}
+	};
+
+	//array table that must have exactly N elements to be read back
+	template<typename T, size_t N>
+	struct LuaStack<array<T, N>>
+	{
+		static constexpr bool isSupported = IsLuaTableElement<T>;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const array<T, N>& value)
+		{
+			LuaTable::PushSequence<T>(state, value);
+		}
+
+		static bool Read(lua_State* state, int index, array<T, N>& out)
+		{
+			if (lua_type(state, index) != LUA_TTABLE
+				|| lua_rawlen(state, index) != N)
+			{
+				return false;
+			}
+
+			return LuaTable::ReadSequence<T>(state, lua_absindex(state, index), out);
+		}
+	};
+
+	//table with string keys, reading fails on any non-string key
+	template<typename T>
+	struct LuaStack<unordered_map<string, T>>
+	{
+		static constexpr bool isSupported = IsLuaTableElement<T>;
+		static constexpr int slots = 1;
+
+		static void Push(lua_State* state, const unordered_map<string, T>& value)
+		{
+			lua_createtable(state, 0, scast<int>(value.size()));
+
+			for (const auto& [key, element] : value)
+			{
+				lua_pushlstring(state, key.data(), key.size());
+				LuaStack<T>::Push(state, element);
+				lua_rawset(state, -3);
+			}
+		}
+
+		static bool Read(lua_State* state, int index, unordered_map<string, T>& out)
+		{
+			if (lua_type(state, index) != LUA_TTABLE) return false;
+
+			//lua_next keeps a key and a value on the stack
+			if (!lua_checkstack(state, 2)) return false;
+
+			index = lua_absindex(state, index);
+			out.clear();
+
+			lua_pushnil(state);
+			while (lua_next(state, index) != 0)
+			{
+				//lua_tolstring would turn number keys into strings and break lua_next
+				if (lua_type(state, -2) != LUA_TSTRING)
+				{
+					lua_pop(state, 2);
+					return false;
+				}
+
+				size_t keyLength{};
+				const char* key = lua_tolstring(state, -2, &keyLength);
+
+				if (!LuaStack<T>::Read(state, -1, out[string(key, keyLength)]))
+				{
+					lua_pop(state, 2);
+					return false;
+				}
+
+				lua_pop(state, 1);
+			}
+
+			return true;
+		}
+	};
+}
@@ -0,0 +1,1472 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <functional>
+#include <vector>
+#include <variant>
+#include <type_traits>
+#include <utility>
+#include <optional>
+#include <tuple>
+#include <new>
+#include <span>
+#include <ranges>
+#include <iterator>
+#include <filesystem>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_core.hpp"
+#include "core/kl_stack.hpp"
+#include "core/kl_allocator.hpp"
+#include "core/kl_watcher.hpp"
+#include "core/kl_profiler.hpp"
+#include "core/kl_metrics.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::to_string;
+	using std::function;
+	using std::vector;
+	using std::variant;
+	using std::is_void_v;
+	using std::is_pointer_v;
+	using std::is_same_v;
+	using std::is_invocable_r_v;
+	using std::index_sequence;
+	using std::index_sequence_for;
+	using std::get;
+	using std::bad_variant_access;
+	using std::holds_alternative;
+	using std::forward;
+	using std::optional;
+	using std::nullopt;
+	using std::conditional_t;
+	using std::tuple;
+	using std::unordered_map;
+	using std::equal_to;
+	using std::hash;
+	using std::is_trivially_destructible_v;
+	using std::is_function_v;
+	using std::remove_pointer_t;
+	using std::span;
+	using std::move;
+	using std::mutex;
+	using std::size;
+	using std::data;
+	using std::invoke_result_t;
+	using std::ranges::contiguous_range;
+	using std::ranges::range_value_t;
+	using std::filesystem::path;
+	using std::atomic;
+	using std::chrono::steady_clock;
+
+	using u8 = uint8_t;
+	using u64 = uint64_t;
+
+	using KalaHeaders::KalaLog::Log;
+	using KalaHeaders::KalaLog::LogType;
+
+	enum class LuaLibrary : u8
+	{
+		//adds coroutine support.
+		//LUA_COLIBNAME / luaopen_coroutine
+		LUA_COROUTINE,
+
+		//adds table utils.
+		//LUA_TABLIBNAME / luaopen_table
+		LUA_TABLE,
+
+		//adds string manipulation utils.
+		//LUA_STRLIBNAME / luaopen_string
+		LUA_STRING,
+
+		//adds extra math functions.
+		//LUA_MATHLIBNAME / luaopen_math
+		LUA_MATH,
+
+		//adds utf-8 string handling.
+		//LUA_UTF8LIBNAME / luaopen_utf8
+		LUA_UTF8,
+
+		//adds modules and enables dynamic library loading.
+		//LUA_LOADLIBNAME / luaopen_package
+		LUA_PACKAGE,
+
+		//adds file I/O utils.
+		//LUA_IOLIBNAME / luaopen_io
+		LUA_IO,
+
+		//adds OS interaction utils.
+		//LUA_OSLIBNAME / luaopen_os
+		LUA_OS,
+
+		//adds debugging utils.
+		//LUA_DBLIBNAME / luaopen_debug
+		LUA_DEBUG,
+
+		//adds all of the available lua libraries
+		LUA_ALL
+	};
+
+	//Which kinds of chunks a script load accepts,
+	//binary chunks are precompiled Lua bytecode from lua_dump or luac
+	enum class LuaLoadMode : u8
+	{
+		//only accept Lua source text
+		LOAD_TEXT,
+
+		//only accept precompiled binary chunks
+		LOAD_BINARY,
+
+		//accept both source text and binary chunks
+		LOAD_TEXT_AND_BINARY
+	};
+
+	//Lua integers that do not fit into int are returned as int64_t,
+	//uint64_t is passed to Lua with its bits unchanged
+	using LuaVar = variant
+	<
+		int,
+		float,
+		double,
+		bool,
+		string,
+		int64_t,
+		uint64_t
+	>;
+
+	//Returns false if variable not found in LuaVar is used
+	template<typename T>
+	constexpr bool IsLuaVarCompatible =
+		is_same_v<T, int> 
+		|| is_same_v<T, float>
+		|| is_same_v<T, double>
+		|| is_same_v<T, bool>
+		|| is_same_v<T, string>
+		|| is_same_v<T, int64_t>
+		|| is_same_v<T, uint64_t>;
+
+	//Return type of the typed CallFunction overloads,
+	//void calls only report success, everything else returns the value or nullopt
+	template<typename R>
+	using LuaCallResult = conditional_t<is_void_v<R>, bool, optional<R>>;
+
+	enum class LuaGCMode : u8
+	{
+		//collects in small steps interleaved with the program, the Lua default
+		GC_INCREMENTAL,
+
+		//collects young objects often and the whole heap rarely,
+		//usually less total work for programs that create many short-lived objects
+		GC_GENERATIONAL
+	};
+
+	//Parameters of the incremental collector, 0 keeps the current value
+	struct LuaGCIncrementalParams
+	{
+		//percent the heap must grow after a cycle before the next cycle starts, Lua default 200
+		int pause{};
+		//collection work done per step relative to allocation speed, Lua default 100
+		int stepMultiplier{};
+		//log2 of the kilobytes allocated between steps, Lua default 13
+		int stepSize{};
+	};
+
+	//Parameters of the generational collector, 0 keeps the current value
+	struct LuaGCGenerationalParams
+	{
+		//percent of heap growth since the last major collection that triggers a minor one, Lua default 20
+		int minorMultiplier{};
+		//percent of heap growth that triggers a major collection, Lua default 100
+		int majorMultiplier{};
+	};
+
+	//Collection work is only timed when it runs through StepGCFor or CollectGarbage,
+	//automatic collection runs inside allocations, stop the collector
+	//and step it yourself to account for every cycle
+	struct LuaGCStats
+	{
+		//bytes currently held by the Lua heap
+		size_t heapBytes{};
+
+		LuaGCMode mode = LuaGCMode::GC_INCREMENTAL;
+		bool isRunning{};
+
+		//cycles finished by StepGCFor or CollectGarbage
+		u64 completedCycles{};
+		//basic steps done by StepGCFor
+		u64 steps{};
+		//time spent in StepGCFor and CollectGarbage
+		u64 totalNanoseconds{};
+		//time the last finished cycle took across all of its steps
+		u64 lastCycleNanoseconds{};
+		//time spent so far on the cycle that is still in progress
+		u64 currentCycleNanoseconds{};
+	};
+
+	struct LuaBytecodeCacheStats
+	{
+		//scripts loaded from a cached binary chunk
+		u64 hits{};
+		//scripts compiled from source, including stale or unreadable cache entries
+		u64 misses{};
+		//original compile time of every hit minus the time its cached chunk took to load
+		u64 timeSavedNanoseconds{};
+	};
+
+	//Limits on one call from C++ into Lua or one script load, 0 is unlimited.
+	//Both are checked by a count hook, so time spent inside a C++ function
+	//is only noticed once Lua code runs again
+	struct LuaExecutionBudget
+	{
+		//Lua VM instructions the call may run, counted in steps of the hook interval
+		u64 maxInstructions{};
+		//wall-clock time the call may take
+		u64 maxMicroseconds{};
+	};
+
+	class LuaState;
+
+	//Handle to a Lua function that was resolved once through GetFunctionRef,
+	//calling through it skips the namespace walk and the function lookup entirely.
+	//The function is pinned in a Lua registry slot, the handle re-resolves itself once
+	//if a script was loaded after it was resolved and becomes invalid after Shutdown,
+	//a handle must not outlive the LuaState it was resolved from
+	class LIB_API LuaFunctionRef
+	{
+		friend class LuaState;
+	public:
+		//Returns true if this handle points to a function in the current Lua state of its owner
+		bool IsValid() const;
+
+		const string& GetFunctionName() const { return functionName; }
+		const string& GetFunctionNamespace() const { return functionNamespace; }
+	private:
+		//same value as LUA_NOREF in lauxlib.h
+		static constexpr int NO_REF = -2;
+
+		LuaState* owner{};
+
+		string functionName{};
+		string functionNamespace{};
+
+		int ref = NO_REF;
+		u32 stateGeneration{};
+		u32 scriptGeneration{};
+	};
+
+	//A single independent Lua interpreter that owns its own lua_State,
+	//registered functions and configuration. States share nothing with each other,
+	//so each thread can run its own state without any locking,
+	//but a single state must only be used by one thread at a time
+	class LIB_API LuaState
+	{
+		friend class LuaFunctionRef;
+		friend class LuaScheduler;
+		friend class LuaProfiler;
+		friend class LuaStateTemplate;
+		friend class LuaClassBase;
+		template<typename T> friend class LuaClass;
+	public:
+		LuaState() = default;
+		~LuaState();
+
+		//the lua_State stores a pointer back to this object, so it can never move
+		LuaState(const LuaState&) = delete;
+		LuaState& operator=(const LuaState&) = delete;
+		LuaState(LuaState&&) = delete;
+		LuaState& operator=(LuaState&&) = delete;
+
+		//Get the LuaState that owns this lua_State or any of its coroutine threads,
+		//only valid for lua_States that were created by a LuaState
+		static LuaState* FromLuaState(lua_State* luaState);
+
+		//Choose the allocator lua_newstate gets and its memory limit, only valid before Initialize,
+		//the default is the system allocator with no limit
+		bool SetAllocator(const LuaAllocatorConfig& config);
+
+		//Change the memory limit at any time, 0 is unlimited,
+		//Lua code that allocates past it gets a catchable 'not enough memory' error
+		void SetMemoryLimit(size_t memoryLimit) { allocator.SetMemoryLimit(memoryLimit); }
+
+		//Get bytes in use, peak bytes and allocation counts per size class
+		const LuaMemoryStats& GetMemoryStats() const { return allocator.GetStats(); }
+
+		void ResetMemoryPeak() { allocator.ResetPeak(); }
+
+		//Open the libraries passed to Initialize the first time a script touches their global
+		//instead of during Initialize, only valid before Initialize. Base functions are still
+		//opened right away, 'require' opens package and string methods open string
+		bool SetLazyLibraries(bool enabled);
+
+		bool IsLazyLibraries() const { return isLazyLibraries; }
+
+		//Initialize this state, does not load scripts or functions.
+		//Optionally add extra Lua libraries, base Lua functions (LUA_GNAME / luaopen_base) are always added.
+		bool Initialize(const vector<LuaLibrary>& libs = {});
+
+		bool IsInitialized() const { return isInitialized; }
+
+		//Get the libraries this state was initialized with
+		const vector<LuaLibrary>& GetLibraries() const { return libraries; }
+
+		//Get the libraries that are open right now, with lazy libraries
+		//only the ones that were touched so far, LUA_ALL is listed as each library
+		const vector<LuaLibrary>& GetLoadedLibraries() const { return loadedLibraries; }
+
+		//Get the pointer to lua state stored within this state
+		//after it has initialized, recommended only for advanced users
+		lua_State* GetLuaState() const { return isInitialized ? state : nullptr; }
+
+		//Load and compile a lua script for use via CallFunction,
+		//the file is memory-mapped and compiled straight from the mapping,
+		//goes through the bytecode cache if one is set
+		bool LoadScript(
+			string_view script,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY);
+
+		//Load and compile a lua script from memory for use via CallFunction,
+		//for scripts stored in asset packs or generated at runtime,
+		//name is used as the chunk name in Lua errors and log messages,
+		//goes through the bytecode cache if one is set
+		bool LoadScriptFromBuffer(
+			string_view name,
+			span<const char> buffer,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY);
+
+		//Save compiled scripts into cacheDirectory and load them from there on later runs,
+		//entries are keyed by the chunk name, source content hash and Lua version so edited scripts
+		//and other Lua builds are recompiled, stripping debug info makes chunks smaller
+		//but removes line numbers from Lua errors, an empty directory disables the cache.
+		//Can be called before Initialize and is kept across Shutdown
+		bool SetBytecodeCache(
+			string_view cacheDirectory,
+			bool stripDebugInfo = false);
+
+		const string& GetBytecodeCacheDirectory() const { return bytecodeCacheDirectory; }
+
+		const LuaBytecodeCacheStats& GetBytecodeCacheStats() const { return bytecodeCacheStats; }
+
+		void ResetBytecodeCacheStats() { bytecodeCacheStats = {}; }
+
+		//Watch every file loaded through LoadScript so far and every one loaded after this,
+		//inotify on Linux and last write time polling elsewhere, nothing reloads until PollHotReload.
+		//Loads only touch the filesystem for watching while this is enabled, so files loaded
+		//before are watched from this call on and earlier writes to them are not reported
+		bool EnableHotReload();
+
+		void DisableHotReload() { scriptWatcher.Stop(); }
+
+		bool IsHotReloadEnabled() const { return scriptWatcher.IsRunning(); }
+
+		//Recompile and rerun every watched script that changed since the last poll in place,
+		//returns how many reloaded. A script that fails to compile keeps its previous version,
+		//function handles re-resolve once after a reload so they point to the new functions
+		u32 PollHotReload();
+
+		//Get the sampling profiler of this state, it only hooks into Lua while running
+		LuaProfiler& GetProfiler() { return profiler; }
+		const LuaProfiler& GetProfiler() const { return profiler; }
+
+		//Get the per-function call metrics of this state, disabled until LuaMetrics::Enable,
+		//snapshots of it can be taken from any thread
+		LuaMetrics& GetMetrics() { return metrics; }
+		const LuaMetrics& GetMetrics() const { return metrics; }
+
+		//Set the budget every call from C++ and every script load runs under,
+		//a call that runs past it is aborted with a Lua error and fails like any other call,
+		//calls made from registered C++ functions share the budget of the outermost call.
+		//No hook is installed for calls while the budget is unlimited
+		void SetExecutionBudget(const LuaExecutionBudget& budget) { executionBudget = budget; }
+
+		const LuaExecutionBudget& GetExecutionBudget() const { return executionBudget; }
+
+		//Abort the call from C++ into Lua that is running right now with a Lua error,
+		//can be called from any thread such as a watchdog, does nothing between calls.
+		//LuaScheduler resumes count as calls, and code inside a coroutine or task is
+		//interrupted where it runs instead of once it yields back.
+		//Must not run at the same time as Initialize or Shutdown
+		void Interrupt();
+
+		//Switch to the incremental collector and set its parameters
+		bool SetIncrementalGC(const LuaGCIncrementalParams& params = {});
+
+		//Switch to the generational collector and set its parameters
+		bool SetGenerationalGC(const LuaGCGenerationalParams& params = {});
+
+		//Stop automatic collection, the heap only shrinks through StepGCFor and CollectGarbage
+		void StopGC();
+
+		//Resume automatic collection
+		void RestartGC();
+
+		//Do basic collection steps until the time budget runs out or the current cycle finishes,
+		//spend idle frame time here to keep collection out of hot frames,
+		//returns true if a cycle finished
+		bool StepGCFor(u32 microseconds);
+
+		//Run a full collection cycle right now
+		void CollectGarbage();
+
+		//Get the heap size, collector mode and time spent collecting
+		LuaGCStats GetGCStats() const;
+
+		//Call a function from one of the loaded lua scripts with N number of args,
+		//default void-only return type, cannot return any LuaVar types,
+		//empty namespace calls function in global namespace,
+		//no dot in namespace calls function in parent namespace,
+		//dotted namespace allows nesting namespace calls (my.name.space.function)
+		void CallFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const vector<LuaVar>& args = {})
+		{
+			_CallFunction(
+				functionName,
+				functionNamespace,
+				args);
+		}
+
+		//Call a function from one of the loaded lua scripts with N number of args,
+		//returns void on failure, can return any LuaVar type,
+		//empty namespace calls function in global namespace,
+		//no dot in namespace calls function in parent namespace,
+		//dotted namespace allows nesting namespace calls (my.name.space.function)
+		template<typename R>
+			requires IsLuaVarCompatible<R>
+		optional<R> CallFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const vector<LuaVar>& args = {})
+		{
+			LuaVar ret{};
+			if (!_CallFunction(
+				functionName,
+				functionNamespace,
+				args,
+				&ret))
+			{
+				return nullopt;
+			}
+
+			try
+			{
+				return ExtractLuaVar<R>(ret);
+			}
+			catch (...)
+			{
+				Log::Print(
+					"Unsupported variable type was passed to CallFunction function '" + string(functionName) + "'!",
+					"KALALUA_CALL_FUNCTION",
+					LogType::LOG_ERROR,
+					2);
+
+				return nullopt;
+			}
+		}
+
+		//Resolve a function from one of the loaded lua scripts once and
+		//return a handle to it that can be called any number of times,
+		//returns an invalid handle if the namespace or function does not exist,
+		//empty namespace resolves function in global namespace,
+		//no dot in namespace resolves function in parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space.function)
+		LuaFunctionRef GetFunctionRef(
+			string_view functionName,
+			string_view functionNamespace);
+
+		//Release the registry slot held by a function handle and invalidate it
+		void ReleaseFunctionRef(LuaFunctionRef& functionRef);
+
+		//Call a function through a resolved handle with N number of args,
+		//default void-only return type, cannot return any LuaVar types
+		void CallFunction(
+			LuaFunctionRef& functionRef,
+			const vector<LuaVar>& args = {})
+		{
+			_CallFunctionRef(
+				functionRef,
+				args);
+		}
+
+		//Call a function through a resolved handle with N number of args,
+		//returns void on failure, can return any LuaVar type
+		template<typename R>
+			requires IsLuaVarCompatible<R>
+		optional<R> CallFunction(
+			LuaFunctionRef& functionRef,
+			const vector<LuaVar>& args = {})
+		{
+			LuaVar ret{};
+			if (!_CallFunctionRef(
+				functionRef,
+				args,
+				&ret))
+			{
+				return nullopt;
+			}
+
+			try
+			{
+				return ExtractLuaVar<R>(ret);
+			}
+			catch (...)
+			{
+				Log::Print(
+					"Unsupported variable type was passed to CallFunction function '" + functionRef.GetFunctionName() + "'!",
+					"KALALUA_CALL_FUNCTION",
+					LogType::LOG_ERROR,
+					2);
+
+				return nullopt;
+			}
+		}
+
+		//Call a function from one of the loaded lua scripts with N number of typed args,
+		//each arg is pushed straight to the Lua stack without building a LuaVar vector,
+		//R can be void (returns true on success) or any LuaStack-compatible type,
+		//pass a tuple as R to receive multiple return values in one call,
+		//string_view and const char* returns stay valid until the next call that returns one,
+		//empty namespace calls function in global namespace,
+		//no dot in namespace calls function in parent namespace,
+		//dotted namespace allows nesting namespace calls (my.name.space.function)
+		template<typename R = void, typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		LuaCallResult<R> CallFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			Args&&... args)
+		{
+			lua_State* callState = _PushFunction(
+				functionName,
+				functionNamespace);
+
+			if (!callState) return {};
+
+			return _CallTyped<R>(
+				callState,
+				functionName,
+				metrics._GetCallEntry(functionName, functionNamespace),
+				forward<Args>(args)...);
+		}
+
+		//Call a function through a resolved handle with N number of typed args,
+		//each arg is pushed straight to the Lua stack without building a LuaVar vector,
+		//R can be void (returns true on success) or any LuaStack-compatible type,
+		//pass a tuple as R to receive multiple return values in one call,
+		//string_view and const char* returns stay valid until the next call that returns one
+		template<typename R = void, typename... Args>
+			requires (IsLuaStackCompatible<Args> && ...)
+		LuaCallResult<R> CallFunction(
+			LuaFunctionRef& functionRef,
+			Args&&... args)
+		{
+			lua_State* callState = _PushFunctionRef(functionRef);
+
+			if (!callState) return {};
+
+			return _CallTyped<R>(
+				callState,
+				functionRef.GetFunctionName(),
+				metrics._GetCallEntry(functionRef.GetFunctionName(), functionRef.GetFunctionNamespace()),
+				forward<Args>(args)...);
+		}
+
+		//Call one function from the loaded lua scripts once for every element of a contiguous range,
+		//an element is a single LuaStack-compatible arg or a tuple of args for several,
+		//the function is resolved once and stays on the stack for every call,
+		//results[i] gets the result of args[i] the same way the typed CallFunction returns it,
+		//a failing element is logged and leaves false or nullopt without aborting the batch,
+		//results can be empty to discard them, returns the number of calls that succeeded
+		template<typename R = void, typename Range>
+			requires contiguous_range<const Range>
+			&& IsLuaStackCompatible<range_value_t<Range>>
+		size_t CallFunctionBatch(
+			string_view functionName,
+			string_view functionNamespace,
+			const Range& args,
+			span<LuaCallResult<R>> results = {})
+		{
+			return CallFunctionBatch<R>(
+				functionName,
+				functionNamespace,
+				size(args),
+				[&args](size_t index) -> const range_value_t<Range>& { return data(args)[index]; },
+				results);
+		}
+
+		//Call one function from the loaded lua scripts count times with the args fill returns for each index,
+		//fill(index) returns a single LuaStack-compatible arg or a tuple of args,
+		//results behave the same as in the range overload
+		template<typename R = void, typename F>
+			requires IsLuaStackCompatible<invoke_result_t<F&, size_t>>
+		size_t CallFunctionBatch(
+			string_view functionName,
+			string_view functionNamespace,
+			size_t count,
+			F&& fill,
+			span<LuaCallResult<R>> results = {})
+		{
+			if (!_CheckBatchResults(functionName, count, results.size())) return 0;
+
+			lua_State* callState = _PushFunction(
+				functionName,
+				functionNamespace);
+
+			if (!callState) return 0;
+
+			return _CallBatch<R>(
+				callState,
+				functionName,
+				metrics._GetCallEntry(functionName, functionNamespace),
+				count,
+				fill,
+				results);
+		}
+
+		//Call a function through a resolved handle once for every element of a contiguous range,
+		//behaves the same as the named range overload
+		template<typename R = void, typename Range>
+			requires contiguous_range<const Range>
+			&& IsLuaStackCompatible<range_value_t<Range>>
+		size_t CallFunctionBatch(
+			LuaFunctionRef& functionRef,
+			const Range& args,
+			span<LuaCallResult<R>> results = {})
+		{
+			return CallFunctionBatch<R>(
+				functionRef,
+				size(args),
+				[&args](size_t index) -> const range_value_t<Range>& { return data(args)[index]; },
+				results);
+		}
+
+		//Call a function through a resolved handle count times with the args fill returns for each index,
+		//behaves the same as the named fill overload
+		template<typename R = void, typename F>
+			requires IsLuaStackCompatible<invoke_result_t<F&, size_t>>
+		size_t CallFunctionBatch(
+			LuaFunctionRef& functionRef,
+			size_t count,
+			F&& fill,
+			span<LuaCallResult<R>> results = {})
+		{
+			if (!_CheckBatchResults(functionRef.GetFunctionName(), count, results.size())) return 0;
+
+			lua_State* callState = _PushFunctionRef(functionRef);
+			if (!callState) return 0;
+
+			return _CallBatch<R>(
+				callState,
+				functionRef.GetFunctionName(),
+				metrics._GetCallEntry(functionRef.GetFunctionName(), functionRef.GetFunctionNamespace()),
+				count,
+				fill,
+				results);
+		}
+
+		//Register a function into this state for lua to use externally,
+		//this overload accepts functionals and targetFunction can return LuaVar,
+		//a tuple of them for multiple return values, or nothing,
+		//accepts N number of any args defined in LuaVar,
+		//args are read straight off the Lua stack by a trampoline generated for this signature,
+		//empty namespace moves function to global namespace,
+		//no dot in namespace moves function to parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		template<typename... Args, typename R>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const function<R(Args...)>& targetFunction)
+		{
+			_AssertRegisterSignature<R, Args...>();
+
+			lua_State* registerState = _BeginRegister(
+				functionName,
+				functionNamespace);
+
+			if (!registerState) return false;
+
+			//the functional lives in a userdata upvalue that is destroyed with the closure
+			_PushOwnedUpvalue(registerState, targetFunction);
+			_PushMetricsUpvalue(functionName, functionNamespace);
+			lua_pushcclosure(registerState, _FunctionalTrampoline<R, Args...>, 2);
+
+			_EndRegister(
+				functionName,
+				functionNamespace);
+
+			return true;
+		}
+
+		//Register a function into this state for lua to use externally,
+		//this overload accepts free functions and targetFunction can return LuaVar or nothing,
+		//accepts N number of any args defined in LuaVar,
+		//args are read straight off the Lua stack by a trampoline generated for this signature,
+		//empty namespace moves function to global namespace,
+		//no dot in namespace moves function to parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		template<typename... Args, typename R>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			R (*func)(Args...))
+		{
+			_AssertRegisterSignature<R, Args...>();
+
+			if (!func)
+			{
+				Log::Print(
+					"Failed to register function '" + string(functionName) + "' because target function was empty.",
+					"KALALUA",
+					LogType::LOG_ERROR,
+					2);
+
+				return false;
+			}
+
+			lua_State* registerState = _BeginRegister(
+				functionName,
+				functionNamespace);
+
+			if (!registerState) return false;
+
+			_PushOwnedUpvalue(registerState, func);
+			_PushMetricsUpvalue(functionName, functionNamespace);
+			lua_pushcclosure(registerState, _PointerTrampoline<R, Args...>, 2);
+
+			_EndRegister(
+				functionName,
+				functionNamespace);
+
+			return true;
+		}
+
+		//Register a function into this state for lua to use externally,
+		//this overload takes the free function as a template argument (RegisterFunction<&MyFunction>)
+		//and generates a trampoline that calls it directly with no functional in between,
+		//accepts N number of any args defined in LuaVar,
+		//empty namespace moves function to global namespace,
+		//no dot in namespace moves function to parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		template<auto F>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace)
+		{
+			static_assert(
+				is_pointer_v<decltype(F)>
+				&& is_function_v<remove_pointer_t<decltype(F)>>,
+				"RegisterFunction<F> only accepts free function pointers");
+
+			_AssertRegisterPointer(F);
+
+			lua_State* registerState = _BeginRegister(
+				functionName,
+				functionNamespace);
+
+			if (!registerState) return false;
+
+			_PushMetricsUpvalue(functionName, functionNamespace);
+			lua_pushcclosure(registerState, _StaticTrampoline<F>, 1);
+
+			_EndRegister(
+				functionName,
+				functionNamespace);
+
+			return true;
+		}
+
+		//Register a function into this state for lua to use externally,
+		//this overload accepts custom lua functions, recommended only for advanced users,
+		//empty namespace moves function to global namespace,
+		//no dot in namespace moves function to parent namespace,
+		//dotted namespace allows nesting namespaces (my.name.space),
+		//returns false and logs if the name, namespace or function is invalid
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const function<int(lua_State*)>& targetFunction);
+
+		//Drop every cached namespace, replaced namespace tables are noticed on their next use
+		//without this, but the cache keeps them alive until then
+		void InvalidateNamespaceCache();
+
+		//Shut down this state and its Lua runtime
+		void Shutdown();
+	private:
+		lua_State* state{};
+		bool isInitialized{};
+
+		vector<LuaLibrary> libraries{};
+
+		bool isLazyLibraries{};
+		//libraries waiting for their first use and libraries that are open
+		vector<LuaLibrary> pendingLibraries{};
+		vector<LuaLibrary> loadedLibraries{};
+
+		//unique per Initialize across all states, invalidates function handles of older states
+		u32 stateGeneration{};
+		//bumped every time a script is loaded, makes function handles re-resolve once
+		u32 scriptGeneration{};
+
+		struct NamespaceHash
+		{
+			using is_transparent = void;
+
+			size_t operator()(string_view name) const { return hash<string_view>{}(name); }
+		};
+
+		struct CachedNamespace
+		{
+			//registry reference to every segment name followed by the table it resolved to,
+			//{ "game", game, "ai", game.ai }, the last table is the namespace itself
+			int ref{};
+			//number of segments in the namespace
+			int depth{};
+		};
+
+		//dotted namespaces the call and register paths resolved, a hit checks every segment
+		//with lua_rawget against its parent, so tables Lua replaced since are resolved again,
+		//namespaces reached through an __index metamethod are never cached
+		unordered_map<string, CachedNamespace, NamespaceHash, equal_to<>> namespaceCache{};
+
+		//every allocation of state goes through this, Shutdown releases it after lua_close
+		LuaAllocator allocator{};
+
+		string bytecodeCacheDirectory{};
+		bool stripBytecodeDebugInfo{};
+		LuaBytecodeCacheStats bytecodeCacheStats{};
+
+		struct LoadedScript
+		{
+			//the path LoadScript was given, used as the chunk name again on reload
+			string script{};
+			//the same file in the absolute form the watcher reports,
+			//empty until hot reload is enabled
+			path file{};
+			LuaLoadMode mode{};
+		};
+
+		//whether the memory limit was enforced when _BeginRegister lifted it
+		bool registerLimitEnforced{};
+
+		//set by LuaStateTemplate while it records a script load,
+		//the compiled chunk of the script is dumped into it before it runs
+		vector<char>* chunkRecorder{};
+
+		//every file LoadScript opened since Initialize, in load order
+		vector<LoadedScript> loadedScripts{};
+		LuaFileWatcher scriptWatcher{};
+
+		LuaProfiler profiler{ *this };
+
+		//registered closures point into it, kept across Shutdown so counters survive a restart
+		LuaMetrics metrics{};
+
+		LuaExecutionBudget executionBudget{};
+
+		//depth of calls from C++ into Lua, also read by Interrupt from other threads
+		atomic<u32> callDepth{};
+		atomic<bool> isInterruptRequested{};
+		//the coroutine or task thread Lua runs on right now, nullptr while it runs on the
+		//main thread, hook changes and Interrupt reach it along with the main thread
+		atomic<lua_State*> runningThread{};
+		//held by Interrupt while it hooks runningThread and by _EndResume while it takes the
+		//thread back, so a thread that finished and may be collected is never hooked
+		mutex interruptMutex{};
+
+		//the budget of the outermost call in progress, only set if it had a limit
+		bool isBudgetActive{};
+		LuaExecutionBudget activeBudget{};
+		u64 budgetInstructions{};
+		steady_clock::time_point budgetDeadline{};
+
+		//instructions between two count hook events, set by _UpdateHook
+		u32 hookInterval{};
+		//count hook interval used for budgets while the profiler is stopped
+		static constexpr u32 BUDGET_HOOK_INTERVAL = 1000;
+
+		//heap size and running state are read from Lua when stats are requested
+		LuaGCStats gcStats{};
+
+		//same as LUAI_GCSTEPSIZE, the step size Lua starts with
+		static constexpr int DEFAULT_GC_STEP_SIZE = 13;
+		//1 KB steps used inside StepGCFor
+		static constexpr int BUDGETED_GC_STEP_SIZE = 10;
+		//step size the collector goes back to after StepGCFor
+		int gcStepSize = DEFAULT_GC_STEP_SIZE;
+
+		template<typename R, typename... Args>
+		static constexpr void _AssertRegisterSignature()
+		{
+			static_assert(
+				(IsLuaStackCompatible<Args> && ...),
+				"Unsupported argument type was passed to RegisterFunction");
+
+			static_assert(
+				is_void_v<R>
+				|| IsLuaStackCompatible<R>,
+				"Unsupported return type was passed to RegisterFunction");
+		}
+
+		template<typename R, typename... Args>
+		static constexpr void _AssertRegisterPointer(R (*)(Args...))
+		{
+			_AssertRegisterSignature<R, Args...>();
+		}
+
+		//Read every arg straight off the Lua stack, call the target and push its return value,
+		//raises a Lua error only after every C++ value read from the stack has been destroyed,
+		//records the call into functionMetrics unless it is nullptr
+		template<typename R, typename... Args, typename F, size_t... I>
+		static int _InvokeFromStack(
+			lua_State* callState,
+			const F& target,
+			LuaFunctionMetrics* functionMetrics,
+			index_sequence<I...>)
+		{
+			constexpr int argCount = scast<int>(sizeof...(Args));
+
+			u64 callStart = functionMetrics ? functionMetrics->BeginCall() : 0;
+
+			//lua only guarantees LUA_MINSTACK free slots to C functions
+			if constexpr (!is_void_v<R>)
+			{
+				if constexpr (LuaStack<decay_t<R>>::slots > LUA_MINSTACK)
+				{
+					luaL_checkstack(callState, LuaStack<decay_t<R>>::slots, "too many return values");
+				}
+			}
+
+			const int passedCount = lua_gettop(callState);
+			int badArg{};
+			int returnCount{};
+
+			if (passedCount == argCount)
+			{
+				//the args, the result and their temporaries live in this block, so nothing in it
+				//may raise a Lua error, the memory limit stays lifted until they are destroyed
+				LuaLimitScope limitScope(callState, false);
+
+				tuple<decay_t<Args>...> values{};
+
+				((badArg == 0
+					&& !LuaStack<decay_t<Args>>::Read(callState, scast<int>(I) + 1, get<I>(values))
+					? (badArg = scast<int>(I) + 1)
+					: 0), ...);
+
+				if (badArg == 0)
+				{
+					if constexpr (is_void_v<R>)
+					{
+						target(scast<Args&&>(get<I>(values))...);
+					}
+					else
+					{
+						returnCount = LuaStack<decay_t<R>>::slots;
+
+						LuaStack<decay_t<R>>::Push(
+							callState,
+							target(scast<Args&&>(get<I>(values))...));
+					}
+				}
+			}
+
+			if (functionMetrics)
+			{
+				functionMetrics->EndCall(
+					callStart,
+					passedCount != argCount
+					|| badArg != 0);
+			}
+
+			if (passedCount != argCount)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Registered function expected %d args but got %d!",
+					argCount,
+					passedCount);
+			}
+
+			if (badArg != 0)
+			{
+				return luaL_error(
+					callState,
+					"KALALUA ERROR: Arg %d passed to registered function has an unsupported type!",
+					badArg);
+			}
+
+			return returnCount;
+		}
+
+		template<typename R, typename... Args>
+		static int _FunctionalTrampoline(lua_State* callState)
+		{
+			auto* f = scast<function<R(Args...)>*>(
+				lua_touserdata(callState, lua_upvalueindex(1)));
+
+			return _InvokeFromStack<R, Args...>(
+				callState,
+				*f,
+				_GetUpvalueMetrics(callState, 2),
+				index_sequence_for<Args...>{});
+		}
+
+		template<typename R, typename... Args>
+		static int _PointerTrampoline(lua_State* callState)
+		{
+			auto* f = scast<R(**)(Args...)>(
+				lua_touserdata(callState, lua_upvalueindex(1)));
+
+			return _InvokeFromStack<R, Args...>(
+				callState,
+				*f,
+				_GetUpvalueMetrics(callState, 2),
+				index_sequence_for<Args...>{});
+		}
+
+		template<auto F, typename R, typename... Args>
+		static int _StaticInvoke(
+			lua_State* callState,
+			R (*)(Args...))
+		{
+			return _InvokeFromStack<R, Args...>(
+				callState,
+				F,
+				_GetUpvalueMetrics(callState, 1),
+				index_sequence_for<Args...>{});
+		}
+
+		template<auto F>
+		static int _StaticTrampoline(lua_State* callState)
+		{
+			return _StaticInvoke<F>(callState, F);
+		}
+
+		//The metrics entry a registered closure carries as a light userdata upvalue
+		static LuaFunctionMetrics* _GetUpvalueMetrics(
+			lua_State* callState,
+			int upvalue)
+		{
+			return scast<LuaFunctionMetrics*>(lua_touserdata(callState, lua_upvalueindex(upvalue)));
+		}
+
+		//Push the metrics entry of a function that is being registered as a light userdata
+		void _PushMetricsUpvalue(
+			string_view functionName,
+			string_view functionNamespace)
+		{
+			lua_pushlightuserdata(state, metrics._GetEntry(
+				functionName,
+				functionNamespace,
+				LuaMetricsSource::REGISTERED_FUNCTION));
+		}
+
+		//Copy a C++ value into a new userdata on top of the stack,
+		//values that need destruction get a shared __gc metatable per type
+		template<typename T>
+		static void _PushOwnedUpvalue(
+			lua_State* pushState,
+			const T& value)
+		{
+			void* memory = lua_newuserdatauv(pushState, sizeof(T), 0);
+			new (memory) T(value);
+
+			if constexpr (!is_trivially_destructible_v<T>)
+			{
+				//the address of this static is unique per type and keys the metatable in the registry
+				static const char metatableKey{};
+
+				if (lua_rawgetp(pushState, LUA_REGISTRYINDEX, &metatableKey) == LUA_TNIL)
+				{
+					lua_pop(pushState, 1);
+
+					lua_createtable(pushState, 0, 1);
+					lua_pushcfunction(pushState, _DestroyUpvalue<T>);
+					lua_setfield(pushState, -2, "__gc");
+
+					lua_pushvalue(pushState, -1);
+					lua_rawsetp(pushState, LUA_REGISTRYINDEX, &metatableKey);
+				}
+
+				lua_setmetatable(pushState, -2);
+			}
+		}
+
+		template<typename T>
+		static int _DestroyUpvalue(lua_State* gcState)
+		{
+			scast<T*>(lua_touserdata(gcState, 1))->~T();
+			return 0;
+		}
+
+		//Numeric extraction helper to help lua cast into int/int64_t/uint64_t/float/double correctly
+		template<typename T>
+		static T ExtractLuaVar(const LuaVar& v)
+		{
+			if constexpr (is_same_v<T, int>)
+			{
+				if (holds_alternative<int>(v))      return get<int>(v);
+				if (holds_alternative<int64_t>(v))  return scast<int>(get<int64_t>(v));
+				if (holds_alternative<uint64_t>(v)) return scast<int>(get<uint64_t>(v));
+				if (holds_alternative<double>(v))   return scast<int>(get<double>(v));
+				if (holds_alternative<float>(v))    return scast<int>(get<float>(v));
+			}
+			else if constexpr (is_same_v<T, int64_t>)
+			{
+				if (holds_alternative<int64_t>(v))  return get<int64_t>(v);
+				if (holds_alternative<int>(v))      return get<int>(v);
+				if (holds_alternative<uint64_t>(v)) return scast<int64_t>(get<uint64_t>(v));
+				if (holds_alternative<double>(v))   return scast<int64_t>(get<double>(v));
+				if (holds_alternative<float>(v))    return scast<int64_t>(get<float>(v));
+			}
+			else if constexpr (is_same_v<T, uint64_t>)
+			{
+				if (holds_alternative<uint64_t>(v)) return get<uint64_t>(v);
+				if (holds_alternative<int64_t>(v))  return scast<uint64_t>(get<int64_t>(v));
+				if (holds_alternative<int>(v))      return scast<uint64_t>(get<int>(v));
+				if (holds_alternative<double>(v))   return scast<uint64_t>(get<double>(v));
+				if (holds_alternative<float>(v))    return scast<uint64_t>(get<float>(v));
+			}
+			else if constexpr (is_same_v<T, float>)
+			{
+				if (holds_alternative<float>(v))    return get<float>(v);
+				if (holds_alternative<double>(v))   return scast<float>(get<double>(v));
+				if (holds_alternative<int>(v))      return scast<float>(get<int>(v));
+				if (holds_alternative<int64_t>(v))  return scast<float>(get<int64_t>(v));
+				if (holds_alternative<uint64_t>(v)) return scast<float>(get<uint64_t>(v));
+			}
+			else if constexpr (is_same_v<T, double>)
+			{
+				if (holds_alternative<double>(v))   return get<double>(v);
+				if (holds_alternative<int>(v))      return scast<double>(get<int>(v));
+				if (holds_alternative<int64_t>(v))  return scast<double>(get<int64_t>(v));
+				if (holds_alternative<uint64_t>(v)) return scast<double>(get<uint64_t>(v));
+				if (holds_alternative<float>(v))    return scast<double>(get<float>(v));
+			}
+			else return get<T>(v);
+
+			KalaLuaCore::ForceClose(
+				"KalaLua type cast error",
+				"ExtractLuaVar failed to cast unsupported type!");
+		}
+
+		//Push args, call the function below them and read the typed return value,
+		//functionMetrics is nullptr while metrics are disabled
+		template<typename R, typename... Args>
+		static LuaCallResult<R> _CallTyped(
+			lua_State* callState,
+			string_view functionName,
+			LuaFunctionMetrics* functionMetrics,
+			Args&&... args)
+		{
+			static_assert(
+				is_void_v<R>
+				|| IsLuaStackCompatible<R>,
+				"Unsupported return type was passed to CallFunction");
+
+			//args are pushed and returns anchored outside of the protected call,
+			//_ProtectedCall enforces the limit again while the function runs
+			LuaLimitScope limitScope(callState, false);
+
+			//tuple args take one slot per element
+			constexpr int argCount = (0 + ... + LuaStack<decay_t<Args>>::slots);
+
+			if constexpr (argCount >= LUA_MINSTACK)
+			{
+				if (!lua_checkstack(callState, argCount))
+				{
+					lua_pop(callState, 1);
+
+					Log::Print(
+						"Failed to call function '" + string(functionName) + "' because the Lua stack could not grow to "
+						+ to_string(argCount) + " args!",
+						"KALALUA",
+						LogType::LOG_ERROR,
+						2);
+
+					return {};
+				}
+			}
+
+			(LuaStack<decay_t<Args>>::Push(callState, args), ...);
+
+			if constexpr (is_void_v<R>)
+			{
+				return _ProtectedCall(
+					callState,
+					functionName,
+					functionMetrics,
+					argCount,
+					0);
+			}
+			else
+			{
+				constexpr int returnCount = LuaStack<R>::slots;
+
+				optional<R> result{};
+				if (!_ProtectedCall(
+					callState,
+					functionName,
+					functionMetrics,
+					argCount,
+					returnCount))
+				{
+					return result;
+				}
+
+				result.emplace();
+				if (!LuaStack<R>::Read(callState, -returnCount, *result))
+				{
+					result.reset();
+
+					Log::Print(
+						"Unsupported Lua return type from function '" + string(functionName) + "'!",
+						"KALALUA",
+						LogType::LOG_ERROR,
+						2);
+				}
+
+				//borrowed strings point into the returned values, so they are kept referenced
+				if constexpr (IsLuaBorrowed<R>) _AnchorReturns(callState, returnCount);
+				else lua_pop(callState, returnCount);
+
+				return result;
+			}
+		}
+
+		//Compile and execute a script that is already in memory
+		bool _RunScript(
+			string_view name,
+			string_view source,
+			LuaLoadMode mode);
+
+		//Compile a script and push its chunk on top of the stack,
+		//loads it from the bytecode cache instead if an up to date entry exists
+		bool _CompileScript(
+			string_view name,
+			string_view source,
+			LuaLoadMode mode);
+
+		//Call the function on top of the stack once per element, pops it when done
+		template<typename R, typename F>
+		static size_t _CallBatch(
+			lua_State* callState,
+			string_view functionName,
+			LuaFunctionMetrics* functionMetrics,
+			size_t count,
+			F& fill,
+			span<LuaCallResult<R>> results)
+		{
+			static_assert(
+				!IsLuaBorrowed<R>,
+				"CallFunctionBatch cannot return string_view or const char* because every call replaces the last one, return string instead");
+
+			int functionIndex = lua_gettop(callState);
+
+			size_t succeeded{};
+			for (size_t i = 0; i < count; ++i)
+			{
+				lua_pushvalue(callState, functionIndex);
+
+				LuaCallResult<R> result = _CallTyped<R>(
+					callState,
+					functionName,
+					functionMetrics,
+					fill(i));
+
+				if (result) ++succeeded;
+				if (!results.empty()) results[i] = move(result);
+			}
+
+			lua_settop(callState, functionIndex - 1);
+
+			return succeeded;
+		}
+
+		//Returns false and logs if results is neither empty nor large enough for count calls
+		static bool _CheckBatchResults(
+			string_view functionName,
+			size_t count,
+			size_t resultCount);
+
+		//Resolve the namespace and push the function on top of the stack,
+		//returns the state the function was pushed to or nullptr on failure
+		lua_State* _PushFunction(
+			string_view functionName,
+			string_view functionNamespace);
+
+		//Push the function behind a resolved handle on top of the stack,
+		//returns the state the function was pushed to or nullptr on failure
+		lua_State* _PushFunctionRef(LuaFunctionRef& functionRef);
+
+		//Pop returnCount values into a registry slot that keeps them referenced until
+		//the next call that returns a borrowed string replaces them
+		static void _AnchorReturns(
+			lua_State* callState,
+			int returnCount);
+
+		//Call the function below argCount args with lua_pcall, logs and pops the error on failure,
+		//records the call into functionMetrics unless it is nullptr
+		static bool _ProtectedCall(
+			lua_State* callState,
+			string_view functionName,
+			LuaFunctionMetrics* functionMetrics,
+			int argCount,
+			int returnCount);
+
+		//The internal true function caller
+		bool _CallFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const vector<LuaVar>& args,
+			LuaVar* outReturn = nullptr);
+
+		//The internal function caller for resolved function handles
+		bool _CallFunctionRef(
+			LuaFunctionRef& functionRef,
+			const vector<LuaVar>& args,
+			LuaVar* outReturn = nullptr);
+
+		//Push the table of a namespace, from the cache if it is still current,
+		//otherwise by walking it from the global table, missing tables are created
+		//if isCreated is true, leaves the stack untouched and returns false on failure
+		bool _PushNamespace(
+			string_view functionNamespace,
+			bool isCreated);
+
+		//Push the cached table of a namespace if every segment still resolves to it,
+		//leaves the stack untouched and returns false otherwise
+		bool _PushCachedNamespace(const CachedNamespace& cached);
+
+		//Resolve the namespace and push the function on top of the stack,
+		//leaves the stack untouched on failure
+		bool _ResolveFunction(
+			string_view functionName,
+			string_view functionNamespace);
+
+		//Open a library that was waiting for its first use and leave its module on the Lua stack
+		void _OpenPendingLibrary(
+			lua_State* luaState,
+			LuaLibrary library);
+
+		//collectgarbage as scripts see it, calls the original from its upvalue
+		//and records collector mode switches in gcStats
+		static int _LuaCollectGarbage(lua_State* luaState);
+
+		//coroutine.resume and the closures coroutine.wrap returns, both resume through
+		//_BeginResume so budgets, interrupts and the profiler follow Lua into coroutines
+		static int _LuaResumeCoroutine(lua_State* luaState);
+		static int _LuaWrapCoroutine(lua_State* luaState);
+		static int _LuaResumeWrapped(lua_State* luaState);
+
+		//Call the function in the first upvalue with every arg while thread is published
+		//as the running thread, errors are raised again once it is taken back
+		static int _ForwardResume(
+			lua_State* luaState,
+			lua_State* thread,
+			bool isWrapped);
+
+		//Replace resume and wrap in the coroutine library table on top of the stack
+		static void _WrapCoroutineLibrary(lua_State* luaState);
+
+		//__index of the global table while lazy libraries are pending
+		static int _LazyGlobalIndex(lua_State* luaState);
+
+		//Every metamethod of the string metatable until the string library is opened,
+		//opens it and forwards to the real metamethod named by its upvalue
+		static int _LazyStringMetamethod(lua_State* luaState);
+
+		//The only hook KalaLua installs, runs every user of the count hook that is active
+		static void _DispatchHook(
+			lua_State* luaState,
+			lua_Debug* debug);
+
+		//Install the dispatch hook with the interval the active users need, or remove it
+		void _UpdateHook();
+
+		//Start the execution budget if this is the outermost call from C++ into Lua
+		void _BeginCall();
+
+		//Stop the execution budget and drop interrupts once the outermost call returns
+		void _EndCall();
+
+		//Publish thread as the thread Lua runs on and give it the hook of the thread resuming it,
+		//returns the thread that ran before, which _EndResume publishes again
+		lua_State* _BeginResume(
+			lua_State* from,
+			lua_State* thread);
+
+		void _EndResume(lua_State* previousThread);
+
+		//Raise a Lua error from the hook if the call was interrupted or ran out of budget
+		void _CheckBudget(
+			lua_State* luaState,
+			int event);
+
+		//Remember a file LoadScript opened so hot reload can watch it
+		void _TrackScript(
+			string_view script,
+			LuaLoadMode mode);
+
+		//Validate the names and push the namespace table the function will be stored in,
+		//returns the state to push the closure to or nullptr on failure
+		lua_State* _BeginRegister(
+			string_view functionName,
+			string_view functionNamespace);
+
+		//Store the closure on top of the stack into the namespace table below it
+		void _EndRegister(
+			string_view functionName,
+			string_view functionNamespace);
+	};
+
+	//Runs every call made while it lives under its own budget instead of the state budget,
+	//for limits on a single call, the previous budget is restored when it goes out of scope
+	class LuaBudgetScope
+	{
+	public:
+		LuaBudgetScope(
+			LuaState& owner,
+			const LuaExecutionBudget& budget)
+			: owner(owner),
+			previousBudget(owner.GetExecutionBudget())
+		{
+			owner.SetExecutionBudget(budget);
+		}
+
+		~LuaBudgetScope() { owner.SetExecutionBudget(previousBudget); }
+
+		LuaBudgetScope(const LuaBudgetScope&) = delete;
+		LuaBudgetScope& operator=(const LuaBudgetScope&) = delete;
+		LuaBudgetScope(LuaBudgetScope&&) = delete;
+		LuaBudgetScope& operator=(LuaBudgetScope&&) = delete;
+	private:
+		LuaState& owner;
+		LuaExecutionBudget previousBudget{};
+	};
+}
\ No newline at end of file
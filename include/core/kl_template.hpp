@@ -0,0 +1,176 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <span>
+#include <atomic>
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+
+namespace KalaLua::Core
+{
+	using std::string;
+	using std::string_view;
+	using std::vector;
+	using std::function;
+	using std::span;
+	using std::atomic;
+
+	using u64 = uint64_t;
+
+	struct LuaTemplateStats
+	{
+		//states created through Instantiate
+		u64 instances{};
+		//time the last Instantiate took
+		u64 lastInstanceNanoseconds{};
+		//time every Instantiate took together
+		u64 totalInstanceNanoseconds{};
+	};
+
+	//Records the setup of a state once and creates new, fully independent states from it.
+	//Every setup call runs on a prototype state right away so mistakes show up at record time,
+	//scripts are recorded as the chunks they compiled to, so instances load precompiled
+	//bytecode instead of parsing source again, and registrations are replayed as they were made.
+	//Instantiate can run on several threads at once as long as no step is added meanwhile
+	class LIB_API LuaStateTemplate
+	{
+	public:
+		LuaStateTemplate() = default;
+
+		LuaStateTemplate(const LuaStateTemplate&) = delete;
+		LuaStateTemplate& operator=(const LuaStateTemplate&) = delete;
+		LuaStateTemplate(LuaStateTemplate&&) = delete;
+		LuaStateTemplate& operator=(LuaStateTemplate&&) = delete;
+
+		//Start recording, every instance gets these libraries and this allocator
+		bool Initialize(
+			const vector<LuaLibrary>& libs = {},
+			const LuaAllocatorConfig& allocator = {});
+
+		bool IsInitialized() const { return prototype.IsInitialized(); }
+
+		//Load a script into the prototype and record its compiled chunk
+		bool LoadScript(
+			string_view script,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY);
+
+		//Load a script from memory into the prototype and record its compiled chunk
+		bool LoadScriptFromBuffer(
+			string_view name,
+			span<const char> buffer,
+			LuaLoadMode mode = LuaLoadMode::LOAD_TEXT_AND_BINARY);
+
+		//Register a functional into the prototype and every instance, same rules as LuaState
+		template<typename... Args, typename R>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const function<R(Args...)>& targetFunction)
+		{
+			return AddSetupStep([
+				functionName = string(functionName),
+				functionNamespace = string(functionNamespace),
+				targetFunction](LuaState& state) -> bool
+				{
+					return state.RegisterFunction(
+						functionName,
+						functionNamespace,
+						targetFunction);
+				});
+		}
+
+		//Register a free function pointer into the prototype and every instance, same rules as LuaState
+		template<typename... Args, typename R>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			R (*func)(Args...))
+		{
+			return AddSetupStep([
+				functionName = string(functionName),
+				functionNamespace = string(functionNamespace),
+				func](LuaState& state) -> bool
+				{
+					return state.RegisterFunction(
+						functionName,
+						functionNamespace,
+						func);
+				});
+		}
+
+		//Register a free function passed as a template argument into the prototype and every instance
+		template<auto F>
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace)
+		{
+			return AddSetupStep([
+				functionName = string(functionName),
+				functionNamespace = string(functionNamespace)](LuaState& state) -> bool
+				{
+					return state.RegisterFunction<F>(
+						functionName,
+						functionNamespace);
+				});
+		}
+
+		//Register a function that works with the lua_State directly into the prototype and every instance
+		bool RegisterFunction(
+			string_view functionName,
+			string_view functionNamespace,
+			const function<int(lua_State*)>& targetFunction);
+
+		//Record any other setup, such as class bindings or GC settings, it runs on the prototype now
+		//and on every instance in the order it was added, returning false fails the setup
+		bool AddSetupStep(const function<bool(LuaState&)>& step);
+
+		//Set up an uninitialized state from the recorded steps, the state shares nothing
+		//with the prototype or other instances, it is shut down again if any step fails
+		bool Instantiate(LuaState& outState);
+
+		//The state every step runs on while recording, for inspecting the result
+		LuaState& GetPrototype() { return prototype; }
+
+		//Counters of every Instantiate so far, safe to read while instances are created
+		LuaTemplateStats GetStats() const;
+
+		//Drop every recorded step and shut down the prototype
+		void Shutdown();
+	private:
+		struct SetupStep
+		{
+			//chunk name and compiled bytecode of a script, empty for other steps
+			string chunkName{};
+			vector<char> chunk{};
+
+			function<bool(LuaState&)> setup{};
+		};
+
+		LuaState prototype{};
+
+		vector<LuaLibrary> libraries{};
+		LuaAllocatorConfig allocatorConfig{};
+
+		vector<SetupStep> steps{};
+
+		//relaxed counters, Instantiate may run on several threads at once
+		atomic<u64> instanceCount{};
+		atomic<u64> lastInstanceNanoseconds{};
+		atomic<u64> totalInstanceNanoseconds{};
+
+		//Record the chunk the last script load into the prototype compiled to
+		bool _RecordChunk(
+			string_view name,
+			bool isLoaded,
+			vector<char>& chunk);
+	};
+}
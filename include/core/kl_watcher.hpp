@@ -0,0 +1,80 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#pragma once
+
+#include <vector>
+#include <filesystem>
+#include <unordered_map>
+
+#include "core_utils.hpp"
+
+namespace KalaLua::Core
+{
+	using std::vector;
+	using std::unordered_map;
+	using std::filesystem::path;
+	using std::filesystem::file_time_type;
+
+	//Reports files that were written since the last poll. On Linux the directories of the
+	//watched files are watched through inotify, so editors that save by renaming a temporary
+	//file over the original are still seen and polling costs one non-blocking read.
+	//Everywhere else every poll compares the last write time of each file.
+	//Not thread safe, polling only happens when the owner calls Poll
+	class LIB_API LuaFileWatcher
+	{
+	public:
+		LuaFileWatcher() = default;
+		~LuaFileWatcher();
+
+		LuaFileWatcher(const LuaFileWatcher&) = delete;
+		LuaFileWatcher& operator=(const LuaFileWatcher&) = delete;
+		LuaFileWatcher(LuaFileWatcher&&) = delete;
+		LuaFileWatcher& operator=(LuaFileWatcher&&) = delete;
+
+		//Start watching, files added before Start are watched from now on
+		//and the first poll reports the ones written while stopped
+		bool Start();
+
+		bool IsRunning() const { return isRunning; }
+
+		//Add a file to watch and get the absolute path Poll reports it as,
+		//files that are already watched are not added again
+		path Watch(const path& file);
+
+		//Append every watched file that was written since the last poll to outChanged,
+		//each file at most once per poll, in absolute form
+		void Poll(vector<path>& outChanged);
+
+		//Stop watching, the list of files is kept for the next Start
+		void Stop();
+
+		//Stop watching and forget every file
+		void Clear();
+	private:
+		struct WatchedFile
+		{
+			//absolute and normalized, compared against the paths inotify reports
+			path file{};
+			file_time_type lastWriteTime{};
+		};
+
+		vector<WatchedFile> files{};
+		bool isRunning{};
+		//compare the write time of every file on the next poll
+		bool isScanPending{};
+
+#ifdef __linux__
+		int inotifyDescriptor = -1;
+
+		//directory of every inotify watch descriptor
+		unordered_map<int, path> directories{};
+
+		void _AddDirectoryWatch(const path& file);
+#endif
+
+		static file_time_type _GetLastWriteTime(const path& file);
+	};
+}
@@ -0,0 +1,275 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "core_utils.hpp"
+
+#include "core/kl_allocator.hpp"
+
+using std::realloc;
+using std::malloc;
+using std::free;
+using std::memcpy;
+using std::min;
+using std::max;
+
+namespace KalaLua::Core
+{
+	//size class of every request size rounded up to 16 bytes, indexed by (size + 15) / 16
+	static constexpr array<u8, 17> SIZE_CLASS_LOOKUP = []
+		{
+			array<u8, 17> result{};
+
+			size_t sizeClass{};
+			for (size_t i = 0; i < result.size(); ++i)
+			{
+				while (LuaAllocator::sizeClasses[sizeClass] < i * 16) ++sizeClass;
+				result[i] = scast<u8>(sizeClass);
+			}
+
+			return result;
+		}();
+
+	LuaAllocator::~LuaAllocator()
+	{
+		Release();
+	}
+
+	void LuaAllocator::Configure(const LuaAllocatorConfig& newConfig)
+	{
+		Release();
+
+		config = newConfig;
+	}
+
+	void LuaAllocator::Release()
+	{
+		for (void* slab : slabs) free(slab);
+
+		slabs.clear();
+		freeLists.fill(nullptr);
+		keptHeapBlocks = 0;
+
+		stats = {};
+		isLimitEnforced = false;
+	}
+
+	void* LuaAllocator::Allocate(
+		void* userData,
+		void* block,
+		size_t oldSize,
+		size_t newSize)
+	{
+		return scast<LuaAllocator*>(userData)->_Reallocate(
+			block,
+			oldSize,
+			newSize);
+	}
+
+	void* LuaAllocator::_Reallocate(
+		void* block,
+		size_t oldSize,
+		size_t newSize)
+	{
+		//lua passes the type of the new object instead of a size when block is null
+		size_t currentSize = block ? oldSize : 0;
+
+		if (newSize == 0)
+		{
+			if (!block) return nullptr;
+
+			switch (config.type)
+			{
+			case LuaAllocatorType::ALLOCATOR_POOL:
+				_PoolFree(block, _GetSizeClass(currentSize));
+				break;
+			case LuaAllocatorType::ALLOCATOR_CUSTOM:
+				config.customAlloc(config.customUserData, block, oldSize, 0);
+				break;
+			default:
+				free(block);
+				break;
+			}
+
+			stats.bytesInUse -= currentSize;
+			return nullptr;
+		}
+
+		//lua assumes shrinking never fails, so only growth is held to the limit
+		if (newSize > currentSize
+			&& isLimitEnforced
+			&& config.memoryLimit != 0
+			&& stats.bytesInUse - currentSize + newSize > config.memoryLimit)
+		{
+			++stats.failedAllocations;
+			return nullptr;
+		}
+
+		void* result{};
+		switch (config.type)
+		{
+		case LuaAllocatorType::ALLOCATOR_POOL:
+			result = _PoolReallocate(block, currentSize, newSize);
+			break;
+		case LuaAllocatorType::ALLOCATOR_CUSTOM:
+			result = config.customAlloc(config.customUserData, block, oldSize, newSize);
+			break;
+		default:
+			result = realloc(block, newSize);
+			break;
+		}
+
+		if (!result)
+		{
+			++stats.failedAllocations;
+			return nullptr;
+		}
+
+		if (block) ++stats.reallocations;
+		else
+		{
+			++stats.allocations;
+
+			size_t sizeClass = _GetSizeClass(newSize);
+			if (sizeClass == LARGE_CLASS) ++stats.largeAllocations;
+			else ++stats.sizeClassAllocations[sizeClass];
+		}
+
+		stats.bytesInUse = stats.bytesInUse - currentSize + newSize;
+		stats.peakBytes = max(stats.peakBytes, stats.bytesInUse);
+
+		return result;
+	}
+
+	void* LuaAllocator::_PoolReallocate(
+		void* block,
+		size_t oldSize,
+		size_t newSize)
+	{
+		size_t oldClass = block ? _GetSizeClass(oldSize) : LARGE_CLASS;
+		size_t newClass = _GetSizeClass(newSize);
+
+		//lua assumes shrinking never fails, so a block that can not move to a smaller class
+		//is kept as is, it is still large enough for the class its new size maps to,
+		//a kept slab block joins that class's free list once Lua frees it
+		bool isShrink = block && newSize <= oldSize;
+
+		if (block
+			&& oldClass == newClass)
+		{
+			//the block already has room for any size in its class
+			if (newClass != LARGE_CLASS) return block;
+
+			void* result = realloc(block, newSize);
+			return !result && isShrink
+				? block
+				: result;
+		}
+
+		void* result = newClass == LARGE_CLASS
+			? malloc(newSize)
+			: _PoolAllocate(newClass);
+
+		if (!result
+			&& isShrink)
+		{
+			//a heap block must go back to free, _PoolFree tells it apart from slab blocks
+			if (oldClass == LARGE_CLASS) ++keptHeapBlocks;
+
+			return block;
+		}
+
+		if (!result
+			|| !block)
+		{
+			return result;
+		}
+
+		memcpy(result, block, min(oldSize, newSize));
+
+		if (oldClass == LARGE_CLASS) free(block);
+		else _PoolFree(block, oldClass);
+
+		return result;
+	}
+
+	void* LuaAllocator::_PoolAllocate(size_t sizeClass)
+	{
+		FreeBlock* head = freeLists[sizeClass];
+
+		if (!head)
+		{
+			//carve a new slab into blocks of this class and thread them into the free list
+			char* slab = scast<char*>(malloc(SLAB_SIZE));
+			if (!slab) return nullptr;
+
+			slabs.push_back(slab);
+			stats.reservedBytes += SLAB_SIZE;
+
+			size_t blockSize = sizeClasses[sizeClass];
+			size_t blockCount = SLAB_SIZE / blockSize;
+
+			for (size_t i = blockCount; i > 0; --i)
+			{
+				FreeBlock* freeBlock = reinterpret_cast<FreeBlock*>(slab + (i - 1) * blockSize);
+				freeBlock->next = head;
+				head = freeBlock;
+			}
+		}
+
+		freeLists[sizeClass] = head->next;
+		return head;
+	}
+
+	void LuaAllocator::_PoolFree(
+		void* block,
+		size_t sizeClass)
+	{
+		if (sizeClass == LARGE_CLASS)
+		{
+			free(block);
+			return;
+		}
+
+		if (keptHeapBlocks != 0
+			&& !_IsSlabBlock(block))
+		{
+			--keptHeapBlocks;
+			free(block);
+			return;
+		}
+
+		FreeBlock* freeBlock = scast<FreeBlock*>(block);
+		freeBlock->next = freeLists[sizeClass];
+		freeLists[sizeClass] = freeBlock;
+	}
+
+	bool LuaAllocator::_IsSlabBlock(const void* block) const
+	{
+		uintptr_t address = reinterpret_cast<uintptr_t>(block);
+
+		for (void* slab : slabs)
+		{
+			uintptr_t start = reinterpret_cast<uintptr_t>(slab);
+			if (address >= start
+				&& address < start + SLAB_SIZE)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	size_t LuaAllocator::_GetSizeClass(size_t size)
+	{
+		if (size > MAX_POOLED_SIZE) return LARGE_CLASS;
+
+		return SIZE_CLASS_LOOKUP[(size + 15) / 16];
+	}
+}
@@ -0,0 +1,649 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <variant>
+#include <cstring>
+#include <climits>
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_channel.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::visit;
+using std::decay_t;
+using std::is_same_v;
+using std::swap;
+using std::memcpy;
+using std::make_unique;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+namespace KalaLua::Core
+{
+	enum class MessageTag : u8
+	{
+		TAG_NIL,
+		TAG_FALSE,
+		TAG_TRUE,
+		TAG_INTEGER,
+		TAG_NUMBER,
+		TAG_STRING,
+		TAG_TABLE
+	};
+
+	//tables nested deeper than this are rejected, which also catches tables that contain themselves
+	static constexpr u32 MAX_MESSAGE_DEPTH = 32;
+
+	//message the Lua functions of the current thread read into and receive into,
+	//its buffer is swapped with channel slots so it is reused instead of reallocated
+	static thread_local LuaMessage scratchMessage{};
+
+	static void AppendTag(
+		string& out,
+		MessageTag tag)
+	{
+		out.push_back(scast<char>(tag));
+	}
+
+	template<typename T>
+	static void AppendRaw(
+		string& out,
+		T value)
+	{
+		char bytes[sizeof(T)];
+		memcpy(bytes, &value, sizeof(T));
+		out.append(bytes, sizeof(T));
+	}
+
+	template<typename T>
+	static bool ReadRaw(
+		string_view data,
+		size_t& offset,
+		T& out)
+	{
+		if (data.size() - offset < sizeof(T)) return false;
+
+		memcpy(&out, data.data() + offset, sizeof(T));
+		offset += sizeof(T);
+		return true;
+	}
+
+	static void AppendString(
+		string& out,
+		const char* str,
+		size_t length)
+	{
+		AppendTag(out, MessageTag::TAG_STRING);
+		AppendRaw(out, scast<u32>(length));
+		out.append(str, length);
+	}
+
+	//Returns nullptr or the reason the value can not be sent
+	static const char* EncodeValue(
+		lua_State* state,
+		int index,
+		string& out,
+		u32 depth)
+	{
+		switch (lua_type(state, index))
+		{
+		case LUA_TNIL:
+			AppendTag(out, MessageTag::TAG_NIL);
+			return nullptr;
+		case LUA_TBOOLEAN:
+			AppendTag(out, lua_toboolean(state, index)
+				? MessageTag::TAG_TRUE
+				: MessageTag::TAG_FALSE);
+			return nullptr;
+		case LUA_TNUMBER:
+			if (lua_isinteger(state, index))
+			{
+				AppendTag(out, MessageTag::TAG_INTEGER);
+				AppendRaw(out, lua_tointegerx(state, index, nullptr));
+			}
+			else
+			{
+				AppendTag(out, MessageTag::TAG_NUMBER);
+				AppendRaw(out, lua_tonumberx(state, index, nullptr));
+			}
+			return nullptr;
+		case LUA_TSTRING:
+		{
+			size_t length{};
+			const char* str = lua_tolstring(state, index, &length);
+			if (length > UINT32_MAX) return "strings larger than 4 GB can not be sent";
+
+			AppendString(out, str, length);
+			return nullptr;
+		}
+		case LUA_TTABLE:
+		{
+			if (depth == MAX_MESSAGE_DEPTH) return "tables nest too deep or contain themselves";
+
+			//lua_next keeps a key and a value on the stack
+			if (!lua_checkstack(state, 2)) return "the Lua stack could not grow";
+
+			index = lua_absindex(state, index);
+
+			AppendTag(out, MessageTag::TAG_TABLE);
+
+			//the pair count is only known after the traversal
+			size_t countOffset = out.size();
+			AppendRaw(out, u32{});
+
+			u32 pairCount{};
+			lua_pushnil(state);
+			while (lua_next(state, index) != 0)
+			{
+				int keyType = lua_type(state, -2);
+				if (keyType != LUA_TBOOLEAN
+					&& keyType != LUA_TNUMBER
+					&& keyType != LUA_TSTRING)
+				{
+					lua_pop(state, 2);
+					return "table keys must be booleans, numbers or strings";
+				}
+
+				const char* error = EncodeValue(state, -2, out, depth + 1);
+				if (!error) error = EncodeValue(state, -1, out, depth + 1);
+
+				if (error)
+				{
+					lua_pop(state, 2);
+					return error;
+				}
+
+				lua_pop(state, 1);
+				++pairCount;
+			}
+
+			memcpy(out.data() + countOffset, &pairCount, sizeof(pairCount));
+			return nullptr;
+		}
+		default:
+			return "functions, userdata and threads can not be sent";
+		}
+	}
+
+	//Push the value at offset and move past it, returns false if the data is cut short
+	static bool DecodeValue(
+		lua_State* state,
+		string_view data,
+		size_t& offset)
+	{
+		if (offset >= data.size()) return false;
+
+		MessageTag tag = scast<MessageTag>(data[offset++]);
+
+		switch (tag)
+		{
+		case MessageTag::TAG_NIL:
+			lua_pushnil(state);
+			return true;
+		case MessageTag::TAG_FALSE:
+			lua_pushboolean(state, 0);
+			return true;
+		case MessageTag::TAG_TRUE:
+			lua_pushboolean(state, 1);
+			return true;
+		case MessageTag::TAG_INTEGER:
+		{
+			lua_Integer value{};
+			if (!ReadRaw(data, offset, value)) return false;
+
+			lua_pushinteger(state, value);
+			return true;
+		}
+		case MessageTag::TAG_NUMBER:
+		{
+			lua_Number value{};
+			if (!ReadRaw(data, offset, value)) return false;
+
+			lua_pushnumber(state, value);
+			return true;
+		}
+		case MessageTag::TAG_STRING:
+		{
+			u32 length{};
+			if (!ReadRaw(data, offset, length)
+				|| data.size() - offset < length)
+			{
+				return false;
+			}
+
+			lua_pushlstring(state, data.data() + offset, length);
+			offset += length;
+			return true;
+		}
+		case MessageTag::TAG_TABLE:
+		{
+			u32 pairCount{};
+			if (!ReadRaw(data, offset, pairCount)) return false;
+
+			//the table, a key and a value
+			if (!lua_checkstack(state, 3)) return false;
+
+			lua_createtable(state, 0, scast<int>(pairCount > INT_MAX ? INT_MAX : pairCount));
+
+			for (u32 i = 0; i < pairCount; ++i)
+			{
+				if (!DecodeValue(state, data, offset))
+				{
+					lua_pop(state, 1);
+					return false;
+				}
+
+				if (!DecodeValue(state, data, offset))
+				{
+					lua_pop(state, 2);
+					return false;
+				}
+
+				lua_rawset(state, -3);
+			}
+
+			return true;
+		}
+		}
+
+		return false;
+	}
+
+	bool LuaMessage::Read(
+		lua_State* state,
+		int index,
+		int count)
+	{
+		const char* error = _Read(state, index, count);
+		if (!error) return true;
+
+		Log::Print(
+			"Failed to read Lua message because " + string(error) + "!",
+			"KALALUA_CHANNEL",
+			LogType::LOG_ERROR,
+			2);
+
+		return false;
+	}
+
+	const char* LuaMessage::_Read(
+		lua_State* state,
+		int index,
+		int count)
+	{
+		Clear();
+
+		index = lua_absindex(state, index);
+
+		for (int i = 0; i < count; ++i)
+		{
+			const char* error = EncodeValue(state, index + i, data, 0);
+			if (error)
+			{
+				Clear();
+				return error;
+			}
+		}
+
+		valueCount = scast<u32>(count);
+		return nullptr;
+	}
+
+	int LuaMessage::Push(lua_State* state) const
+	{
+		if (!lua_checkstack(state, scast<int>(valueCount))) return -1;
+
+		int top = lua_gettop(state);
+
+		size_t offset{};
+		for (u32 i = 0; i < valueCount; ++i)
+		{
+			if (!DecodeValue(state, data, offset))
+			{
+				lua_settop(state, top);
+				return -1;
+			}
+		}
+
+		return scast<int>(valueCount);
+	}
+
+	void LuaMessage::Add(const LuaVar& value)
+	{
+		visit([this](const auto& v)
+			{
+				using T = decay_t<decltype(v)>;
+
+				if constexpr (is_same_v<T, bool>)
+				{
+					AppendTag(data, v ? MessageTag::TAG_TRUE : MessageTag::TAG_FALSE);
+				}
+				else if constexpr (is_same_v<T, float>
+					|| is_same_v<T, double>)
+				{
+					AppendTag(data, MessageTag::TAG_NUMBER);
+					AppendRaw(data, scast<lua_Number>(v));
+				}
+				else if constexpr (is_same_v<T, string>)
+				{
+					AppendString(data, v.data(), v.size());
+				}
+				else
+				{
+					AppendTag(data, MessageTag::TAG_INTEGER);
+					AppendRaw(data, scast<lua_Integer>(v));
+				}
+			}, value);
+
+		++valueCount;
+	}
+
+	bool LuaMessage::ToVars(vector<LuaVar>& outValues) const
+	{
+		outValues.clear();
+		outValues.reserve(valueCount);
+
+		string_view view = data;
+		size_t offset{};
+
+		for (u32 i = 0; i < valueCount; ++i)
+		{
+			if (offset >= view.size()) return false;
+
+			MessageTag tag = scast<MessageTag>(view[offset++]);
+
+			switch (tag)
+			{
+			case MessageTag::TAG_FALSE:
+				outValues.emplace_back(false);
+				break;
+			case MessageTag::TAG_TRUE:
+				outValues.emplace_back(true);
+				break;
+			case MessageTag::TAG_INTEGER:
+			{
+				lua_Integer value{};
+				if (!ReadRaw(view, offset, value)) return false;
+
+				//same narrowing rule as integer returns of CallFunction
+				if (value >= INT_MIN && value <= INT_MAX) outValues.emplace_back(scast<int>(value));
+				else outValues.emplace_back(scast<int64_t>(value));
+				break;
+			}
+			case MessageTag::TAG_NUMBER:
+			{
+				lua_Number value{};
+				if (!ReadRaw(view, offset, value)) return false;
+
+				outValues.emplace_back(scast<double>(value));
+				break;
+			}
+			case MessageTag::TAG_STRING:
+			{
+				u32 length{};
+				if (!ReadRaw(view, offset, length)
+					|| view.size() - offset < length)
+				{
+					return false;
+				}
+
+				outValues.emplace_back(string(view.substr(offset, length)));
+				offset += length;
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void LuaMessage::Clear()
+	{
+		data.clear();
+		valueCount = 0;
+	}
+
+	LuaChannel::LuaChannel(u32 capacity)
+	{
+		size_t slotCount = 2;
+		while (slotCount < capacity) slotCount <<= 1;
+
+		slots = make_unique<Slot[]>(slotCount);
+		mask = slotCount - 1;
+
+		for (size_t i = 0; i < slotCount; ++i)
+		{
+			slots[i].sequence.store(i, memory_order_relaxed);
+		}
+	}
+
+	bool LuaChannel::TrySend(LuaMessage& message)
+	{
+		size_t position = sendPosition.load(memory_order_relaxed);
+		Slot* slot{};
+
+		while (true)
+		{
+			slot = &slots[position & mask];
+			size_t sequence = slot->sequence.load(memory_order_acquire);
+
+			if (sequence == position)
+			{
+				if (sendPosition.compare_exchange_weak(
+					position,
+					position + 1,
+					memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			//the slot still holds the message from one lap ago
+			else if (sequence < position) return false;
+			else position = sendPosition.load(memory_order_relaxed);
+		}
+
+		//the slot gets the message and the sender gets back the buffer a receiver left there
+		swap(slot->message.data, message.data);
+		slot->message.valueCount = message.valueCount;
+		message.Clear();
+
+		slot->sequence.store(position + 1, memory_order_release);
+		return true;
+	}
+
+	bool LuaChannel::TryReceive(LuaMessage& outMessage)
+	{
+		size_t position = receivePosition.load(memory_order_relaxed);
+		Slot* slot{};
+
+		while (true)
+		{
+			slot = &slots[position & mask];
+			size_t sequence = slot->sequence.load(memory_order_acquire);
+
+			if (sequence == position + 1)
+			{
+				if (receivePosition.compare_exchange_weak(
+					position,
+					position + 1,
+					memory_order_relaxed))
+				{
+					break;
+				}
+			}
+			//no sender has filled this slot yet
+			else if (sequence < position + 1) return false;
+			else position = receivePosition.load(memory_order_relaxed);
+		}
+
+		swap(slot->message.data, outMessage.data);
+		outMessage.valueCount = slot->message.valueCount;
+		slot->message.Clear();
+
+		//free the slot for the sender one lap ahead
+		slot->sequence.store(position + mask + 1, memory_order_release);
+		return true;
+	}
+
+	u32 LuaChannel::GetSize() const
+	{
+		size_t sent = sendPosition.load(memory_order_relaxed);
+		size_t received = receivePosition.load(memory_order_relaxed);
+
+		return sent > received ? scast<u32>(sent - received) : 0;
+	}
+
+	bool LuaChannel::Bind(
+		LuaState& state,
+		string_view luaName)
+	{
+		if (!state.IsInitialized())
+		{
+			Log::Print(
+				"Failed to bind Lua channel because its Lua state is not initialized!",
+				"KALALUA_CHANNEL",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (luaName.empty()
+			|| luaName.find('.') != string_view::npos)
+		{
+			Log::Print(
+				"Failed to bind Lua channel because its name was empty or dotted!",
+				"KALALUA_CHANNEL",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		lua_State* luaState = state.GetLuaState();
+
+		//receive yields, so the functions are plain C functions with no C++ frames
+		//a yield could jump over, the channel is their only upvalue
+
+		lua_createtable(luaState, 0, 4);
+
+		auto add_function = [this, luaState](
+			const char* name,
+			lua_CFunction function) -> void
+			{
+				lua_pushlightuserdata(luaState, this);
+				lua_pushcclosure(luaState, function, 1);
+				lua_setfield(luaState, -2, name);
+			};
+
+		add_function("send", _LuaSend);
+		add_function("try_receive", _LuaTryReceive);
+		add_function("receive", _LuaReceive);
+		add_function("size", _LuaSize);
+
+		lua_setglobal(luaState, string(luaName).c_str());
+
+		Log::Print(
+			"Bound Lua channel '" + string(luaName) + "'!",
+			"KALALUA_CHANNEL",
+			LogType::LOG_SUCCESS);
+
+		return true;
+	}
+
+	//the Lua functions below raise errors with luaL_error, which skips C++ destructors,
+	//so they only keep trivially destructible values on their own frames
+
+	int LuaChannel::_LuaSend(lua_State* state)
+	{
+		LuaChannel* channel = scast<LuaChannel*>(lua_touserdata(state, lua_upvalueindex(1)));
+
+		const char* error = scratchMessage._Read(
+			state,
+			1,
+			lua_gettop(state));
+
+		if (error) return luaL_error(state, "channel send failed because %s", error);
+
+		lua_pushboolean(state, channel->TrySend(scratchMessage));
+		return 1;
+	}
+
+	int LuaChannel::_LuaTryReceive(lua_State* state)
+	{
+		LuaChannel* channel = scast<LuaChannel*>(lua_touserdata(state, lua_upvalueindex(1)));
+
+		if (!channel->TryReceive(scratchMessage))
+		{
+			lua_pushboolean(state, 0);
+			return 1;
+		}
+
+		lua_pushboolean(state, 1);
+
+		int valueCount = scratchMessage.Push(state);
+		if (valueCount < 0) return luaL_error(state, "channel receive failed because the Lua stack could not grow");
+
+		return valueCount + 1;
+	}
+
+	int LuaChannel::_LuaReceive(lua_State* state)
+	{
+		LuaChannel* channel = scast<LuaChannel*>(lua_touserdata(state, lua_upvalueindex(1)));
+
+		if (channel->TryReceive(scratchMessage))
+		{
+			int valueCount = scratchMessage.Push(state);
+			if (valueCount < 0) return luaL_error(state, "channel receive failed because the Lua stack could not grow");
+
+			return valueCount;
+		}
+
+		if (!lua_isyieldable(state))
+		{
+			return luaL_error(state, "channel receive can only wait inside a coroutine, use try_receive instead");
+		}
+
+		//whoever resumes the coroutine makes it check again, a scheduler task once per Tick
+		return lua_yieldk(state, 0, 0, _LuaReceiveContinue);
+	}
+
+	int LuaChannel::_LuaReceiveContinue(
+		lua_State* state,
+		int,
+		lua_KContext)
+	{
+		//drop whatever the resume passed in, the continuation still has the upvalues of receive
+		lua_settop(state, 0);
+
+		return _LuaReceive(state);
+	}
+
+	int LuaChannel::_LuaSize(lua_State* state)
+	{
+		LuaChannel* channel = scast<LuaChannel*>(lua_touserdata(state, lua_upvalueindex(1)));
+
+		lua_pushinteger(state, scast<lua_Integer>(channel->GetSize()));
+		return 1;
+	}
+}
@@ -0,0 +1,279 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_class.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::string_view;
+
+namespace KalaLua::Core
+{
+	LuaClassBase::LuaClassBase(
+		LuaState& state,
+		string_view newClassName,
+		string_view classNamespace,
+		const void* classKey,
+		lua_CFunction collect)
+	{
+		if (!state.IsInitialized())
+		{
+			Log::Print(
+				"Failed to bind class '" + string(newClassName) + "' because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return;
+		}
+
+		if (newClassName.empty()
+			|| newClassName.size() > 50
+			|| newClassName.find('.') != string::npos)
+		{
+			Log::Print(
+				"Failed to bind class because its name was empty, dotted or too long.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return;
+		}
+		if (classNamespace.size() > 50)
+		{
+			Log::Print(
+				"Failed to bind class '" + string(newClassName) + "' because namespace was too long.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return;
+		}
+
+		owner = &state;
+		ownerGeneration = state.stateGeneration;
+		className = string(newClassName);
+		classPath = classNamespace.empty()
+			? className
+			: string(classNamespace) + "." + className;
+
+		lua_State* luaState = state.GetLuaState();
+
+		//binding is not protected, so it must not run into the memory limit
+		LuaLimitScope limitScope(luaState, false);
+
+		lua_createtable(luaState, 0, 5);
+
+		lua_pushstring(luaState, className.c_str());
+		lua_setfield(luaState, -2, "__name");
+
+		//getmetatable returns the name instead, so scripts cannot reach the dispatch functions
+		lua_pushstring(luaState, className.c_str());
+		lua_setfield(luaState, -2, "__metatable");
+
+		lua_pushcfunction(luaState, collect);
+		lua_setfield(luaState, -2, "__gc");
+
+		//without properties Lua indexes the method table directly, no C function in between
+		lua_newtable(luaState);
+		lua_pushvalue(luaState, -1);
+		methodsRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		lua_setfield(luaState, -2, "__index");
+
+		lua_pushvalue(luaState, -1);
+		metatableRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		lua_rawsetp(luaState, LUA_REGISTRYINDEX, classKey);
+
+		Log::Print(
+			"Bound class '" + classPath + "'!",
+			"KALALUA",
+			LogType::LOG_SUCCESS);
+	}
+
+	LuaClassBase::~LuaClassBase()
+	{
+		//the tables stay alive through the metatable and the dispatch closures
+		if (!IsValid()) return;
+
+		lua_State* luaState = owner->GetLuaState();
+
+		luaL_unref(luaState, LUA_REGISTRYINDEX, metatableRef);
+		luaL_unref(luaState, LUA_REGISTRYINDEX, methodsRef);
+		luaL_unref(luaState, LUA_REGISTRYINDEX, gettersRef);
+		luaL_unref(luaState, LUA_REGISTRYINDEX, settersRef);
+	}
+
+	bool LuaClassBase::IsValid() const
+	{
+		return owner
+			&& owner->IsInitialized()
+			&& owner->stateGeneration == ownerGeneration;
+	}
+
+	void LuaClassBase::_AddMethod(
+		string_view methodName,
+		lua_CFunction trampoline)
+	{
+		if (!_CanAdd(methodName, "method")) return;
+
+		lua_State* luaState = owner->GetLuaState();
+		LuaLimitScope limitScope(luaState, false);
+
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, methodsRef);
+
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, metatableRef);
+		lua_pushcclosure(luaState, trampoline, 1);
+		LuaProfiler::NameFunction(luaState, -1, classPath + ":" + string(methodName));
+		lua_setfield(luaState, -2, string(methodName).c_str());
+
+		lua_pop(luaState, 1);
+	}
+
+	void LuaClassBase::_AddProperty(
+		string_view propertyName,
+		lua_CFunction getter,
+		lua_CFunction setter)
+	{
+		if (!_CanAdd(propertyName, "property")) return;
+
+		lua_State* luaState = owner->GetLuaState();
+		LuaLimitScope limitScope(luaState, false);
+
+		if (gettersRef == NO_REF) _CreatePropertyTables(luaState);
+
+		const string name(propertyName);
+
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, gettersRef);
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, metatableRef);
+		lua_pushcclosure(luaState, getter, 1);
+		lua_setfield(luaState, -2, name.c_str());
+		lua_pop(luaState, 1);
+
+		//read-only properties have no setter, so __newindex raises an error for them
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, settersRef);
+		if (setter)
+		{
+			lua_rawgeti(luaState, LUA_REGISTRYINDEX, metatableRef);
+			lua_pushcclosure(luaState, setter, 1);
+		}
+		else lua_pushnil(luaState);
+		lua_setfield(luaState, -2, name.c_str());
+		lua_pop(luaState, 1);
+	}
+
+	void LuaClassBase::_AddConstructor(lua_CFunction constructor)
+	{
+		if (!_CanAdd("new", "constructor")) return;
+
+		//the class table is a namespace that holds 'new'
+		lua_State* registerState = owner->_BeginRegister(
+			"new",
+			classPath);
+
+		if (!registerState) return;
+
+		lua_pushcfunction(registerState, constructor);
+
+		owner->_EndRegister(
+			"new",
+			classPath);
+	}
+
+	bool LuaClassBase::_CanAdd(
+		string_view memberName,
+		string_view memberType) const
+	{
+		if (!IsValid())
+		{
+			Log::Print(
+				"Failed to add " + string(memberType) + " '" + string(memberName) + "' because its class is not bound to an initialized Lua state!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (memberName.empty()
+			|| memberName.size() > 50)
+		{
+			Log::Print(
+				"Failed to add " + string(memberType) + " to class '" + classPath + "' because name was empty or too long.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	void LuaClassBase::_CreatePropertyTables(lua_State* luaState)
+	{
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, metatableRef);
+
+		lua_rawgeti(luaState, LUA_REGISTRYINDEX, methodsRef);
+		lua_newtable(luaState);
+		lua_pushvalue(luaState, -1);
+		gettersRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		lua_pushcclosure(luaState, _Index, 2);
+		lua_setfield(luaState, -2, "__index");
+
+		lua_newtable(luaState);
+		lua_pushvalue(luaState, -1);
+		settersRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		lua_pushcclosure(luaState, _NewIndex, 1);
+		lua_setfield(luaState, -2, "__newindex");
+
+		lua_pop(luaState, 1);
+	}
+
+	int LuaClassBase::_Index(lua_State* luaState)
+	{
+		//methods first, they are looked up far more often than properties
+		lua_pushvalue(luaState, 2);
+		if (lua_rawget(luaState, lua_upvalueindex(1)) != LUA_TNIL) return 1;
+
+		lua_pushvalue(luaState, 2);
+		if (lua_rawget(luaState, lua_upvalueindex(2)) != LUA_TFUNCTION) return 1;
+
+		lua_pushvalue(luaState, 1);
+		lua_call(luaState, 1, 1);
+
+		return 1;
+	}
+
+	int LuaClassBase::_NewIndex(lua_State* luaState)
+	{
+		lua_pushvalue(luaState, 2);
+		if (lua_rawget(luaState, lua_upvalueindex(1)) != LUA_TFUNCTION)
+		{
+			return luaL_error(
+				luaState,
+				"KALALUA ERROR: Property '%s' does not exist or is read-only!",
+				luaL_tolstring(luaState, 2, nullptr));
+		}
+
+		lua_pushvalue(luaState, 1);
+		lua_pushvalue(luaState, 3);
+		lua_call(luaState, 2, 0);
+
+		return 0;
+	}
+}
@@ -3,861 +3,14 @@
 //This is free software, and you are welcome to redistribute it under certain conditions.
 //Read LICENSE.md for more information.
 
-#include <filesystem>
-#include <vector>
-#include <functional>
-
-extern "C"
-{
-#include "lua.h"
-#include "lauxlib.h"
-#include "lualib.h"
-}
-
-#include "core_utils.hpp"
-#include "log_utils.hpp"
-#include "string_utils.hpp"
-
 #include "core/kl_lua.hpp"
-#include "core/kl_core.hpp"
-
-using KalaHeaders::KalaCore::ContainsValue;
-using KalaHeaders::KalaCore::RemoveDuplicates;
-
-using KalaHeaders::KalaLog::Log;
-using KalaHeaders::KalaLog::LogType;
-
-using KalaHeaders::KalaString::SplitString;
-
-using KalaLua::Core::LuaVar;
-using KalaLua::Core::KalaLuaCore;
-
-using std::string;
-using std::string_view;
-using std::to_string;
-using std::filesystem::path;
-using std::filesystem::exists;
-using std::filesystem::is_regular_file;
-using std::vector;
-using std::function;
-using std::visit;
-using std::decay_t;
-using std::is_same_v;
-using std::optional;
-
-static int LuaPanic(lua_State* state);
-
-static int LuaFunctionTrampolineArgs(lua_State* state);
-static int LuaFunctionTrampolineCustom(lua_State* state);
-
-static vector<function<optional<LuaVar>(const vector<LuaVar>&)>*> loadedArgFunctions{};
-static vector<function<int(lua_State*)>*> loadedCustomFunctions{};
 
 namespace KalaLua::Core
 {
-	static bool isInitialized{};
-	static lua_State* state{};
-
-	bool Lua::Initialize(const vector<LuaLibrary>& libs)
-	{
-		if (isInitialized)
-		{
-			Log::Print(
-				"Failed to initialize KalaLua because its already initialized!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		state = luaL_newstate();
-		if (!state)
-		{
-			Log::Print(
-				"Failed to initialize KalaLua because its state couldn't be created!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		auto added_lib = [](string_view libName) -> void
-			{
-				Log::Print(
-					"Added Lua library '" + string(libName) + "'!",
-					"KALALUA",
-					LogType::LOG_INFO);
-			};
-
-		if (ContainsValue(libs, LuaLibrary::LUA_ALL))
-		{
-			luaL_openlibs(state);
-
-			Log::Print(
-				"Added all Lua libraries!",
-				"KALALUA",
-				LogType::LOG_INFO);
-		}
-		else
-		{
-			vector<LuaLibrary> realLibs = libs;
-			RemoveDuplicates(realLibs);
-
-			luaL_requiref(state, LUA_GNAME, luaopen_base, 1); lua_pop(state, 1);
-
-			added_lib("base");
-
-			for (const auto& l : realLibs)
-			{
-				switch (l)
-				{
-					case LuaLibrary::LUA_COROUTINE:
-						luaL_requiref(state, LUA_COLIBNAME, luaopen_coroutine, 1);
-						lua_pop(state, 1);
-						added_lib("coroutine");
-						break;
-					case LuaLibrary::LUA_TABLE:
-						luaL_requiref(state, LUA_TABLIBNAME, luaopen_table, 1);
-						lua_pop(state, 1);
-						added_lib("table");
-						break;
-					case LuaLibrary::LUA_STRING:
-						luaL_requiref(state, LUA_STRLIBNAME, luaopen_string, 1);
-						lua_pop(state, 1);
-						added_lib("string");
-						break;
-					case LuaLibrary::LUA_MATH:
-						luaL_requiref(state, LUA_MATHLIBNAME, luaopen_math, 1);
-						lua_pop(state, 1);
-						added_lib("math");
-						break;
-					case LuaLibrary::LUA_UTF8:
-						luaL_requiref(state, LUA_UTF8LIBNAME, luaopen_utf8, 1);
-						lua_pop(state, 1);
-						added_lib("utf8");
-						break;
-					case LuaLibrary::LUA_PACKAGE:
-						luaL_requiref(state, LUA_LOADLIBNAME, luaopen_package, 1);
-						lua_pop(state, 1);
-						added_lib("package");
-						break;
-					case LuaLibrary::LUA_IO:
-						luaL_requiref(state, LUA_IOLIBNAME, luaopen_io, 1);
-						lua_pop(state, 1);
-						added_lib("io");
-						break;
-					case LuaLibrary::LUA_OS:
-						luaL_requiref(state, LUA_OSLIBNAME, luaopen_os, 1);
-						lua_pop(state, 1);
-						added_lib("os");
-						break;
-					case LuaLibrary::LUA_DEBUG:
-						luaL_requiref(state, LUA_DBLIBNAME, luaopen_debug, 1);
-						lua_pop(state, 1);
-						added_lib("debug");
-						break;
-
-					default: break;
-				}
-			}
-		}
-
-		lua_atpanic(state, LuaPanic);
-
-		isInitialized = true;
-
-		Log::Print(
-			"Finished initializing KalaLua!",
-			"KALALUA",
-			LogType::LOG_SUCCESS);
-
-		return true;
-	}
-
-	bool Lua::IsInitialized() { return isInitialized; };
-
-	lua_State* Lua::GetLuaState() { return isInitialized ? state : nullptr; }
-
-	bool Lua::LoadScript(string_view script)
+	LuaState& Lua::GetDefaultState()
 	{
-		if (!isInitialized)
-		{
-			Log::Print(
-				"Failed to load script '" + string(script) + "' because KalaLua is not initialized!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (!state)
-		{
-			Log::Print(
-				"Failed to load script '" + string(script) + "' because KalaLua state is invalid!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (!exists(script))
-		{
-			Log::Print(
-				"Failed to load script '" + string(script) + "' because it does not exist!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (!is_regular_file(script))
-		{
-			Log::Print(
-				"Failed to load script '" + string(script) + "' because it is not a regular file!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (path(script).extension() != ".lua")
-		{
-			Log::Print(
-				"Failed to load script '" + string(script) + "' because its extension is incorrect!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
+		static LuaState defaultState{};
 
-		//load (compile) the script
-
-		int status = luaL_loadfile(state, string(script).c_str());
-		if (status != LUA_OK)
-		{
-			const char* err = lua_tostring(state, -1);
-			string errValue = err ? err : "Unknown error.";
-
-			Log::Print(
-				"Lua load error in script '" + string(script) + "': " + errValue,
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			lua_pop(state, 1);
-
-			return false;
-		}
-
-		//execute the script
-
-		status = lua_pcall(
-			state,
-			0,
-			LUA_MULTRET,
-			0);
-		if (status != LUA_OK)
-		{
-			const char* err = lua_tostring(state, -1);
-			string errValue = err ? err : "Unknown error.";
-
-			Log::Print(
-				"Lua runtime error in script '" + string(script) + "': " + errValue,
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			lua_pop(state, 1);
-
-			return false;
-		}
-
-		Log::Print(
-			"Loaded script '" + string(script) + "'!",
-			"KALALUA",
-			LogType::LOG_SUCCESS);
-
-		return true;
+		return defaultState;
 	}
-
-	bool Lua::_CallFunction(
-		string_view functionName,
-		string_view functionNamespace,
-		const vector<LuaVar>& args,
-		LuaVar* outReturn)
-	{
-		if (!isInitialized)
-		{
-			Log::Print(
-				"Failed to call function because KalaLua is not initialized!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (!state)
-		{
-			Log::Print(
-				"Failed to call function because KalaLua state is invalid!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (functionName.empty())
-		{
-			Log::Print(
-				"Failed to call function because name was empty!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (functionNamespace.empty())
-		{
-			lua_pushglobaltable(state);
-		}
-		else if (functionNamespace.find('.') == string::npos)
-		{
-			lua_getglobal(state, string(functionNamespace).c_str());
-
-			if (!lua_istable(state, -1))
-			{
-				lua_pop(state, 1);
-
-				Log::Print(
-					"Lua namespace '" + string(functionNamespace) + "' does not exist!",
-					"KALALUA",
-					LogType::LOG_ERROR,
-					2);
-
-				return false;
-			}
-		}
-		else
-		{
-			const vector<string> parts = SplitString(functionNamespace, ".");
-
-			lua_pushglobaltable(state);
-
-			for (const auto& p : parts)
-			{
-				lua_getfield(state, -1, p.c_str());
-				lua_remove(state, -2);
-
-				if (lua_isnil(state, -1))
-				{
-					lua_pop(state, 1);
-
-					Log::Print(
-						"Lua namespace '" + string(functionNamespace) + "' does not exist!",
-						"KALALUA",
-						LogType::LOG_ERROR,
-						2);
-
-					return false;
-				}
-			}
-		}
-
-		//fetch function from resolved namespace
-		lua_getfield(state, -1, string(functionName).c_str());
-		lua_remove(state, -2);
-
-		if (!lua_isfunction(state, -1))
-		{
-			lua_pop(state, 1);
-
-			Log::Print(
-				"Lua function '" + string(functionName) + "' does not exist!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		//push arguments
-		for (const LuaVar& v : args)
-		{
-			visit([](auto&& value)
-				{
-					using T = decay_t<decltype(value)>;
-
-					if constexpr (is_same_v<T, int>)         lua_pushinteger(state, value);
-					else if constexpr (is_same_v<T, float>)  lua_pushnumber(state, value);
-					else if constexpr (is_same_v<T, double>) lua_pushnumber(state, value);
-					else if constexpr (is_same_v<T, bool>)   lua_pushboolean(state, value);
-					else if constexpr (is_same_v<T, string>) lua_pushstring(state, value.c_str());
-				}, v);
-
-		}
-
-		int status = lua_pcall(
-			state,
-			scast<int>(args.size()),
-			outReturn ? 1 : 0, //allow one return from lua if outReturn is assigned
-			0);
-
-		if (status != LUA_OK)
-		{
-			const char* err = lua_tostring(state, -1);
-			string errValue = err ? err : "Unknown error";
-
-			Log::Print(
-				"Lua runtime error with function '" + string(functionName) + "': " + errValue,
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			lua_pop(state, 1);
-
-			return false;
-		}
-
-		if (outReturn)
-		{
-			if (lua_gettop(state) != 1)
-			{
-				Log::Print(
-					"Lua function '" + string(functionName) + "' returned multiple values!",
-					"KALALUA",
-					LogType::LOG_ERROR,
-					2);
-
-				lua_settop(state, 0);
-				return false;
-			}
-
-			int type = lua_type(state, -1);
-
-			switch (type)
-			{
-			case LUA_TNUMBER:
-			{
-				lua_Number n = lua_tonumber(state, -1);
-
-				//preserve integer if possible
-				if (lua_isinteger(state, -1)) *outReturn = scast<int>(n);
-				else *outReturn = scast<double>(n);
-
-				break;
-			}
-			case LUA_TBOOLEAN:
-				*outReturn = scast<bool>(lua_toboolean(state, -1));
-				break;
-			case LUA_TSTRING:
-				*outReturn = string(lua_tostring(state, -1));
-				break;
-			case LUA_TNIL:
-				//lua returned nil - we do nothing with that here
-				break;
-			default:
-				Log::Print(
-					"Unsupported Lua return type from function '" + string(functionName) + "'!",
-					"KALALUA",
-					LogType::LOG_ERROR,
-					2);
-
-				lua_pop(state, 1);
-				return false;
-			}
-
-			lua_pop(state, 1);
-		}
-
-		if (functionNamespace.empty())
-		{
-			Log::Print(
-				"Called global function '" 
-				+ string(functionName) + "' with '" 
-				+ to_string(args.size()) + "' args.",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-		else
-		{
-			Log::Print(
-				"Called function '" 
-				+ string(functionName) + "' in namespace '" 
-				+ string(functionNamespace) + "' with '" 
-				+ to_string(args.size()) + "' args.",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-
-		return true;
-	}
-
-	void Lua::RegisterFunction(
-		string_view functionName,
-		string_view functionNamespace,
-		const function<int(lua_State*)>& targetFunction)
-	{
-		if (!isInitialized)
-		{
-			Log::Print(
-				"Failed to register function because KalaLua is not initialized!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return;
-		}
-
-		if (!state)
-		{
-			Log::Print(
-				"Failed to register function because KalaLua state is invalid!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return;
-		}
-
-		if (functionName.empty()
-			|| functionName.size() > 50)
-		{
-			Log::Print(
-				"Failed to register function because name was empty or too long.",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return;
-		}
-		if (functionNamespace.size() > 50)
-		{
-			Log::Print(
-				"Failed to register function '" + string(functionName) + "' because namespace was too long.",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return;
-		}
-		if (!targetFunction)
-		{
-			Log::Print(
-				"Failed to register function '" + string(functionName) + "' because target function was empty.",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return;
-		}
-
-		//no namespace
-		if (functionNamespace.empty())
-		{
-			lua_pushglobaltable(state);
-		}
-		//namespace has no dots
-		else if (functionNamespace.find('.') == string::npos)
-		{
-			lua_getglobal(state, string(functionNamespace).c_str());
-
-			if (!lua_istable(state, -1))
-			{
-				lua_pop(state, 1);
-				lua_newtable(state);
-				lua_pushvalue(state, -1);
-				lua_setglobal(state, string(functionNamespace).c_str());
-			}
-		}
-		//namespace has dots
-		else
-		{
-			const vector<string> parts = SplitString(functionNamespace, ".");
-
-			lua_pushglobaltable(state);
-
-			for (const auto& p : parts)
-			{
-				lua_getfield(state, -1, p.c_str());
-
-				if (!lua_istable(state, -1))
-				{
-					lua_pop(state, 1);
-					lua_newtable(state);
-					lua_pushvalue(state, -1);
-					lua_setfield(state, -3, p.c_str());
-				}
-
-				//remove parent table
-				lua_remove(state, -2);
-			}
-		}
-
-		auto* storedf = new function<int(lua_State*)>(targetFunction);
-		loadedCustomFunctions.push_back(storedf);
-
-		//push user data (upvalue)
-		lua_pushlightuserdata(state, storedf);
-
-		//create closure with 1 upvalue
-		lua_pushcclosure(state, LuaFunctionTrampolineCustom, 1);
-
-		//set global function name
-		lua_setfield(state, -2, string(functionName).c_str());
-
-		//pop namespace table
-		lua_pop(state, 1);
-
-		if (!functionNamespace.empty())
-		{
-			Log::Print(
-				"Registered function '" + string(functionName) + "' to namespace '" + string(functionNamespace) + "'!",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-		else
-		{
-			Log::Print(
-				"Registered function '" + string(functionName) + "' to global namespace!",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-	}
-
-	bool Lua::_RegisterFunction(
-		string_view functionName,
-		string_view functionNamespace,
-		function<optional<LuaVar>(const vector<LuaVar>&)> invoker)
-	{
-		if (!isInitialized)
-		{
-			Log::Print(
-				"Failed to register function because KalaLua is not initialized!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-		
-		if (!state)
-		{
-			Log::Print(
-				"Failed to register function because KalaLua state is invalid!",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		if (functionName.empty()
-			|| functionName.size() > 50)
-		{
-			Log::Print(
-				"Failed to register function because name was empty or too long.",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-		if (functionNamespace.size() > 50)
-		{
-			Log::Print(
-				"Failed to register function '" + string(functionName) + "' because namespace was too long.",
-				"KALALUA",
-				LogType::LOG_ERROR,
-				2);
-
-			return false;
-		}
-
-		//no namespace
-		if (functionNamespace.empty())
-		{
-			lua_pushglobaltable(state);
-		}
-		//namespace has no dots
-		else if (functionNamespace.find('.') == string::npos)
-		{
-			lua_getglobal(state, string(functionNamespace).c_str());
-
-			if (!lua_istable(state, -1))
-			{
-				lua_pop(state, 1);
-				lua_newtable(state);
-				lua_pushvalue(state, -1);
-				lua_setglobal(state, string(functionNamespace).c_str());
-			}
-		}
-		//namespace has dots
-		else
-		{
-			const vector<string> parts = SplitString(functionNamespace, ".");
-
-			lua_pushglobaltable(state);
-
-			for (const auto& p : parts)
-			{
-				lua_getfield(state, -1, p.c_str());
-
-				if (!lua_istable(state, -1))
-				{
-					lua_pop(state, 1);
-					lua_newtable(state);
-					lua_pushvalue(state, -1);
-					lua_setfield(state, -3, p.c_str());
-				}
-
-				//remove parent table
-				lua_remove(state, -2);
-			}
-		}
-
-		auto* storedf = new function<optional<LuaVar>(const vector<LuaVar>&)>(std::move(invoker));
-		loadedArgFunctions.push_back(storedf);
-
-		//push user data (upvalue)
-		lua_pushlightuserdata(state, storedf);
-
-		//create closure with 1 upvalue
-		lua_pushcclosure(state, LuaFunctionTrampolineArgs, 1);
-
-		//set global function name
-		lua_setfield(state, -2, string(functionName).c_str());
-
-		//pop namespace table
-		lua_pop(state, 1);
-
-		if (!functionNamespace.empty())
-		{
-			Log::Print(
-				"Registered function '" + string(functionName) + "' to namespace '" + string(functionNamespace) + "'!",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-		else
-		{
-			Log::Print(
-				"Registered function '" + string(functionName) + "' to global namespace!",
-				"KALALUA",
-				LogType::LOG_SUCCESS);
-		}
-
-		return true;
-	}
-
-	void Lua::Shutdown()
-	{
-		if (!isInitialized) return;
-
-		Log::Print(
-			"Shutting down KalaLua.",
-			"KALALUA",
-			LogType::LOG_INFO);
-
-		for (auto* f : loadedArgFunctions) delete f;
-		loadedArgFunctions.clear();
-
-		for (auto* f : loadedCustomFunctions) delete f;
-		loadedCustomFunctions.clear();
-
-		lua_close(state);
-		state = nullptr;
-		isInitialized = false;
-	}
-}
-
-int LuaPanic(lua_State* state)
-{
-	const char* msg = lua_tostring(state, -1);
-
-	KalaLuaCore::ForceClose(
-		"KalaLua error",
-		msg ? msg : "Unknown lua panic.");
-
-	return 0;
 }
-
-int LuaFunctionTrampolineArgs(lua_State* state)
-{
-	auto* f = scast<function<optional<LuaVar>(const vector<LuaVar>&)>*>(
-		lua_touserdata(state, lua_upvalueindex(1)));
-
-	if (!f)
-	{
-		return luaL_error(
-			state,
-			"KALALUA ERROR: User passed function whose target action was invalid!");
-	}
-
-	const int argc = lua_gettop(state);
-	vector<LuaVar> args{};
-	args.reserve(argc);
-
-	for (int i = 1; i <= argc; ++i)
-	{
-		switch (lua_type(state, i))
-		{
-		case LUA_TNUMBER:
-			args.emplace_back(scast<double>(lua_tonumber(state, i)));
-			break;
-		case LUA_TBOOLEAN:
-			args.emplace_back(scast<bool>(lua_toboolean(state, i)));
-			break;
-		case LUA_TSTRING:
-			args.emplace_back(string(lua_tostring(state, i)));
-			break;
-		default:
-			return luaL_error(
-				state,
-				"KALALUA ERROR: User passed unsupported types to registered function!");
-		}
-	}
-
-	//call the function
-	auto ret = (*f)(args);
-
-	if (!ret.has_value()) return 0;
-	
-	//push LuaVar return
-	visit([state](auto&& value)
-		{
-			using T = decay_t<decltype(value)>;
-
-			if constexpr      (is_same_v<T, int>)    lua_pushinteger(state, value);
-			else if constexpr (is_same_v<T, float>)  lua_pushnumber(state, value);
-			else if constexpr (is_same_v<T, double>) lua_pushnumber(state, value);
-			else if constexpr (is_same_v<T, bool>)   lua_pushboolean(state, value);
-			else if constexpr (is_same_v<T, string>) lua_pushstring(state, value.c_str());
-		}, *ret);
-
-	//lua consumes one return value
-	return 1;
-}
-
-int LuaFunctionTrampolineCustom(lua_State* state)
-{
-	auto* f = scast<function<int(lua_State*)>*>(lua_touserdata(state, lua_upvalueindex(1)));
-
-	if (!f)
-	{
-		return luaL_error(
-			state,
-			"KALALUA ERROR: User-defined function has no target function!");
-	}
-
-	//call the function
-	return (*f)(state);
-}
\ No newline at end of file
@@ -0,0 +1,177 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <cstdio>
+
+#include "core_utils.hpp"
+
+#include "core/kl_metrics.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::sort;
+using std::lock_guard;
+using std::move;
+using std::snprintf;
+
+namespace KalaLua::Core
+{
+	u64 LuaFunctionMetricsSnapshot::GetPercentileNanoseconds(double percentile) const
+	{
+		if (calls == 0) return 0;
+
+		//the call the percentile lands on, counted from 1
+		u64 target = scast<u64>(percentile / 100.0 * scast<double>(calls));
+		if (target == 0) target = 1;
+		if (target > calls) target = calls;
+
+		u64 seen{};
+		for (u32 i = 0; i < LUA_LATENCY_BUCKETS; ++i)
+		{
+			seen += latencyBuckets[i];
+			if (seen >= target) return i == 0 ? 0 : (1ull << i) - 1;
+		}
+
+		return maxNanoseconds;
+	}
+
+	LuaFunctionMetricsSnapshot LuaFunctionMetrics::_GetSnapshot() const
+	{
+		LuaFunctionMetricsSnapshot result{};
+		result.name = name;
+		result.source = source;
+
+		//counters are read one by one, so a snapshot taken mid-call can be off by that call
+		result.calls = calls.load(memory_order_relaxed);
+		result.errors = errors.load(memory_order_relaxed);
+		result.totalNanoseconds = totalNanoseconds.load(memory_order_relaxed);
+		result.maxNanoseconds = maxNanoseconds.load(memory_order_relaxed);
+
+		for (u32 i = 0; i < LUA_LATENCY_BUCKETS; ++i)
+		{
+			result.latencyBuckets[i] = latencyBuckets[i].load(memory_order_relaxed);
+		}
+
+		return result;
+	}
+
+	void LuaFunctionMetrics::_Reset()
+	{
+		calls.store(0, memory_order_relaxed);
+		errors.store(0, memory_order_relaxed);
+		totalNanoseconds.store(0, memory_order_relaxed);
+		maxNanoseconds.store(0, memory_order_relaxed);
+
+		for (atomic<u64>& bucket : latencyBuckets) bucket.store(0, memory_order_relaxed);
+	}
+
+	bool LuaMetrics::GetSnapshot(
+		string_view name,
+		LuaMetricsSource source,
+		LuaFunctionMetricsSnapshot& outSnapshot) const
+	{
+		lock_guard lock(entriesMutex);
+
+		const EntryMap& entries = source == LuaMetricsSource::LUA_FUNCTION
+			? luaFunctions
+			: registeredFunctions;
+
+		auto it = entries.find(name);
+		if (it == entries.end()) return false;
+
+		outSnapshot = it->second->_GetSnapshot();
+		return true;
+	}
+
+	vector<LuaFunctionMetricsSnapshot> LuaMetrics::GetSnapshots() const
+	{
+		vector<LuaFunctionMetricsSnapshot> result{};
+
+		{
+			lock_guard lock(entriesMutex);
+
+			result.reserve(luaFunctions.size() + registeredFunctions.size());
+
+			for (const auto& [name, entry] : luaFunctions) result.push_back(entry->_GetSnapshot());
+			for (const auto& [name, entry] : registeredFunctions) result.push_back(entry->_GetSnapshot());
+		}
+
+		sort(result.begin(), result.end(), [](const LuaFunctionMetricsSnapshot& a, const LuaFunctionMetricsSnapshot& b)
+			{
+				if (a.name != b.name) return a.name < b.name;
+				return a.source < b.source;
+			});
+
+		return result;
+	}
+
+	string LuaMetrics::ExportText() const
+	{
+		string result = "#source name calls errors total_ns mean_ns p50_ns p99_ns max_ns\n";
+
+		for (const LuaFunctionMetricsSnapshot& snapshot : GetSnapshots())
+		{
+			char line[128]{};
+			snprintf(line, sizeof(line),
+				" %llu %llu %llu %llu %llu %llu %llu\n",
+				scast<unsigned long long>(snapshot.calls),
+				scast<unsigned long long>(snapshot.errors),
+				scast<unsigned long long>(snapshot.totalNanoseconds),
+				scast<unsigned long long>(snapshot.GetMeanNanoseconds()),
+				scast<unsigned long long>(snapshot.GetPercentileNanoseconds(50.0)),
+				scast<unsigned long long>(snapshot.GetPercentileNanoseconds(99.0)),
+				scast<unsigned long long>(snapshot.maxNanoseconds));
+
+			result += snapshot.source == LuaMetricsSource::LUA_FUNCTION ? "lua " : "cpp ";
+			result += snapshot.name;
+			result += line;
+		}
+
+		return result;
+	}
+
+	void LuaMetrics::Reset()
+	{
+		lock_guard lock(entriesMutex);
+
+		for (auto& [name, entry] : luaFunctions) entry->_Reset();
+		for (auto& [name, entry] : registeredFunctions) entry->_Reset();
+	}
+
+	LuaFunctionMetrics* LuaMetrics::_GetEntry(
+		string_view functionName,
+		string_view functionNamespace,
+		LuaMetricsSource source)
+	{
+		EntryMap& entries = source == LuaMetricsSource::LUA_FUNCTION
+			? luaFunctions
+			: registeredFunctions;
+
+		nameBuffer.assign(functionNamespace);
+		if (!nameBuffer.empty()) nameBuffer += '.';
+		nameBuffer += functionName;
+
+		//only this thread inserts, so finding without the lock is safe
+		auto it = entries.find(string_view(nameBuffer));
+		if (it != entries.end()) return it->second.get();
+
+		lock_guard lock(entriesMutex);
+
+		unique_ptr<LuaFunctionMetrics> entry(new LuaFunctionMetrics(
+			nameBuffer,
+			source,
+			isEnabled));
+
+		LuaFunctionMetrics* result = entry.get();
+		entries.emplace(nameBuffer, move(entry));
+
+		return result;
+	}
+}
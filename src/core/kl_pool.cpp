@@ -0,0 +1,313 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <chrono>
+#include <thread>
+#include <latch>
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_pool.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::to_string;
+using std::vector;
+using std::unique_ptr;
+using std::make_unique;
+using std::thread;
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::latch;
+using std::atomic;
+using std::memory_order_relaxed;
+using std::move;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+namespace KalaLua::Core
+{
+	//the pool and worker the current thread belongs to, lets jobs that submit
+	//more jobs keep them on their own worker's queue
+	static thread_local const LuaStatePool* currentPool{};
+	static thread_local u32 currentWorker{};
+
+	static u64 NowNanoseconds()
+	{
+		return scast<u64>(duration_cast<nanoseconds>(
+			steady_clock::now().time_since_epoch()).count());
+	}
+
+	LuaStatePool::~LuaStatePool()
+	{
+		Shutdown();
+	}
+
+	bool LuaStatePool::Initialize(const LuaPoolConfig& newConfig)
+	{
+		if (isInitialized)
+		{
+			Log::Print(
+				"Failed to initialize Lua state pool because its already initialized!",
+				"KALALUA_POOL",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		config = newConfig;
+
+		u32 workerCount = config.workerCount;
+		if (workerCount == 0) workerCount = thread::hardware_concurrency();
+		if (workerCount == 0) workerCount = 1;
+
+		isStopping = false;
+		pendingJobs = 0;
+		nextWorker = 0;
+		statsStartNanoseconds = NowNanoseconds();
+
+		workers.clear();
+		workers.reserve(workerCount);
+		for (u32 i = 0; i < workerCount; ++i) workers.push_back(make_unique<Worker>());
+
+		atomic<bool> setupFailed{};
+		latch setupDone(workerCount);
+
+		for (u32 i = 0; i < workerCount; ++i)
+		{
+			workers[i]->workerThread = thread(
+				&LuaStatePool::WorkerLoop,
+				this,
+				i,
+				&setupFailed,
+				&setupDone);
+		}
+
+		setupDone.wait();
+
+		//workers can only start taking jobs once the pool counts as initialized
+		isInitialized = true;
+
+		if (setupFailed)
+		{
+			Log::Print(
+				"Failed to initialize Lua state pool because a worker state failed to set up!",
+				"KALALUA_POOL",
+				LogType::LOG_ERROR,
+				2);
+
+			Shutdown();
+			return false;
+		}
+
+		Log::Print(
+			"Finished initializing Lua state pool with '" + to_string(workerCount) + "' workers!",
+			"KALALUA_POOL",
+			LogType::LOG_SUCCESS);
+
+		return true;
+	}
+
+	void LuaStatePool::WorkerLoop(
+		u32 workerIndex,
+		atomic<bool>* setupFailed,
+		latch* setupDone)
+	{
+		currentPool = this;
+		currentWorker = workerIndex;
+
+		//the state is created, used and closed on this thread only
+		LuaState state{};
+
+		//every worker shares the cache directory, entries are written atomically
+		bool isSetUp =
+			state.SetAllocator(config.allocator)
+			&& state.SetBytecodeCache(
+				config.bytecodeCacheDirectory,
+				config.stripBytecodeDebugInfo)
+			&& state.Initialize(config.libraries);
+
+		for (const auto& script : config.scripts)
+		{
+			if (!isSetUp) break;
+			isSetUp = state.LoadScript(script);
+		}
+
+		if (isSetUp
+			&& config.onWorkerSetup)
+		{
+			isSetUp = config.onWorkerSetup(state);
+		}
+
+		if (!isSetUp) *setupFailed = true;
+		setupDone->count_down();
+
+		Worker& worker = *workers[workerIndex];
+
+		while (true)
+		{
+			unique_ptr<LuaPoolJob> job = TakeJob(workerIndex);
+
+			if (!job)
+			{
+				unique_lock lock(sleepMutex);
+				sleepCondition.wait(lock, [this]
+					{
+						return pendingJobs.load() > 0
+							|| isStopping.load();
+					});
+
+				//finish every queued job before stopping
+				if (isStopping
+					&& pendingJobs.load() == 0)
+				{
+					break;
+				}
+
+				continue;
+			}
+
+			u64 start = NowNanoseconds();
+
+			job->Run(state);
+			job.reset();
+
+			worker.busyNanoseconds.fetch_add(NowNanoseconds() - start, memory_order_relaxed);
+			worker.jobsExecuted.fetch_add(1, memory_order_relaxed);
+		}
+
+		currentPool = nullptr;
+	}
+
+	void LuaStatePool::Enqueue(unique_ptr<LuaPoolJob> job)
+	{
+		u32 workerIndex = currentPool == this
+			? currentWorker
+			: nextWorker.fetch_add(1, memory_order_relaxed) % GetWorkerCount();
+
+		//counted before the job is visible, so a worker that takes it right away
+		//can never decrement first and wrap the count around,
+		//taking the sleep lock orders this with a worker that is about to sleep
+		{
+			lock_guard lock(sleepMutex);
+			pendingJobs.fetch_add(1);
+		}
+
+		Worker& worker = *workers[workerIndex];
+		{
+			lock_guard lock(worker.queueMutex);
+			worker.queue.push_back(move(job));
+		}
+
+		sleepCondition.notify_one();
+	}
+
+	unique_ptr<LuaStatePool::LuaPoolJob> LuaStatePool::TakeJob(u32 workerIndex)
+	{
+		const u32 workerCount = GetWorkerCount();
+
+		//own queue first, oldest job first
+		{
+			Worker& worker = *workers[workerIndex];
+			lock_guard lock(worker.queueMutex);
+
+			if (!worker.queue.empty())
+			{
+				unique_ptr<LuaPoolJob> job = move(worker.queue.front());
+				worker.queue.pop_front();
+				pendingJobs.fetch_sub(1);
+
+				return job;
+			}
+		}
+
+		//then steal the newest job of the next busy worker
+		for (u32 i = 1; i < workerCount; ++i)
+		{
+			Worker& victim = *workers[(workerIndex + i) % workerCount];
+			lock_guard lock(victim.queueMutex);
+
+			if (!victim.queue.empty())
+			{
+				unique_ptr<LuaPoolJob> job = move(victim.queue.back());
+				victim.queue.pop_back();
+				pendingJobs.fetch_sub(1);
+
+				workers[workerIndex]->jobsStolen.fetch_add(1, memory_order_relaxed);
+
+				return job;
+			}
+		}
+
+		return nullptr;
+	}
+
+	vector<LuaWorkerStats> LuaStatePool::GetWorkerStats() const
+	{
+		vector<LuaWorkerStats> stats{};
+		stats.reserve(workers.size());
+
+		u64 elapsed = NowNanoseconds() - statsStartNanoseconds.load();
+
+		for (const auto& worker : workers)
+		{
+			LuaWorkerStats s{};
+			s.jobsExecuted = worker->jobsExecuted.load(memory_order_relaxed);
+			s.jobsStolen = worker->jobsStolen.load(memory_order_relaxed);
+			s.busyNanoseconds = worker->busyNanoseconds.load(memory_order_relaxed);
+			s.elapsedNanoseconds = elapsed;
+			s.utilization = elapsed > 0
+				? scast<double>(s.busyNanoseconds) / scast<double>(elapsed)
+				: 0.0;
+
+			stats.push_back(s);
+		}
+
+		return stats;
+	}
+
+	void LuaStatePool::ResetWorkerStats()
+	{
+		for (auto& worker : workers)
+		{
+			worker->jobsExecuted = 0;
+			worker->jobsStolen = 0;
+			worker->busyNanoseconds = 0;
+		}
+
+		statsStartNanoseconds = NowNanoseconds();
+	}
+
+	void LuaStatePool::Shutdown()
+	{
+		if (workers.empty()) return;
+
+		{
+			lock_guard lock(sleepMutex);
+			isStopping = true;
+		}
+
+		sleepCondition.notify_all();
+
+		for (auto& worker : workers)
+		{
+			if (worker->workerThread.joinable()) worker->workerThread.join();
+		}
+
+		workers.clear();
+		isInitialized = false;
+
+		Log::Print(
+			"Shut down Lua state pool.",
+			"KALALUA_POOL",
+			LogType::LOG_INFO);
+	}
+}
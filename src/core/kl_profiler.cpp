@@ -0,0 +1,389 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_profiler.hpp"
+#include "core/kl_state.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::string_view;
+using std::to_string;
+using std::vector;
+using std::unordered_map;
+using std::pair;
+using std::sort;
+using std::min;
+using std::replace;
+using std::ofstream;
+using std::ios;
+using std::hash;
+using std::move;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+namespace KalaLua::Core
+{
+	//the address of this static keys the weak table of function names in the registry
+	static const char functionNamesKey{};
+
+	static u64 NowNanoseconds()
+	{
+		return scast<u64>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+	}
+
+	size_t LuaProfiler::FrameKeyHash::operator()(const FrameKey& key) const
+	{
+		return hash<const void*>{}(key.pointer) ^ (scast<size_t>(key.line) * 0x9E3779B97F4A7C15ull);
+	}
+
+	bool LuaProfiler::Start(const LuaProfilerConfig& newConfig)
+	{
+		if (!owner.IsInitialized())
+		{
+			Log::Print(
+				"Failed to start profiler because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (newConfig.instructionInterval == 0
+			|| newConfig.maxStackDepth == 0
+			|| (newConfig.mode == LuaProfilerMode::PROFILE_TIME
+			&& newConfig.sampleIntervalMicroseconds == 0))
+		{
+			Log::Print(
+				"Failed to start profiler because an interval or the max stack depth was 0!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		config = newConfig;
+		nextSampleNanoseconds = NowNanoseconds() + scast<u64>(config.sampleIntervalMicroseconds) * 1000;
+		isRunning = true;
+
+		owner._UpdateHook();
+
+		Log::Print(
+			"Started profiler.",
+			"KALALUA",
+			LogType::LOG_INFO);
+
+		return true;
+	}
+
+	void LuaProfiler::Stop()
+	{
+		if (!isRunning) return;
+
+		isRunning = false;
+		owner._UpdateHook();
+
+		Log::Print(
+			"Stopped profiler after " + to_string(stats.samples) + " samples.",
+			"KALALUA",
+			LogType::LOG_INFO);
+	}
+
+	LuaProfilerStats LuaProfiler::GetStats() const
+	{
+		LuaProfilerStats result = stats;
+		result.uniqueFrames = scast<u32>(frameNames.size());
+
+		return result;
+	}
+
+	string LuaProfiler::ExportCollapsedStacks() const
+	{
+		unordered_map<string, u64> stackCounts{};
+
+		string stack{};
+		for (size_t i = 0; i < sampleBuffer.size(); )
+		{
+			u32 depth = sampleBuffer[i];
+			u32 weight = sampleBuffer[i + 1];
+
+			//stored leaf first, collapsed stacks start at the root
+			stack.clear();
+			for (u32 level = depth; level > 0; --level)
+			{
+				if (!stack.empty()) stack += ';';
+				stack += frameNames[sampleBuffer[i + 1 + level]];
+			}
+
+			stackCounts[stack] += weight;
+			i += depth + 2;
+		}
+
+		vector<pair<string, u64>> sorted(stackCounts.begin(), stackCounts.end());
+		sort(sorted.begin(), sorted.end());
+
+		string result{};
+		for (const auto& [frames, count] : sorted)
+		{
+			result += frames;
+			result += ' ';
+			result += to_string(count);
+			result += '\n';
+		}
+
+		return result;
+	}
+
+	bool LuaProfiler::SaveCollapsedStacks(string_view filePath) const
+	{
+		ofstream file(string(filePath), ios::binary | ios::trunc);
+		if (!file)
+		{
+			Log::Print(
+				"Failed to save profile to '" + string(filePath) + "' because it could not be opened!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		file << ExportCollapsedStacks();
+
+		return file.good();
+	}
+
+	void LuaProfiler::Clear()
+	{
+		sampleBuffer.clear();
+		frameNames.clear();
+		frameIds.clear();
+		stats = {};
+	}
+
+	void LuaProfiler::NameFunction(
+		lua_State* luaState,
+		int index,
+		string_view name)
+	{
+		index = lua_absindex(luaState, index);
+
+		if (lua_rawgetp(luaState, LUA_REGISTRYINDEX, &functionNamesKey) != LUA_TTABLE)
+		{
+			lua_pop(luaState, 1);
+
+			//weak keys, a name never keeps its function alive
+			lua_newtable(luaState);
+			lua_createtable(luaState, 0, 1);
+			lua_pushliteral(luaState, "k");
+			lua_setfield(luaState, -2, "__mode");
+			lua_setmetatable(luaState, -2);
+
+			lua_pushvalue(luaState, -1);
+			lua_rawsetp(luaState, LUA_REGISTRYINDEX, &functionNamesKey);
+		}
+
+		lua_pushvalue(luaState, index);
+		lua_pushlstring(luaState, name.data(), name.size());
+		lua_rawset(luaState, -3);
+
+		lua_pop(luaState, 1);
+	}
+
+	void LuaProfiler::_OnHook(lua_State* luaState)
+	{
+		u32 weight = 1;
+
+		if (config.mode == LuaProfilerMode::PROFILE_TIME)
+		{
+			u64 now = NowNanoseconds();
+			if (now < nextSampleNanoseconds) return;
+
+			//a long C++ call or a slow clock check covers several intervals in one sample
+			u64 interval = scast<u64>(config.sampleIntervalMicroseconds) * 1000;
+			weight += scast<u32>(min<u64>((now - nextSampleNanoseconds) / interval, UINT32_MAX - 1));
+
+			nextSampleNanoseconds = now + interval;
+		}
+
+		if (stats.samples + stats.droppedSamples >= config.maxSamples)
+		{
+			++stats.droppedSamples;
+			return;
+		}
+
+		_Sample(luaState, weight);
+	}
+
+	void LuaProfiler::_Sample(
+		lua_State* luaState,
+		u32 weight)
+	{
+		size_t depthIndex = sampleBuffer.size();
+		sampleBuffer.push_back(0);
+		sampleBuffer.push_back(weight);
+
+		lua_Debug debug{};
+		u32 depth{};
+
+		while (lua_getstack(luaState, scast<int>(depth), &debug))
+		{
+			if (depth == config.maxStackDepth)
+			{
+				++stats.truncatedSamples;
+				break;
+			}
+
+			sampleBuffer.push_back(_GetFrameId(luaState, debug));
+			++depth;
+		}
+
+		sampleBuffer[depthIndex] = depth;
+		++stats.samples;
+	}
+
+	u32 LuaProfiler::_GetFrameId(
+		lua_State* luaState,
+		lua_Debug& debug)
+	{
+		//pushes the function of the frame
+		lua_getinfo(luaState, "Sf", &debug);
+
+		bool isCFunction = debug.what[0] == 'C';
+		FrameKey key = isCFunction
+			? FrameKey{ lua_topointer(luaState, -1), -1 }
+			: FrameKey{ debug.source, debug.linedefined };
+
+		auto it = frameIds.find(key);
+		if (it != frameIds.end())
+		{
+			lua_pop(luaState, 1);
+			return it->second;
+		}
+
+		//first time this function is seen, build its name once:
+		//the registered name, then where it is stored globally, then how it was called
+		string name{};
+		bool isRegistered{};
+
+		if (lua_rawgetp(luaState, LUA_REGISTRYINDEX, &functionNamesKey) == LUA_TTABLE)
+		{
+			lua_pushvalue(luaState, -2);
+			if (lua_rawget(luaState, -2) == LUA_TSTRING)
+			{
+				name = lua_tostring(luaState, -1);
+				isRegistered = true;
+			}
+			lua_pop(luaState, 1);
+		}
+		lua_pop(luaState, 1);
+
+		if (name.empty()) _FindGlobalName(luaState, name);
+		lua_pop(luaState, 1);
+
+		if (name.empty())
+		{
+			lua_getinfo(luaState, "n", &debug);
+
+			if (debug.name) name = debug.name;
+			else if (debug.what[0] == 'm') name = "main chunk";
+			else name = "?";
+		}
+
+		if (!isRegistered)
+		{
+			name += isCFunction
+				? " [C]"
+				: " (" + string(debug.short_src) + ":" + to_string(debug.linedefined) + ")";
+		}
+
+		//';' separates frames in collapsed stacks
+		replace(name.begin(), name.end(), ';', ',');
+
+		u32 id = scast<u32>(frameNames.size());
+		frameNames.push_back(move(name));
+		frameIds.emplace(key, id);
+
+		return id;
+	}
+
+	bool LuaProfiler::_FindGlobalName(
+		lua_State* luaState,
+		string& outName)
+	{
+		int function = lua_gettop(luaState);
+
+		lua_pushglobaltable(luaState);
+		int globals = lua_gettop(luaState);
+
+		lua_pushnil(luaState);
+		while (lua_next(luaState, globals))
+		{
+			//only string keys, lua_tostring would turn number keys into strings mid-traversal
+			if (lua_type(luaState, -2) == LUA_TSTRING)
+			{
+				if (lua_rawequal(luaState, -1, function))
+				{
+					outName = lua_tostring(luaState, -2);
+					lua_settop(luaState, function);
+					return true;
+				}
+
+				if (lua_type(luaState, -1) == LUA_TTABLE
+					&& !lua_rawequal(luaState, -1, globals))
+				{
+					int space = lua_gettop(luaState);
+
+					lua_pushnil(luaState);
+					while (lua_next(luaState, space))
+					{
+						if (lua_type(luaState, -2) == LUA_TSTRING
+							&& lua_rawequal(luaState, -1, function))
+						{
+							outName = string(lua_tostring(luaState, space - 1)) + "." + lua_tostring(luaState, -2);
+							lua_settop(luaState, function);
+							return true;
+						}
+
+						lua_pop(luaState, 1);
+					}
+				}
+			}
+
+			lua_pop(luaState, 1);
+		}
+
+		lua_settop(luaState, function);
+		return false;
+	}
+
+	void LuaProfiler::_OnShutdown()
+	{
+		isRunning = false;
+		frameIds.clear();
+	}
+}
@@ -0,0 +1,623 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <variant>
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_scheduler.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::visit;
+using std::decay_t;
+using std::move;
+using std::swap;
+using std::erase_if;
+
+namespace KalaLua::Core
+{
+	LuaScheduler::~LuaScheduler()
+	{
+		Shutdown();
+	}
+
+	bool LuaScheduler::Initialize(
+		LuaState& state,
+		const LuaSchedulerConfig& newConfig)
+	{
+		if (owner)
+		{
+			Log::Print(
+				"Failed to initialize Lua scheduler because its already initialized!",
+				"KALALUA_SCHEDULER",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!state.IsInitialized())
+		{
+			Log::Print(
+				"Failed to initialize Lua scheduler because its Lua state is not initialized!",
+				"KALALUA_SCHEDULER",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (newConfig.luaNamespace.empty()
+			|| newConfig.luaNamespace.find('.') != string::npos)
+		{
+			Log::Print(
+				"Failed to initialize Lua scheduler because its namespace was empty or dotted!",
+				"KALALUA_SCHEDULER",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		lua_State* luaState = state.GetLuaState();
+
+		//the wait functions yield, so they are plain C functions with no C++ frames
+		//a yield could jump over, the scheduler is their only upvalue
+
+		lua_newtable(luaState);
+
+		auto add_function = [this, luaState](
+			const char* name,
+			lua_CFunction function) -> void
+			{
+				lua_pushlightuserdata(luaState, this);
+				lua_pushcclosure(luaState, function, 1);
+				lua_setfield(luaState, -2, name);
+			};
+
+		add_function("wait_frames", _LuaWaitFrames);
+		add_function("wait_signal", _LuaWaitSignal);
+		add_function("wait_value", _LuaWaitValue);
+		add_function("signal", _LuaSignal);
+
+		lua_setglobal(luaState, newConfig.luaNamespace.c_str());
+
+		owner = &state;
+		ownerGeneration = state.stateGeneration;
+		config = newConfig;
+		frame = 0;
+		stats = {};
+
+		Log::Print(
+			"Initialized Lua scheduler with namespace '" + config.luaNamespace + "'!",
+			"KALALUA_SCHEDULER",
+			LogType::LOG_SUCCESS);
+
+		return true;
+	}
+
+	void LuaScheduler::Tick()
+	{
+		if (!_IsStateAlive()) return;
+
+		++frame;
+
+		//collect everything due this frame first, so tasks that wait again
+		//while being resumed only run on a later Tick
+
+		vector<TaskHandle> due{};
+		swap(due, readyTasks);
+
+		while (!frameWaits.empty()
+			&& frameWaits.top().frame <= frame)
+		{
+			due.push_back(frameWaits.top().task);
+			frameWaits.pop();
+		}
+
+		for (const TaskHandle& handle : due)
+		{
+			if (!_IsCurrent(handle)) continue;
+
+			Task& task = tasks[handle.index];
+			if (task.waitType == WaitType::WAIT_NONE) continue;
+
+			int argCount{};
+			if (task.waitType == WaitType::WAIT_VALUE)
+			{
+				//the value was cleared again before this Tick, keep waiting for the next one
+				auto it = values.find(task.waitName);
+				if (it == values.end())
+				{
+					valueWaits[task.waitName].push_back(handle);
+					continue;
+				}
+
+				_PushValue(task.thread, it->second);
+				argCount = 1;
+			}
+
+			task.waitType = WaitType::WAIT_NONE;
+			task.waitName.clear();
+
+			_Resume(handle.index, argCount);
+		}
+	}
+
+	void LuaScheduler::Signal(string_view name)
+	{
+		auto it = signalWaits.find(string(name));
+		if (it == signalWaits.end()) return;
+
+		_WakeAll(it->second);
+		signalWaits.erase(it);
+	}
+
+	void LuaScheduler::SetValue(
+		string_view name,
+		const LuaVar& value)
+	{
+		string key(name);
+		values[key] = value;
+
+		auto it = valueWaits.find(key);
+		if (it == valueWaits.end()) return;
+
+		_WakeAll(it->second);
+		valueWaits.erase(it);
+	}
+
+	void LuaScheduler::ClearValue(string_view name)
+	{
+		values.erase(string(name));
+	}
+
+	bool LuaScheduler::Cancel(LuaTaskID taskID)
+	{
+		TaskHandle handle
+		{
+			scast<u32>(taskID & 0xFFFFFFFF),
+			scast<u32>(taskID >> 32)
+		};
+
+		if (!_IsCurrent(handle)
+			|| !_IsStateAlive())
+		{
+			return false;
+		}
+
+		Task& task = tasks[handle.index];
+		if (task.isResuming)
+		{
+			//a task cannot close its own thread, _Resume finishes it once it yields
+			task.isCancelled = true;
+			return true;
+		}
+
+		//waits that still point at the slot go stale with it
+		++stats.tasksCancelled;
+		_FinishTask(handle.index, false);
+
+		return true;
+	}
+
+	bool LuaScheduler::IsRunning(LuaTaskID taskID) const
+	{
+		return _IsCurrent(TaskHandle
+			{
+				scast<u32>(taskID & 0xFFFFFFFF),
+				scast<u32>(taskID >> 32)
+			});
+	}
+
+	LuaSchedulerStats LuaScheduler::GetStats() const
+	{
+		LuaSchedulerStats result = stats;
+		result.activeTasks = scast<u32>(threadTasks.size());
+		result.pooledThreads = scast<u32>(threadPool.size());
+
+		return result;
+	}
+
+	void LuaScheduler::Shutdown()
+	{
+		if (!owner) return;
+
+		//a state that was shut down or initialized again already dropped every thread
+		if (_IsStateAlive())
+		{
+			lua_State* luaState = owner->GetLuaState();
+
+			for (const Task& task : tasks)
+			{
+				if (task.isActive) luaL_unref(luaState, LUA_REGISTRYINDEX, task.threadRef);
+			}
+			for (const PooledThread& pooled : threadPool)
+			{
+				luaL_unref(luaState, LUA_REGISTRYINDEX, pooled.threadRef);
+			}
+
+			lua_pushnil(luaState);
+			lua_setglobal(luaState, config.luaNamespace.c_str());
+		}
+
+		tasks.clear();
+		freeTaskSlots.clear();
+		threadPool.clear();
+		threadTasks.clear();
+		frameWaits = {};
+		signalWaits.clear();
+		valueWaits.clear();
+		values.clear();
+		readyTasks.clear();
+
+		owner = nullptr;
+
+		Log::Print(
+			"Shut down Lua scheduler.",
+			"KALALUA_SCHEDULER",
+			LogType::LOG_INFO);
+	}
+
+	bool LuaScheduler::_CanStart(string_view functionName) const
+	{
+		if (!_IsStateAlive())
+		{
+			Log::Print(
+				"Failed to start task '" + string(functionName) + "' because the Lua scheduler or its state is not initialized!",
+				"KALALUA_SCHEDULER",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	lua_State* LuaScheduler::_BeginTask(string_view functionName)
+	{
+		lua_State* luaState = owner->GetLuaState();
+
+		u32 index{};
+		if (!freeTaskSlots.empty())
+		{
+			index = freeTaskSlots.back();
+			freeTaskSlots.pop_back();
+		}
+		else
+		{
+			index = scast<u32>(tasks.size());
+			tasks.emplace_back();
+		}
+
+		Task& task = tasks[index];
+		task.isActive = true;
+		task.isCancelled = false;
+		task.waitType = WaitType::WAIT_NONE;
+		task.functionName = string(functionName);
+
+		if (!threadPool.empty())
+		{
+			task.thread = threadPool.back().thread;
+			task.threadRef = threadPool.back().threadRef;
+			threadPool.pop_back();
+
+			++stats.threadsReused;
+		}
+		else
+		{
+			task.thread = lua_newthread(luaState);
+			task.threadRef = luaL_ref(luaState, LUA_REGISTRYINDEX);
+		}
+
+		threadTasks[task.thread] = index;
+
+		//the function was pushed to the main thread by the caller
+		lua_xmove(luaState, task.thread, 1);
+
+		pendingTask = index;
+		return task.thread;
+	}
+
+	LuaTaskID LuaScheduler::_EndTask(int argCount)
+	{
+		u32 index = pendingTask;
+		LuaTaskID taskID =
+			(scast<u64>(tasks[index].generation) << 32)
+			| index;
+
+		++stats.tasksStarted;
+		_Resume(index, argCount);
+
+		return taskID;
+	}
+
+	void LuaScheduler::_Resume(
+		u32 index,
+		int argCount)
+	{
+		lua_State* thread = tasks[index].thread;
+
+		++stats.resumes;
+
+		tasks[index].isResuming = true;
+
+		//resumes count as calls from C++ into Lua, so they get the execution budget,
+		//Interrupt reaches them and the thread runs with the current hook
+		owner->_BeginCall();
+		lua_State* previousThread = owner->_BeginResume(
+			owner->GetLuaState(),
+			thread);
+
+		int resultCount{};
+		int status{};
+		{
+			//errors inside a resume are caught like inside a protected call
+			LuaLimitScope limitScope(thread, true);
+
+			status = lua_resume(
+				thread,
+				owner->GetLuaState(),
+				argCount,
+				&resultCount);
+		}
+
+		owner->_EndResume(previousThread);
+		owner->_EndCall();
+
+		//tasks started from inside this resume may have grown the task list
+		Task& task = tasks[index];
+		task.isResuming = false;
+
+		if (task.isCancelled)
+		{
+			//a finished thread goes back to the pool as is, so its return values must go
+			if (status == LUA_OK) lua_settop(thread, 0);
+
+			++stats.tasksCancelled;
+			_FinishTask(index, status == LUA_OK);
+
+			return;
+		}
+
+		if (status == LUA_YIELD)
+		{
+			lua_pop(thread, resultCount);
+
+			//a plain coroutine.yield waits one frame
+			if (task.waitType == WaitType::WAIT_NONE)
+			{
+				task.waitType = WaitType::WAIT_FRAMES;
+				frameWaits.push({ frame + 1, { index, task.generation } });
+			}
+
+			return;
+		}
+
+		if (status == LUA_OK)
+		{
+			lua_settop(thread, 0);
+
+			++stats.tasksFinished;
+			_FinishTask(index, true);
+
+			return;
+		}
+
+		const char* err = lua_tostring(thread, -1);
+		string errValue = err ? err : "Unknown error.";
+
+		Log::Print(
+			"Lua runtime error in task '" + task.functionName + "': " + errValue,
+			"KALALUA_SCHEDULER",
+			LogType::LOG_ERROR,
+			2);
+
+		++stats.tasksFailed;
+		_FinishTask(index, false);
+	}
+
+	void LuaScheduler::_FinishTask(
+		u32 index,
+		bool isClean)
+	{
+		lua_State* luaState = owner->GetLuaState();
+		Task& task = tasks[index];
+
+		threadTasks.erase(task.thread);
+
+		//drop the wait so names that are never signaled do not collect dead handles
+		auto& waits = task.waitType == WaitType::WAIT_SIGNAL
+			? signalWaits
+			: valueWaits;
+
+		if (task.waitType == WaitType::WAIT_SIGNAL
+			|| task.waitType == WaitType::WAIT_VALUE)
+		{
+			auto it = waits.find(task.waitName);
+			if (it != waits.end())
+			{
+				erase_if(it->second, [&](const TaskHandle& handle)
+					{
+						return handle.index == index;
+					});
+
+				if (it->second.empty()) waits.erase(it);
+			}
+		}
+
+		//failed and suspended threads must be reset before another task can use them
+		if (!isClean)
+		{
+#if LUA_VERSION_NUM >= 505 || LUA_VERSION_RELEASE_NUM >= 50406
+			lua_closethread(task.thread, luaState);
+#else
+			lua_resetthread(task.thread);
+#endif
+		}
+
+		if (threadPool.size() < config.maxPooledThreads)
+		{
+			threadPool.push_back({ task.thread, task.threadRef });
+		}
+		else luaL_unref(luaState, LUA_REGISTRYINDEX, task.threadRef);
+
+		task.thread = nullptr;
+		task.threadRef = 0;
+		task.isActive = false;
+		task.waitType = WaitType::WAIT_NONE;
+		task.waitName.clear();
+		task.functionName.clear();
+		++task.generation;
+
+		freeTaskSlots.push_back(index);
+	}
+
+	bool LuaScheduler::_IsCurrent(TaskHandle handle) const
+	{
+		return handle.index < tasks.size()
+			&& tasks[handle.index].isActive
+			&& tasks[handle.index].generation == handle.generation;
+	}
+
+	bool LuaScheduler::_IsStateAlive() const
+	{
+		return owner
+			&& owner->IsInitialized()
+			&& owner->stateGeneration == ownerGeneration;
+	}
+
+	bool LuaScheduler::_FindTask(
+		lua_State* thread,
+		u32& outIndex) const
+	{
+		auto it = threadTasks.find(thread);
+		if (it == threadTasks.end()) return false;
+
+		outIndex = it->second;
+		return true;
+	}
+
+	void LuaScheduler::_WakeAll(vector<TaskHandle>& waiters)
+	{
+		for (const TaskHandle& handle : waiters)
+		{
+			if (_IsCurrent(handle)) readyTasks.push_back(handle);
+		}
+	}
+
+	int LuaScheduler::_LuaWaitFrames(lua_State* thread)
+	{
+		LuaScheduler* scheduler = scast<LuaScheduler*>(lua_touserdata(thread, lua_upvalueindex(1)));
+		lua_Integer frames = luaL_optinteger(thread, 1, 1);
+
+		u32 index{};
+		if (!scheduler->_FindTask(thread, index))
+		{
+			return luaL_error(thread, "wait_frames can only be called from a scheduler task");
+		}
+
+		Task* task = &scheduler->tasks[index];
+
+		task->waitType = WaitType::WAIT_FRAMES;
+		scheduler->frameWaits.push(
+			{
+				scheduler->frame + scast<u64>(frames < 1 ? 1 : frames),
+				{ index, task->generation }
+			});
+
+		return lua_yield(thread, 0);
+	}
+
+	int LuaScheduler::_LuaWaitSignal(lua_State* thread)
+	{
+		LuaScheduler* scheduler = scast<LuaScheduler*>(lua_touserdata(thread, lua_upvalueindex(1)));
+
+		size_t nameLength{};
+		const char* name = luaL_checklstring(thread, 1, &nameLength);
+
+		u32 index{};
+		if (!scheduler->_FindTask(thread, index))
+		{
+			return luaL_error(thread, "wait_signal can only be called from a scheduler task");
+		}
+
+		Task* task = &scheduler->tasks[index];
+
+		task->waitType = WaitType::WAIT_SIGNAL;
+		task->waitName.assign(name, nameLength);
+		scheduler->signalWaits[task->waitName].push_back({ index, task->generation });
+
+		return lua_yield(thread, 0);
+	}
+
+	int LuaScheduler::_LuaWaitValue(lua_State* thread)
+	{
+		LuaScheduler* scheduler = scast<LuaScheduler*>(lua_touserdata(thread, lua_upvalueindex(1)));
+
+		size_t nameLength{};
+		const char* name = luaL_checklstring(thread, 1, &nameLength);
+
+		u32 index{};
+		if (!scheduler->_FindTask(thread, index))
+		{
+			return luaL_error(thread, "wait_value can only be called from a scheduler task");
+		}
+
+		//values that are already set return without waiting
+		auto it = scheduler->values.find(string(name, nameLength));
+		if (it != scheduler->values.end())
+		{
+			_PushValue(thread, it->second);
+			return 1;
+		}
+
+		Task* task = &scheduler->tasks[index];
+
+		task->waitType = WaitType::WAIT_VALUE;
+		task->waitName.assign(name, nameLength);
+		scheduler->valueWaits[task->waitName].push_back({ index, task->generation });
+
+		//Tick pushes the value when it resumes the task, it becomes the return value
+		return lua_yield(thread, 0);
+	}
+
+	int LuaScheduler::_LuaSignal(lua_State* thread)
+	{
+		LuaScheduler* scheduler = scast<LuaScheduler*>(lua_touserdata(thread, lua_upvalueindex(1)));
+
+		size_t nameLength{};
+		const char* name = luaL_checklstring(thread, 1, &nameLength);
+
+		scheduler->Signal(string_view(name, nameLength));
+
+		return 0;
+	}
+
+	void LuaScheduler::_PushValue(
+		lua_State* thread,
+		const LuaVar& value)
+	{
+		visit([thread](const auto& v)
+			{
+				LuaStack<decay_t<decltype(v)>>::Push(thread, v);
+			}, value);
+	}
+}
@@ -0,0 +1,2624 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <filesystem>
+#include <vector>
+#include <functional>
+#include <atomic>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <span>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+extern "C"
+{
+#include "lua.h"
+#include "lauxlib.h"
+#include "lualib.h"
+}
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_state.hpp"
+#include "core/kl_core.hpp"
+
+using KalaHeaders::KalaCore::ContainsValue;
+using KalaHeaders::KalaCore::RemoveDuplicates;
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+
+using KalaLua::Core::LuaVar;
+using KalaLua::Core::LuaFunctionMetrics;
+using KalaLua::Core::KalaLuaCore;
+
+using std::string;
+using std::string_view;
+using std::to_string;
+using std::filesystem::path;
+using std::filesystem::is_directory;
+using std::filesystem::create_directories;
+using std::filesystem::rename;
+using std::filesystem::remove;
+using std::error_code;
+using std::ofstream;
+using std::ios;
+using std::streamsize;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+using std::memcpy;
+using std::memcmp;
+using std::snprintf;
+using std::strcmp;
+using std::fputs;
+using std::fflush;
+using std::span;
+using std::min;
+using std::size;
+using std::erase;
+using std::find_if;
+using std::count;
+using std::vector;
+using std::function;
+using std::visit;
+using std::decay_t;
+using std::is_same_v;
+using std::optional;
+using std::atomic;
+using std::memory_order_relaxed;
+using std::lock_guard;
+using std::chrono::microseconds;
+
+static int LuaPanic(lua_State* state);
+
+static int LuaFunctionTrampolineCustom(lua_State* state);
+
+
+namespace KalaLua::Core
+{
+	static_assert(
+		LUA_EXTRASPACE >= sizeof(LuaState*),
+		"LuaState stores a pointer to itself in the extra space of lua_State");
+
+	//source of the unique generation every initialized state gets
+	static atomic<u32> nextStateGeneration{};
+
+	//Call the function below argCount args with lua_pcall,
+	//logs and pops the error message on failure
+	static bool ProtectedCall(
+		lua_State* callState,
+		string_view functionName,
+		LuaFunctionMetrics* functionMetrics,
+		int argCount,
+		int returnCount)
+	{
+		u64 callStart = functionMetrics ? functionMetrics->BeginCall() : 0;
+
+		int status{};
+		{
+			//Lua code is the only place a memory error can be caught
+			LuaLimitScope limitScope(callState, true);
+
+			status = lua_pcall(
+				callState,
+				argCount,
+				returnCount,
+				0);
+		}
+
+		if (functionMetrics) functionMetrics->EndCall(callStart, status != LUA_OK);
+
+		if (status != LUA_OK)
+		{
+			const char* err = lua_tostring(callState, -1);
+			string errValue = err ? err : "Unknown error";
+
+			Log::Print(
+				"Lua runtime error with function '" + string(functionName) + "': " + errValue,
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			lua_pop(callState, 1);
+
+			return false;
+		}
+
+		return true;
+	}
+
+	//Push args to the function on top of the stack, call it and
+	//optionally store its single return value
+	static bool CallPushedFunction(
+		lua_State* state,
+		string_view functionName,
+		LuaFunctionMetrics* functionMetrics,
+		const vector<LuaVar>& args,
+		LuaVar* outReturn)
+	{
+		//the stack below the function belongs to whoever called into Lua,
+		//a registered function calling back into Lua still has its args there
+		int base = lua_gettop(state) - 1;
+
+		//push arguments
+		for (const LuaVar& v : args)
+		{
+			visit([state](auto&& value)
+				{
+					using T = decay_t<decltype(value)>;
+
+					if constexpr (is_same_v<T, int>)           lua_pushinteger(state, value);
+					else if constexpr (is_same_v<T, int64_t>)  lua_pushinteger(state, scast<lua_Integer>(value));
+					else if constexpr (is_same_v<T, uint64_t>) lua_pushinteger(state, scast<lua_Integer>(value));
+					else if constexpr (is_same_v<T, float>)    lua_pushnumber(state, value);
+					else if constexpr (is_same_v<T, double>)   lua_pushnumber(state, value);
+					else if constexpr (is_same_v<T, bool>)     lua_pushboolean(state, value);
+					else if constexpr (is_same_v<T, string>)   lua_pushlstring(state, value.data(), value.size());
+				}, v);
+
+		}
+
+		if (!ProtectedCall(
+			state,
+			functionName,
+			functionMetrics,
+			scast<int>(args.size()),
+			outReturn ? 1 : 0)) //allow one return from lua if outReturn is assigned
+		{
+			return false;
+		}
+
+		if (outReturn)
+		{
+			if (lua_gettop(state) - base != 1)
+			{
+				Log::Print(
+					"Lua function '" + string(functionName) + "' returned multiple values!",
+					"KALALUA",
+					LogType::LOG_ERROR,
+					2);
+
+				lua_settop(state, base);
+				return false;
+			}
+
+			int type = lua_type(state, -1);
+
+			switch (type)
+			{
+			case LUA_TNUMBER:
+			{
+				//preserve integer if possible, integers that do not fit into int keep all 64 bits
+				int isInteger{};
+				lua_Integer n = lua_tointegerx(state, -1, &isInteger);
+
+				if (!isInteger) *outReturn = scast<double>(lua_tonumber(state, -1));
+				else if (n >= INT_MIN && n <= INT_MAX) *outReturn = scast<int>(n);
+				else *outReturn = scast<int64_t>(n);
+
+				break;
+			}
+			case LUA_TBOOLEAN:
+				*outReturn = scast<bool>(lua_toboolean(state, -1));
+				break;
+			case LUA_TSTRING:
+			{
+				size_t len{};
+				const char* str = lua_tolstring(state, -1, &len);
+				*outReturn = string(str, len);
+				break;
+			}
+			case LUA_TNIL:
+				//lua returned nil - we do nothing with that here
+				break;
+			default:
+				Log::Print(
+					"Unsupported Lua return type from function '" + string(functionName) + "'!",
+					"KALALUA",
+					LogType::LOG_ERROR,
+					2);
+
+				lua_pop(state, 1);
+				return false;
+			}
+
+			lua_pop(state, 1);
+		}
+
+		return true;
+	}
+
+	//identifies a KalaLua bytecode cache entry
+	static constexpr char BYTECODE_CACHE_MAGIC[4] = { 'K', 'L', 'B', 'C' };
+
+	//written in front of every cached chunk, an entry is only used if
+	//every field matches the script and Lua build that is loading it
+	struct BytecodeCacheHeader
+	{
+		char magic[4]{};
+		u32 luaVersion{};
+		u64 sourceHash{};
+		u64 sourceSize{};
+		u64 compileNanoseconds{};
+		u32 stripped{};
+		u32 reserved{};
+	};
+
+	//64-bit FNV-1a, only used to tell apart script versions,
+	//pass the previous hash to continue it over more bytes
+	static u64 HashSource(
+		string_view source,
+		u64 hash = 14695981039346656037ULL)
+	{
+		for (char c : source)
+		{
+			hash ^= scast<u8>(c);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	//Read-only view of a whole file mapped into memory, Lua reads the pages
+	//straight from the page cache instead of copying them through fread
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile() { Close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		//Map the whole file, writes why it failed into error on failure
+		bool Open(
+			const string& filePath,
+			string& error)
+		{
+#ifdef _WIN32
+			file = CreateFileW(
+				path(filePath).wstring().c_str(),
+				GENERIC_READ,
+				FILE_SHARE_READ,
+				nullptr,
+				OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+				nullptr);
+
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				DWORD lastError = GetLastError();
+				error = lastError == ERROR_FILE_NOT_FOUND
+					|| lastError == ERROR_PATH_NOT_FOUND
+					? "it does not exist"
+					: "it could not be opened";
+
+				return false;
+			}
+
+			LARGE_INTEGER fileSize{};
+			if (GetFileType(file) != FILE_TYPE_DISK
+				|| !GetFileSizeEx(file, &fileSize))
+			{
+				error = "it is not a regular file";
+				return false;
+			}
+
+			size = scast<size_t>(fileSize.QuadPart);
+			if (size == 0) return true;
+
+			mapping = CreateFileMappingW(
+				file,
+				nullptr,
+				PAGE_READONLY,
+				0,
+				0,
+				nullptr);
+
+			if (mapping) data = scast<const char*>(MapViewOfFile(
+				mapping,
+				FILE_MAP_READ,
+				0,
+				0,
+				0));
+#else
+			int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+			{
+				error = errno == ENOENT
+					? "it does not exist"
+					: "it could not be opened";
+
+				return false;
+			}
+
+			struct stat info{};
+			if (fstat(fd, &info) != 0
+				|| !S_ISREG(info.st_mode))
+			{
+				close(fd);
+
+				error = "it is not a regular file";
+				return false;
+			}
+
+			size = scast<size_t>(info.st_size);
+			if (size == 0)
+			{
+				close(fd);
+				return true;
+			}
+
+			void* view = mmap(
+				nullptr,
+				size,
+				PROT_READ,
+				MAP_PRIVATE,
+				fd,
+				0);
+
+			//the mapping stays valid after its descriptor is closed
+			close(fd);
+
+			if (view != MAP_FAILED) data = scast<const char*>(view);
+#endif
+			if (!data)
+			{
+				size = 0;
+
+				error = "it could not be mapped to memory";
+				return false;
+			}
+
+			return true;
+		}
+
+		string_view GetView() const { return data ? string_view(data, size) : string_view{}; }
+	private:
+		const char* data{};
+		size_t size{};
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping{};
+#endif
+
+		void Close()
+		{
+#ifdef _WIN32
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+			if (data) munmap(const_cast<char*>(data), size);
+#endif
+			data = nullptr;
+			size = 0;
+		}
+	};
+
+	//mode string luaL_loadbufferx expects for each load mode
+	static const char* ToLoadModeString(LuaLoadMode mode)
+	{
+		switch (mode)
+		{
+		case LuaLoadMode::LOAD_TEXT:   return "t";
+		case LuaLoadMode::LOAD_BINARY: return "b";
+		default:                       return "bt";
+		}
+	}
+
+	//appends every piece lua_dump hands over to a byte buffer
+	static int DumpToBuffer(
+		lua_State*,
+		const void* data,
+		size_t size,
+		void* userData)
+	{
+		vector<char>* buffer = scast<vector<char>*>(userData);
+		const char* bytes = scast<const char*>(data);
+
+		buffer->insert(buffer->end(), bytes, bytes + size);
+		return 0;
+	}
+
+	//Skip a UTF-8 BOM and a first '#' line the same way luaL_loadfile does,
+	//the newline is kept so line numbers in errors stay correct
+	static string_view SkipScriptPrefix(string_view source)
+	{
+		if (source.starts_with("\xEF\xBB\xBF")) source.remove_prefix(3);
+
+		if (source.starts_with('#'))
+		{
+			size_t lineEnd = source.find('\n');
+			source.remove_prefix(lineEnd == string_view::npos
+				? source.size()
+				: lineEnd);
+		}
+
+		return source;
+	}
+
+	static u64 NanosecondsSince(steady_clock::time_point start)
+	{
+		return scast<u64>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+	}
+
+	struct LibraryEntry
+	{
+		LuaLibrary library;
+		const char* name;
+		lua_CFunction open;
+	};
+
+	//every library LuaLibrary can name, in the order luaL_openlibs opens them
+	static constexpr LibraryEntry LIBRARY_ENTRIES[] =
+	{
+		{ LuaLibrary::LUA_PACKAGE,   LUA_LOADLIBNAME, luaopen_package },
+		{ LuaLibrary::LUA_COROUTINE, LUA_COLIBNAME,   luaopen_coroutine },
+		{ LuaLibrary::LUA_TABLE,     LUA_TABLIBNAME,  luaopen_table },
+		{ LuaLibrary::LUA_IO,        LUA_IOLIBNAME,   luaopen_io },
+		{ LuaLibrary::LUA_OS,        LUA_OSLIBNAME,   luaopen_os },
+		{ LuaLibrary::LUA_STRING,    LUA_STRLIBNAME,  luaopen_string },
+		{ LuaLibrary::LUA_MATH,      LUA_MATHLIBNAME, luaopen_math },
+		{ LuaLibrary::LUA_UTF8,      LUA_UTF8LIBNAME, luaopen_utf8 },
+		{ LuaLibrary::LUA_DEBUG,     LUA_DBLIBNAME,   luaopen_debug }
+	};
+
+	static const LibraryEntry* FindLibraryEntry(LuaLibrary library)
+	{
+		for (const auto& entry : LIBRARY_ENTRIES)
+		{
+			if (entry.library == library) return &entry;
+		}
+
+		return nullptr;
+	}
+
+	//every metamethod luaopen_string puts into the string metatable
+	static constexpr const char* STRING_METAMETHODS[] =
+	{
+		"__index",
+		"__add",
+		"__sub",
+		"__mul",
+		"__mod",
+		"__pow",
+		"__div",
+		"__idiv",
+		"__unm"
+	};
+
+#if LUA_VERSION_NUM >= 504
+	//the warn function luaL_newstate installs, lua_newstate installs none so Lua warn() would do nothing,
+	//warnings start off and are switched with the '@on' and '@off' control messages like in lauxlib
+
+	static void WarnOff(void* userData, const char* message, int toContinue);
+	static void WarnOn(void* userData, const char* message, int toContinue);
+
+	static bool CheckWarnControl(
+		lua_State* luaState,
+		const char* message,
+		int toContinue)
+	{
+		if (toContinue
+			|| *(message++) != '@')
+		{
+			return false;
+		}
+
+		if (strcmp(message, "off") == 0) lua_setwarnf(luaState, WarnOff, luaState);
+		else if (strcmp(message, "on") == 0) lua_setwarnf(luaState, WarnOn, luaState);
+
+		return true;
+	}
+
+	static void WarnOff(
+		void* userData,
+		const char* message,
+		int toContinue)
+	{
+		CheckWarnControl(scast<lua_State*>(userData), message, toContinue);
+	}
+
+	static void WarnContinue(
+		void* userData,
+		const char* message,
+		int toContinue)
+	{
+		lua_State* luaState = scast<lua_State*>(userData);
+
+		fputs(message, stderr);
+
+		if (toContinue) lua_setwarnf(luaState, WarnContinue, luaState);
+		else
+		{
+			fputs("\n", stderr);
+			lua_setwarnf(luaState, WarnOn, luaState);
+		}
+
+		fflush(stderr);
+	}
+
+	static void WarnOn(
+		void* userData,
+		const char* message,
+		int toContinue)
+	{
+		if (CheckWarnControl(scast<lua_State*>(userData), message, toContinue)) return;
+
+		fputs("Lua warning: ", stderr);
+		WarnContinue(userData, message, toContinue);
+	}
+#endif
+
+	LuaState::~LuaState()
+	{
+		Shutdown();
+	}
+
+	LuaState* LuaState::FromLuaState(lua_State* luaState)
+	{
+		if (!luaState) return nullptr;
+
+		return *scast<LuaState**>(lua_getextraspace(luaState));
+	}
+
+	bool LuaState::Initialize(const vector<LuaLibrary>& libs)
+	{
+		if (isInitialized)
+		{
+			Log::Print(
+				"Failed to initialize Lua state because its already initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		//the limit is only enforced inside protected calls, see LuaLimitScope,
+		//so opening libraries and every other C++ side push never runs into it
+		allocator.SetLimitEnforced(false);
+
+#if LUA_VERSION_NUM >= 505
+		state = lua_newstate(
+			LuaAllocator::Allocate,
+			&allocator,
+			luaL_makeseed(nullptr));
+#else
+		state = lua_newstate(
+			LuaAllocator::Allocate,
+			&allocator);
+#endif
+		if (!state)
+		{
+			allocator.Release();
+
+			Log::Print(
+				"Failed to initialize Lua state because it couldn't be created!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+#if LUA_VERSION_NUM >= 504
+		lua_setwarnf(state, WarnOff, state);
+#endif
+
+		auto added_lib = [](string_view libName) -> void
+			{
+				Log::Print(
+					"Added Lua library '" + string(libName) + "'!",
+					"KALALUA",
+					LogType::LOG_INFO);
+			};
+
+		loadedLibraries.clear();
+		pendingLibraries.clear();
+
+		if (ContainsValue(libs, LuaLibrary::LUA_ALL)
+			&& !isLazyLibraries)
+		{
+			luaL_openlibs(state);
+
+			lua_getglobal(state, LUA_COLIBNAME);
+			_WrapCoroutineLibrary(state);
+			lua_pop(state, 1);
+
+			for (const auto& entry : LIBRARY_ENTRIES)
+			{
+				loadedLibraries.push_back(entry.library);
+			}
+
+			Log::Print(
+				"Added all Lua libraries!",
+				"KALALUA",
+				LogType::LOG_INFO);
+		}
+		else
+		{
+			vector<LuaLibrary> realLibs{};
+			if (ContainsValue(libs, LuaLibrary::LUA_ALL))
+			{
+				for (const auto& entry : LIBRARY_ENTRIES)
+				{
+					realLibs.push_back(entry.library);
+				}
+			}
+			else realLibs = libs;
+
+			RemoveDuplicates(realLibs);
+
+			luaL_requiref(state, LUA_GNAME, luaopen_base, 1); lua_pop(state, 1);
+
+			added_lib("base");
+
+			for (const auto& l : realLibs)
+			{
+				const LibraryEntry* entry = FindLibraryEntry(l);
+				if (!entry) continue;
+
+				if (isLazyLibraries)
+				{
+					pendingLibraries.push_back(l);
+					continue;
+				}
+
+				luaL_requiref(state, entry->name, entry->open, 1);
+				if (l == LuaLibrary::LUA_COROUTINE) _WrapCoroutineLibrary(state);
+				lua_pop(state, 1);
+				loadedLibraries.push_back(l);
+				added_lib(entry->name);
+			}
+
+			if (!pendingLibraries.empty())
+			{
+				//globals that do not exist yet fall through to the stub that opens their library
+
+				lua_pushglobaltable(state);
+				lua_createtable(state, 0, 1);
+				lua_pushcfunction(state, _LazyGlobalIndex);
+				lua_setfield(state, -2, "__index");
+				lua_setmetatable(state, -2);
+				lua_pop(state, 1);
+
+				//string methods and string arithmetic go through the string metatable
+				//instead of the global, so it gets stubs of its own until string is opened
+
+				if (ContainsValue(pendingLibraries, LuaLibrary::LUA_STRING))
+				{
+					lua_pushliteral(state, "");
+					lua_createtable(state, 0, scast<int>(size(STRING_METAMETHODS)));
+					for (const char* event : STRING_METAMETHODS)
+					{
+						lua_pushstring(state, event);
+						lua_pushcclosure(state, _LazyStringMetamethod, 1);
+						lua_setfield(state, -2, event);
+					}
+					lua_setmetatable(state, -2);
+					lua_pop(state, 1);
+				}
+
+				Log::Print(
+					"Deferred " + to_string(pendingLibraries.size()) + " Lua libraries until their first use!",
+					"KALALUA",
+					LogType::LOG_INFO);
+			}
+		}
+
+		//scripts can switch the collector mode themselves, the wrapper keeps gcStats.mode
+		//in sync so StepGCFor never puts a generational collector back into incremental mode
+		lua_getglobal(state, "collectgarbage");
+		if (lua_isfunction(state, -1))
+		{
+			lua_pushcclosure(state, _LuaCollectGarbage, 1);
+			lua_setglobal(state, "collectgarbage");
+		}
+		else lua_pop(state, 1);
+
+		lua_atpanic(state, LuaPanic);
+
+		//lets trampolines and coroutine threads find their owner
+		*scast<LuaState**>(lua_getextraspace(state)) = this;
+
+		libraries = libs;
+		gcStats = {};
+		gcStepSize = DEFAULT_GC_STEP_SIZE;
+		stateGeneration = ++nextStateGeneration;
+		isInitialized = true;
+
+		Log::Print(
+			"Finished initializing Lua state!",
+			"KALALUA",
+			LogType::LOG_SUCCESS);
+
+		return true;
+	}
+
+	bool LuaState::LoadScript(
+		string_view script,
+		LuaLoadMode mode)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to load script '" + string(script) + "' because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!state)
+		{
+			Log::Print(
+				"Failed to load script '" + string(script) + "' because the Lua state is invalid!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		string_view extension = script.substr(min(script.rfind('.'), script.size()));
+		if (extension != ".lua"
+			&& extension != ".luac")
+		{
+			Log::Print(
+				"Failed to load script '" + string(script) + "' because its extension is incorrect!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		//opening the file is the only filesystem call,
+		//it reports missing files and non-files on its own
+
+		MappedFile file{};
+		string error{};
+		if (!file.Open(string(script), error))
+		{
+			Log::Print(
+				"Failed to load script '" + string(script) + "' because " + error + "!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		_TrackScript(script, mode);
+
+		//skip a UTF-8 BOM and a first '#' line the same way luaL_loadfile does
+		return _RunScript(
+			script,
+			SkipScriptPrefix(file.GetView()),
+			mode);
+	}
+
+	bool LuaState::EnableHotReload()
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to enable hot reload because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!scriptWatcher.Start()) return false;
+
+		//scripts loaded while hot reload was off are only watched from now on
+		vector<LoadedScript> watchedScripts{};
+		for (auto& loaded : loadedScripts)
+		{
+			if (loaded.file.empty()) loaded.file = scriptWatcher.Watch(path(loaded.script));
+
+			//two spellings of the same file keep the newest load
+			auto it = find_if(watchedScripts.begin(), watchedScripts.end(), [&](const LoadedScript& watched)
+				{
+					return watched.file == loaded.file;
+				});
+
+			if (it != watchedScripts.end()) *it = move(loaded);
+			else watchedScripts.push_back(move(loaded));
+		}
+		loadedScripts = move(watchedScripts);
+
+		Log::Print(
+			"Enabled hot reload for " + to_string(loadedScripts.size()) + " scripts.",
+			"KALALUA",
+			LogType::LOG_INFO);
+
+		return true;
+	}
+
+	u32 LuaState::PollHotReload()
+	{
+		if (!isInitialized
+			|| !scriptWatcher.IsRunning())
+		{
+			return 0;
+		}
+
+		vector<path> changedFiles{};
+		scriptWatcher.Poll(changedFiles);
+
+		u32 reloadCount{};
+
+		for (const path& changedFile : changedFiles)
+		{
+			auto it = find_if(loadedScripts.begin(), loadedScripts.end(), [&](const LoadedScript& loaded)
+				{
+					return loaded.file == changedFile;
+				});
+			if (it == loadedScripts.end()) continue;
+
+			//the file can be missing for a moment while an editor saves it,
+			//the watcher reports it again once it is back
+			MappedFile file{};
+			string error{};
+			if (!file.Open(it->script, error))
+			{
+				Log::Print(
+					"Skipped reloading script '" + it->script + "' because " + error + "!",
+					"KALALUA",
+					LogType::LOG_WARNING);
+
+				continue;
+			}
+
+			//a compile error leaves every function of the previous version in place,
+			//a runtime error keeps whatever the script defined before it failed
+			if (!_RunScript(
+				it->script,
+				SkipScriptPrefix(file.GetView()),
+				it->mode))
+			{
+				Log::Print(
+					"Failed to reload script '" + it->script + "', the previous version stays loaded.",
+					"KALALUA",
+					LogType::LOG_ERROR,
+					2);
+
+				continue;
+			}
+
+			++reloadCount;
+		}
+
+		return reloadCount;
+	}
+
+	void LuaState::_DispatchHook(
+		lua_State* luaState,
+		lua_Debug* debug)
+	{
+		LuaState* owner = FromLuaState(luaState);
+
+		if (owner->profiler.isRunning) owner->profiler._OnHook(luaState);
+
+		owner->_CheckBudget(
+			luaState,
+			debug->event);
+	}
+
+	void LuaState::_UpdateHook()
+	{
+		if (!state) return;
+
+		lua_State* thread = runningThread.load(memory_order_relaxed);
+
+		if (!profiler.isRunning
+			&& !isBudgetActive)
+		{
+			lua_sethook(state, nullptr, 0, 0);
+			if (thread) lua_sethook(thread, nullptr, 0, 0);
+
+			return;
+		}
+
+		int mask = LUA_MASKCOUNT;
+		hookInterval = BUDGET_HOOK_INTERVAL;
+
+		if (profiler.isRunning)
+		{
+			//the profiler samples on every count event, so budgets are counted at its interval
+			hookInterval = profiler.config.instructionInterval;
+			if (profiler.config.mode == LuaProfilerMode::PROFILE_TIME) mask |= LUA_MASKRET;
+		}
+		else if (activeBudget.maxInstructions != 0
+			&& activeBudget.maxInstructions < hookInterval)
+		{
+			hookInterval = scast<u32>(activeBudget.maxInstructions);
+		}
+
+		lua_sethook(
+			state,
+			_DispatchHook,
+			mask,
+			scast<int>(hookInterval));
+
+		if (thread)
+		{
+			lua_sethook(
+				thread,
+				_DispatchHook,
+				mask,
+				scast<int>(hookInterval));
+		}
+	}
+
+	void LuaState::Interrupt()
+	{
+		if (callDepth.load(memory_order_relaxed) == 0) return;
+
+		isInterruptRequested.store(true, memory_order_relaxed);
+
+		//lua_sethook is the one Lua function that may run while another thread is inside Lua,
+		//the hook it installs fires at the next instruction and raises the error there
+		lua_sethook(
+			state,
+			_DispatchHook,
+			LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT,
+			1);
+
+		//the main thread only gets there once the coroutine it resumed yields,
+		//the lock keeps _EndResume from letting go of the thread while it is hooked
+		lock_guard lock(interruptMutex);
+
+		lua_State* thread = runningThread.load(memory_order_relaxed);
+		if (thread)
+		{
+			lua_sethook(
+				thread,
+				_DispatchHook,
+				LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT,
+				1);
+		}
+	}
+
+	void LuaState::_BeginCall()
+	{
+		u32 depth = callDepth.load(memory_order_relaxed);
+		callDepth.store(depth + 1, memory_order_relaxed);
+
+		if (depth != 0) return;
+
+		//an interrupt that arrived after the previous call returned is dropped
+		isInterruptRequested.store(false, memory_order_relaxed);
+
+		if (executionBudget.maxInstructions == 0
+			&& executionBudget.maxMicroseconds == 0)
+		{
+			return;
+		}
+
+		activeBudget = executionBudget;
+		budgetInstructions = 0;
+		budgetDeadline = activeBudget.maxMicroseconds != 0
+			? steady_clock::now() + microseconds(activeBudget.maxMicroseconds)
+			: steady_clock::time_point::max();
+
+		isBudgetActive = true;
+		_UpdateHook();
+	}
+
+	void LuaState::_EndCall()
+	{
+		u32 depth = callDepth.load(memory_order_relaxed);
+		callDepth.store(depth - 1, memory_order_relaxed);
+
+		if (depth != 1) return;
+
+		bool wasInterrupted = isInterruptRequested.exchange(false, memory_order_relaxed);
+
+		if (isBudgetActive
+			|| wasInterrupted)
+		{
+			isBudgetActive = false;
+			_UpdateHook();
+		}
+	}
+
+	lua_State* LuaState::_BeginResume(
+		lua_State* from,
+		lua_State* thread)
+	{
+		//published first, so an Interrupt from now on reaches the thread directly
+		lua_State* previousThread = runningThread.exchange(thread, memory_order_relaxed);
+
+		//a thread keeps the hook it had when it was created or last resumed,
+		//which may be from before a budget started or the profiler stopped
+		lua_sethook(
+			thread,
+			lua_gethook(from),
+			lua_gethookmask(from),
+			lua_gethookcount(from));
+
+		//an Interrupt between the exchange and copying the hook would be overwritten
+		if (isInterruptRequested.load(memory_order_relaxed))
+		{
+			lua_sethook(
+				thread,
+				_DispatchHook,
+				LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT,
+				1);
+		}
+
+		return previousThread;
+	}
+
+	void LuaState::_EndResume(lua_State* previousThread)
+	{
+		//the resumed thread may be released right after this, an Interrupt that already
+		//loaded it finishes hooking it first
+		lock_guard lock(interruptMutex);
+		runningThread.store(previousThread, memory_order_relaxed);
+	}
+
+	void LuaState::_CheckBudget(
+		lua_State* luaState,
+		int event)
+	{
+		if (callDepth.load(memory_order_relaxed) == 0) return;
+
+		if (isInterruptRequested.load(memory_order_relaxed))
+		{
+			luaL_error(luaState, "script was interrupted");
+		}
+
+		//only Interrupt hooks calls, an interrupt that landed just after a call returned
+		//leaves its every instruction hook behind, which is replaced here
+		if (lua_gethookmask(luaState) & LUA_MASKCALL)
+		{
+			_UpdateHook();
+
+			//a thread resumed from C++ outside the scheduler is not published
+			if (luaState != state
+				&& luaState != runningThread.load(memory_order_relaxed))
+			{
+				lua_sethook(
+					luaState,
+					lua_gethook(state),
+					lua_gethookmask(state),
+					lua_gethookcount(state));
+			}
+		}
+
+		if (!isBudgetActive) return;
+
+		if (event == LUA_HOOKCOUNT
+			&& activeBudget.maxInstructions != 0)
+		{
+			budgetInstructions += hookInterval;
+
+			if (budgetInstructions >= activeBudget.maxInstructions)
+			{
+				luaL_error(
+					luaState,
+					"execution budget of %llu instructions exceeded",
+					scast<unsigned long long>(activeBudget.maxInstructions));
+			}
+		}
+
+		if (activeBudget.maxMicroseconds != 0
+			&& steady_clock::now() >= budgetDeadline)
+		{
+			luaL_error(
+				luaState,
+				"execution budget of %llu microseconds exceeded",
+				scast<unsigned long long>(activeBudget.maxMicroseconds));
+		}
+	}
+
+	void LuaState::_TrackScript(
+		string_view script,
+		LuaLoadMode mode)
+	{
+		//without hot reload the path is only recorded, so loads cost no filesystem calls,
+		//EnableHotReload resolves and stats it later
+		path file = scriptWatcher.IsRunning()
+			? scriptWatcher.Watch(path(script))
+			: path{};
+
+		auto it = find_if(loadedScripts.begin(), loadedScripts.end(), [&](const LoadedScript& loaded)
+			{
+				return file.empty()
+					? loaded.script == script
+					: loaded.file == file;
+			});
+
+		//loading the same file again reloads it with the newest mode
+		if (it != loadedScripts.end())
+		{
+			it->script = string(script);
+			it->mode = mode;
+			return;
+		}
+
+		loadedScripts.push_back({ string(script), move(file), mode });
+	}
+
+	bool LuaState::LoadScriptFromBuffer(
+		string_view name,
+		span<const char> buffer,
+		LuaLoadMode mode)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to load script '" + string(name) + "' from buffer because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!state)
+		{
+			Log::Print(
+				"Failed to load script '" + string(name) + "' from buffer because the Lua state is invalid!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (name.empty())
+		{
+			Log::Print(
+				"Failed to load script from buffer because its name is empty!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		return _RunScript(
+			name,
+			string_view(buffer.data(), buffer.size()),
+			mode);
+	}
+
+	bool LuaState::_RunScript(
+		string_view name,
+		string_view source,
+		LuaLoadMode mode)
+	{
+		//load (compile) the script
+
+		if (!_CompileScript(
+			name,
+			source,
+			mode))
+		{
+			return false;
+		}
+
+		if (chunkRecorder)
+		{
+			chunkRecorder->clear();
+
+			//an empty chunk tells the template the script could not be recorded
+			if (lua_dump(
+				state,
+				DumpToBuffer,
+				chunkRecorder,
+				0) != 0)
+			{
+				chunkRecorder->clear();
+			}
+		}
+
+		//execute the script, values a module-style script returns are dropped,
+		//they would otherwise pile up on the main thread with every load and reload
+
+		_BeginCall();
+
+		int status{};
+		{
+			LuaLimitScope limitScope(state, true);
+
+			status = lua_pcall(
+				state,
+				0,
+				0,
+				0);
+		}
+
+		_EndCall();
+		if (status != LUA_OK)
+		{
+			const char* err = lua_tostring(state, -1);
+			string errValue = err ? err : "Unknown error.";
+
+			Log::Print(
+				"Lua runtime error in script '" + string(name) + "': " + errValue,
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			lua_pop(state, 1);
+
+			return false;
+		}
+
+		++scriptGeneration;
+
+		Log::Print(
+			"Loaded script '" + string(name) + "'!",
+			"KALALUA",
+			LogType::LOG_SUCCESS);
+
+		return true;
+	}
+
+	bool LuaState::_CheckBatchResults(
+		string_view functionName,
+		size_t count,
+		size_t resultCount)
+	{
+		if (resultCount == 0
+			|| resultCount >= count)
+		{
+			return true;
+		}
+
+		Log::Print(
+			"Failed to call function '" + string(functionName) + "' in a batch because its results span is smaller than its args!",
+			"KALALUA",
+			LogType::LOG_ERROR,
+			2);
+
+		return false;
+	}
+
+	lua_State* LuaState::_PushFunction(
+		string_view functionName,
+		string_view functionNamespace)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to call function because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		if (!state)
+		{
+			Log::Print(
+				"Failed to call function because the Lua state is invalid!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		if (functionName.empty())
+		{
+			Log::Print(
+				"Failed to call function because name was empty!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		if (!_ResolveFunction(
+			functionName,
+			functionNamespace))
+		{
+			return nullptr;
+		}
+
+		return state;
+	}
+
+	void LuaState::_AnchorReturns(
+		lua_State* callState,
+		int returnCount)
+	{
+		//the address identifies the registry slot, one slot is shared by every state
+		static const char returnAnchorKey{};
+
+		if (returnCount > 1)
+		{
+			lua_createtable(callState, returnCount, 0);
+			lua_insert(callState, -(returnCount + 1));
+
+			int table = lua_absindex(callState, -(returnCount + 1));
+			for (int i = returnCount; i > 0; --i)
+			{
+				lua_rawseti(callState, table, i);
+			}
+		}
+
+		lua_rawsetp(callState, LUA_REGISTRYINDEX, &returnAnchorKey);
+	}
+
+	bool LuaState::_ProtectedCall(
+		lua_State* callState,
+		string_view functionName,
+		LuaFunctionMetrics* functionMetrics,
+		int argCount,
+		int returnCount)
+	{
+		LuaState* owner = FromLuaState(callState);
+
+		owner->_BeginCall();
+
+		bool isCalled = ProtectedCall(
+			callState,
+			functionName,
+			functionMetrics,
+			argCount,
+			returnCount);
+
+		owner->_EndCall();
+
+		return isCalled;
+	}
+
+	bool LuaState::_CallFunction(
+		string_view functionName,
+		string_view functionNamespace,
+		const vector<LuaVar>& args,
+		LuaVar* outReturn)
+	{
+		if (!_PushFunction(
+			functionName,
+			functionNamespace))
+		{
+			return false;
+		}
+
+		//args are pushed outside of the protected call
+		LuaLimitScope limitScope(state, false);
+
+		_BeginCall();
+
+		bool isCalled = CallPushedFunction(
+			state,
+			functionName,
+			metrics._GetCallEntry(functionName, functionNamespace),
+			args,
+			outReturn);
+
+		_EndCall();
+
+		if (!isCalled) return false;
+
+		if (functionNamespace.empty())
+		{
+			Log::Print(
+				"Called global function '" 
+				+ string(functionName) + "' with '" 
+				+ to_string(args.size()) + "' args.",
+				"KALALUA",
+				LogType::LOG_SUCCESS);
+		}
+		else
+		{
+			Log::Print(
+				"Called function '" 
+				+ string(functionName) + "' in namespace '" 
+				+ string(functionNamespace) + "' with '" 
+				+ to_string(args.size()) + "' args.",
+				"KALALUA",
+				LogType::LOG_SUCCESS);
+		}
+
+		return true;
+	}
+
+	bool LuaFunctionRef::IsValid() const
+	{
+		return owner
+			&& owner->isInitialized
+			&& ref != NO_REF
+			&& stateGeneration == owner->stateGeneration;
+	}
+
+	bool LuaState::SetAllocator(const LuaAllocatorConfig& config)
+	{
+		if (isInitialized)
+		{
+			Log::Print(
+				"Failed to set allocator because the Lua state is already initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (config.type == LuaAllocatorType::ALLOCATOR_CUSTOM
+			&& !config.customAlloc)
+		{
+			Log::Print(
+				"Failed to set custom allocator because its lua_Alloc function is empty!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		allocator.Configure(config);
+
+		return true;
+	}
+
+	bool LuaState::SetIncrementalGC(const LuaGCIncrementalParams& params)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to set incremental garbage collector because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		lua_gc(
+			state,
+			LUA_GCINC,
+			params.pause,
+			params.stepMultiplier,
+			params.stepSize);
+
+		if (params.stepSize != 0) gcStepSize = params.stepSize;
+		gcStats.mode = LuaGCMode::GC_INCREMENTAL;
+
+		return true;
+	}
+
+	bool LuaState::SetGenerationalGC(const LuaGCGenerationalParams& params)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to set generational garbage collector because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		lua_gc(
+			state,
+			LUA_GCGEN,
+			params.minorMultiplier,
+			params.majorMultiplier);
+
+		//a generational switch finishes the current cycle with a full collection
+		gcStats.mode = LuaGCMode::GC_GENERATIONAL;
+		gcStats.currentCycleNanoseconds = 0;
+
+		return true;
+	}
+
+	void LuaState::StopGC()
+	{
+		if (!isInitialized) return;
+
+		lua_gc(state, LUA_GCSTOP);
+	}
+
+	void LuaState::RestartGC()
+	{
+		if (!isInitialized) return;
+
+		lua_gc(state, LUA_GCRESTART);
+	}
+
+	bool LuaState::StepGCFor(u32 microseconds)
+	{
+		if (!isInitialized) return false;
+
+		//a basic step does work in proportion to the step size, so shrink it while stepping
+		//to overshoot the budget by at most one small step, generational steps
+		//are always a whole minor or major collection and cannot be split
+		bool isIncremental = gcStats.mode == LuaGCMode::GC_INCREMENTAL;
+		if (isIncremental
+			&& lua_gc(state, LUA_GCINC, 0, 0, BUDGETED_GC_STEP_SIZE) == LUA_GCGEN)
+		{
+			//something switched to generational behind our back, put it back and remember it,
+			//0 keeps the generational parameters it had
+			lua_gc(state, LUA_GCGEN, 0, 0);
+
+			gcStats.mode = LuaGCMode::GC_GENERATIONAL;
+			isIncremental = false;
+		}
+
+		auto start = steady_clock::now();
+		auto deadline = start + std::chrono::microseconds(microseconds);
+
+		bool isCycleDone{};
+		do
+		{
+			//0 is a single basic step, returns 1 when the step finished a cycle
+			isCycleDone = lua_gc(state, LUA_GCSTEP, 0) != 0;
+			++gcStats.steps;
+		}
+		while (!isCycleDone
+			&& steady_clock::now() < deadline);
+
+		if (isIncremental) lua_gc(state, LUA_GCINC, 0, 0, gcStepSize);
+
+		u64 elapsed = NanosecondsSince(start);
+		gcStats.totalNanoseconds += elapsed;
+		gcStats.currentCycleNanoseconds += elapsed;
+
+		if (isCycleDone)
+		{
+			++gcStats.completedCycles;
+			gcStats.lastCycleNanoseconds = gcStats.currentCycleNanoseconds;
+			gcStats.currentCycleNanoseconds = 0;
+		}
+
+		return isCycleDone;
+	}
+
+	void LuaState::CollectGarbage()
+	{
+		if (!isInitialized) return;
+
+		auto start = steady_clock::now();
+
+		lua_gc(state, LUA_GCCOLLECT);
+
+		u64 elapsed = NanosecondsSince(start);
+		gcStats.totalNanoseconds += elapsed;
+
+		//a full collection also finishes any cycle that was in progress
+		++gcStats.completedCycles;
+		gcStats.lastCycleNanoseconds = gcStats.currentCycleNanoseconds + elapsed;
+		gcStats.currentCycleNanoseconds = 0;
+	}
+
+	int LuaState::_LuaCollectGarbage(lua_State* luaState)
+	{
+		//the option string may be collected during the call, so it is compared first
+		const char* option = luaL_optstring(luaState, 1, "collect");
+		bool isGenerational = strcmp(option, "generational") == 0;
+		bool isIncremental = strcmp(option, "incremental") == 0;
+		lua_Integer stepSize = isIncremental ? luaL_optinteger(luaState, 4, 0) : 0;
+
+		//call the original collectgarbage with every arg
+		int argCount = lua_gettop(luaState);
+		lua_pushvalue(luaState, lua_upvalueindex(1));
+		lua_insert(luaState, 1);
+		lua_call(luaState, argCount, LUA_MULTRET);
+
+		LuaState* owner = FromLuaState(luaState);
+		if (owner)
+		{
+			if (isGenerational) owner->gcStats.mode = LuaGCMode::GC_GENERATIONAL;
+			else if (isIncremental)
+			{
+				owner->gcStats.mode = LuaGCMode::GC_INCREMENTAL;
+				if (stepSize != 0) owner->gcStepSize = scast<int>(stepSize);
+			}
+		}
+
+		return lua_gettop(luaState);
+	}
+
+	int LuaState::_LuaResumeCoroutine(lua_State* luaState)
+	{
+		//checked before the thread is published, the original resume raises nothing else
+		luaL_checktype(luaState, 1, LUA_TTHREAD);
+
+		return _ForwardResume(
+			luaState,
+			lua_tothread(luaState, 1),
+			false);
+	}
+
+	int LuaState::_LuaWrapCoroutine(lua_State* luaState)
+	{
+		//the closure the original wrap returns keeps its coroutine as its only upvalue
+		int argCount = lua_gettop(luaState);
+		lua_pushvalue(luaState, lua_upvalueindex(1));
+		lua_insert(luaState, 1);
+		lua_call(luaState, argCount, 1);
+
+		lua_getupvalue(luaState, -1, 1);
+		lua_pushcclosure(luaState, _LuaResumeWrapped, 2);
+
+		return 1;
+	}
+
+	int LuaState::_LuaResumeWrapped(lua_State* luaState)
+	{
+		return _ForwardResume(
+			luaState,
+			lua_tothread(luaState, lua_upvalueindex(2)),
+			true);
+	}
+
+	int LuaState::_ForwardResume(
+		lua_State* luaState,
+		lua_State* thread,
+		bool isWrapped)
+	{
+		LuaState* owner = FromLuaState(luaState);
+
+		int argCount = lua_gettop(luaState);
+		lua_pushvalue(luaState, lua_upvalueindex(1));
+		lua_insert(luaState, 1);
+
+		if (!owner)
+		{
+			lua_call(luaState, argCount, LUA_MULTRET);
+			return lua_gettop(luaState);
+		}
+
+		//protected, so the thread is never left published after an error
+		lua_State* previousThread = owner->_BeginResume(luaState, thread);
+		int status = lua_pcall(luaState, argCount, LUA_MULTRET, 0);
+		owner->_EndResume(previousThread);
+
+		if (status == LUA_OK) return lua_gettop(luaState);
+
+		//the wrapped closure adds the position of its caller, which is this function now
+		if (isWrapped
+			&& status != LUA_ERRMEM
+			&& lua_type(luaState, -1) == LUA_TSTRING)
+		{
+			luaL_where(luaState, 1);
+			lua_insert(luaState, -2);
+			lua_concat(luaState, 2);
+		}
+
+		return lua_error(luaState);
+	}
+
+	void LuaState::_WrapCoroutineLibrary(lua_State* luaState)
+	{
+		if (!lua_istable(luaState, -1)) return;
+
+		lua_getfield(luaState, -1, "resume");
+		lua_pushcclosure(luaState, _LuaResumeCoroutine, 1);
+		lua_setfield(luaState, -2, "resume");
+
+		lua_getfield(luaState, -1, "wrap");
+		lua_pushcclosure(luaState, _LuaWrapCoroutine, 1);
+		lua_setfield(luaState, -2, "wrap");
+	}
+
+	LuaGCStats LuaState::GetGCStats() const
+	{
+		LuaGCStats stats = gcStats;
+		if (!isInitialized) return stats;
+
+		stats.heapBytes =
+			scast<size_t>(lua_gc(state, LUA_GCCOUNT)) * 1024
+			+ scast<size_t>(lua_gc(state, LUA_GCCOUNTB));
+		stats.isRunning = lua_gc(state, LUA_GCISRUNNING) != 0;
+
+		return stats;
+	}
+
+	bool LuaState::SetBytecodeCache(
+		string_view cacheDirectory,
+		bool stripDebugInfo)
+	{
+		if (cacheDirectory.empty())
+		{
+			bytecodeCacheDirectory.clear();
+			stripBytecodeDebugInfo = false;
+
+			return true;
+		}
+
+		error_code ec{};
+		create_directories(cacheDirectory, ec);
+		if (ec
+			|| !is_directory(cacheDirectory, ec))
+		{
+			Log::Print(
+				"Failed to set bytecode cache directory '" + string(cacheDirectory) + "' because it could not be created!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		bytecodeCacheDirectory = string(cacheDirectory);
+		stripBytecodeDebugInfo = stripDebugInfo;
+
+		return true;
+	}
+
+	bool LuaState::_CompileScript(
+		string_view name,
+		string_view source,
+		LuaLoadMode mode)
+	{
+		string chunkName = "@" + string(name);
+
+		auto load_failed = [&](string_view errorPrefix) -> bool
+			{
+				const char* err = lua_tostring(state, -1);
+				string errValue = err ? err : "Unknown error.";
+
+				Log::Print(
+					string(errorPrefix) + " in script '" + string(name) + "': " + errValue,
+					"KALALUA",
+					LogType::LOG_ERROR,
+					2);
+
+				lua_pop(state, 1);
+
+				return false;
+			};
+
+		//precompiled chunks gain nothing from the cache
+		if (bytecodeCacheDirectory.empty()
+			|| source.starts_with(LUA_SIGNATURE))
+		{
+			if (luaL_loadbufferx(
+				state,
+				source.data(),
+				source.size(),
+				chunkName.c_str(),
+				ToLoadModeString(mode)) != LUA_OK)
+			{
+				return load_failed("Lua load error");
+			}
+
+			return true;
+		}
+
+		if (mode == LuaLoadMode::LOAD_BINARY)
+		{
+			Log::Print(
+				"Lua load error in script '" + string(name) + "': attempt to load a text chunk (mode is 'b')",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		//the chunk name is stored in the chunk and shows up in Lua errors,
+		//so the same source loaded under two names gets two entries
+		u64 sourceHash = HashSource(source, HashSource(chunkName));
+		u32 stripped = stripBytecodeDebugInfo ? 1 : 0;
+
+		char hashText[17]{};
+		snprintf(hashText, sizeof(hashText), "%016llx", scast<unsigned long long>(sourceHash));
+
+		path cacheFile = path(bytecodeCacheDirectory)
+			/ (string(hashText)
+			+ "_" + to_string(LUA_VERSION_NUM)
+			+ (stripped ? "_s" : "_d")
+			+ ".luac");
+
+		//try the cached chunk first, anything that does not match falls back to compiling
+
+		MappedFile cacheEntry{};
+		string cacheError{};
+		string_view cached{};
+		if (cacheEntry.Open(cacheFile.string(), cacheError)) cached = cacheEntry.GetView();
+
+		if (cached.size() > sizeof(BytecodeCacheHeader))
+		{
+			BytecodeCacheHeader header{};
+			memcpy(&header, cached.data(), sizeof(header));
+
+			if (memcmp(header.magic, BYTECODE_CACHE_MAGIC, sizeof(header.magic)) == 0
+				&& header.luaVersion == LUA_VERSION_NUM
+				&& header.sourceHash == sourceHash
+				&& header.sourceSize == source.size()
+				&& header.stripped == stripped)
+			{
+				auto loadStart = steady_clock::now();
+
+				//binary-only mode, lua_load validates the chunk header against this Lua build
+				int status = luaL_loadbufferx(
+					state,
+					cached.data() + sizeof(header),
+					cached.size() - sizeof(header),
+					chunkName.c_str(),
+					"b");
+
+				if (status == LUA_OK)
+				{
+					u64 loadNanoseconds = NanosecondsSince(loadStart);
+
+					++bytecodeCacheStats.hits;
+					if (header.compileNanoseconds > loadNanoseconds)
+					{
+						bytecodeCacheStats.timeSavedNanoseconds += header.compileNanoseconds - loadNanoseconds;
+					}
+
+					return true;
+				}
+
+				lua_pop(state, 1);
+			}
+		}
+
+		++bytecodeCacheStats.misses;
+
+		auto compileStart = steady_clock::now();
+
+		if (luaL_loadbufferx(
+			state,
+			source.data(),
+			source.size(),
+			chunkName.c_str(),
+			"t") != LUA_OK)
+		{
+			return load_failed("Lua load error");
+		}
+
+		BytecodeCacheHeader header{};
+		memcpy(header.magic, BYTECODE_CACHE_MAGIC, sizeof(header.magic));
+		header.luaVersion = LUA_VERSION_NUM;
+		header.sourceHash = sourceHash;
+		header.sourceSize = source.size();
+		header.compileNanoseconds = NanosecondsSince(compileStart);
+		header.stripped = stripped;
+
+		vector<char> chunk(sizeof(header));
+		memcpy(chunk.data(), &header, sizeof(header));
+
+		if (lua_dump(
+			state,
+			DumpToBuffer,
+			&chunk,
+			scast<int>(stripped)) != 0)
+		{
+			Log::Print(
+				"Failed to write script '" + string(name) + "' to the bytecode cache because it could not be dumped!",
+				"KALALUA",
+				LogType::LOG_WARNING);
+
+			return true;
+		}
+
+		//write next to the final file and rename, so other states reading
+		//the same cache directory never see a partially written entry,
+		//the temp name is unique per process and state so no two writers share it
+
+#ifdef _WIN32
+		u64 processID = scast<u64>(GetCurrentProcessId());
+#else
+		u64 processID = scast<u64>(getpid());
+#endif
+
+		path tempFile = cacheFile;
+		tempFile += ".tmp" + to_string(processID) + "_" + to_string(stateGeneration);
+
+		bool written{};
+		{
+			ofstream file(tempFile, ios::binary | ios::trunc);
+			written = file.write(chunk.data(), scast<streamsize>(chunk.size())).good();
+		}
+
+		error_code ec{};
+		if (written) rename(tempFile, cacheFile, ec);
+
+		if (!written
+			|| ec)
+		{
+			remove(tempFile, ec);
+
+			Log::Print(
+				"Failed to write script '" + string(name) + "' to the bytecode cache!",
+				"KALALUA",
+				LogType::LOG_WARNING);
+		}
+
+		return true;
+	}
+
+	LuaFunctionRef LuaState::GetFunctionRef(
+		string_view functionName,
+		string_view functionNamespace)
+	{
+		LuaFunctionRef functionRef{};
+
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to resolve function because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return functionRef;
+		}
+
+		if (functionName.empty())
+		{
+			Log::Print(
+				"Failed to resolve function because name was empty!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return functionRef;
+		}
+
+		//pinning the function to the registry is not protected either
+		LuaLimitScope limitScope(state, false);
+
+		if (!_ResolveFunction(
+			functionName,
+			functionNamespace))
+		{
+			return functionRef;
+		}
+
+		functionRef.owner = this;
+		functionRef.functionName = string(functionName);
+		functionRef.functionNamespace = string(functionNamespace);
+
+		//pops the function and pins it to the registry
+		functionRef.ref = luaL_ref(state, LUA_REGISTRYINDEX);
+		functionRef.stateGeneration = stateGeneration;
+		functionRef.scriptGeneration = scriptGeneration;
+
+		return functionRef;
+	}
+
+	void LuaState::ReleaseFunctionRef(LuaFunctionRef& functionRef)
+	{
+		if (functionRef.IsValid()
+			&& functionRef.owner == this)
+		{
+			luaL_unref(state, LUA_REGISTRYINDEX, functionRef.ref);
+		}
+
+		functionRef.ref = LuaFunctionRef::NO_REF;
+	}
+
+	lua_State* LuaState::_PushFunctionRef(LuaFunctionRef& functionRef)
+	{
+		if (!functionRef.IsValid()
+			|| functionRef.owner != this)
+		{
+			Log::Print(
+				"Failed to call function '" + functionRef.functionName + "' because its handle is invalid for this state!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		//a script was loaded after this handle was resolved,
+		//so the function may have been replaced
+		if (functionRef.scriptGeneration != scriptGeneration)
+		{
+			if (!_ResolveFunction(
+				functionRef.functionName,
+				functionRef.functionNamespace))
+			{
+				ReleaseFunctionRef(functionRef);
+				return nullptr;
+			}
+
+			lua_rawseti(state, LUA_REGISTRYINDEX, functionRef.ref);
+			functionRef.scriptGeneration = scriptGeneration;
+		}
+
+		lua_rawgeti(state, LUA_REGISTRYINDEX, functionRef.ref);
+
+		return state;
+	}
+
+	bool LuaState::_CallFunctionRef(
+		LuaFunctionRef& functionRef,
+		const vector<LuaVar>& args,
+		LuaVar* outReturn)
+	{
+		if (!_PushFunctionRef(functionRef)) return false;
+
+		//args are pushed outside of the protected call
+		LuaLimitScope limitScope(state, false);
+
+		_BeginCall();
+
+		bool isCalled = CallPushedFunction(
+			state,
+			functionRef.functionName,
+			metrics._GetCallEntry(functionRef.functionName, functionRef.functionNamespace),
+			args,
+			outReturn);
+
+		_EndCall();
+
+		return isCalled;
+	}
+
+	bool LuaState::RegisterFunction(
+		string_view functionName,
+		string_view functionNamespace,
+		const function<int(lua_State*)>& targetFunction)
+	{
+		if (!targetFunction)
+		{
+			Log::Print(
+				"Failed to register function '" + string(functionName) + "' because target function was empty.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!_BeginRegister(
+			functionName,
+			functionNamespace))
+		{
+			return false;
+		}
+
+		//the functional lives in a userdata upvalue that is destroyed with the closure
+		_PushOwnedUpvalue(state, targetFunction);
+		_PushMetricsUpvalue(functionName, functionNamespace);
+
+		//create closure with 2 upvalues
+		lua_pushcclosure(state, LuaFunctionTrampolineCustom, 2);
+
+		_EndRegister(
+			functionName,
+			functionNamespace);
+
+		return true;
+	}
+
+	lua_State* LuaState::_BeginRegister(
+		string_view functionName,
+		string_view functionNamespace)
+	{
+		if (!isInitialized)
+		{
+			Log::Print(
+				"Failed to register function because the Lua state is not initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+		
+		if (!state)
+		{
+			Log::Print(
+				"Failed to register function because the Lua state is invalid!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		if (functionName.empty()
+			|| functionName.size() > 50)
+		{
+			Log::Print(
+				"Failed to register function because name was empty or too long.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+		if (functionNamespace.size() > 50)
+		{
+			Log::Print(
+				"Failed to register function '" + string(functionName) + "' because namespace was too long.",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return nullptr;
+		}
+
+		//registering is not protected, so it must not run into the memory limit,
+		//_EndRegister restores it
+		registerLimitEnforced = allocator.IsLimitEnforced();
+		allocator.SetLimitEnforced(false);
+
+		//missing tables along the namespace are created
+		_PushNamespace(
+			functionNamespace,
+			true);
+
+		return state;
+	}
+
+	void LuaState::_EndRegister(
+		string_view functionName,
+		string_view functionNamespace)
+	{
+		//profiles show registered functions under the name Lua calls them by
+		LuaProfiler::NameFunction(
+			state,
+			-1,
+			functionNamespace.empty()
+				? string(functionName)
+				: string(functionNamespace) + "." + string(functionName));
+
+		//set function name in the namespace table below the closure
+		lua_setfield(state, -2, string(functionName).c_str());
+
+		//pop namespace table
+		lua_pop(state, 1);
+
+		allocator.SetLimitEnforced(registerLimitEnforced);
+
+		if (!functionNamespace.empty())
+		{
+			Log::Print(
+				"Registered function '" + string(functionName) + "' to namespace '" + string(functionNamespace) + "'!",
+				"KALALUA",
+				LogType::LOG_SUCCESS);
+		}
+		else
+		{
+			Log::Print(
+				"Registered function '" + string(functionName) + "' to global namespace!",
+				"KALALUA",
+				LogType::LOG_SUCCESS);
+		}
+	}
+
+	void LuaState::Shutdown()
+	{
+		if (!isInitialized) return;
+
+		Log::Print(
+			"Shutting down Lua state.",
+			"KALALUA",
+			LogType::LOG_INFO);
+
+		profiler._OnShutdown();
+
+		lua_close(state);
+		state = nullptr;
+		isInitialized = false;
+
+		//every block is freed by now, the slabs can go
+		allocator.Release();
+
+		scriptWatcher.Clear();
+		loadedScripts.clear();
+
+		libraries.clear();
+		pendingLibraries.clear();
+		loadedLibraries.clear();
+
+		//the registry references went away with lua_close
+		namespaceCache.clear();
+	}
+
+	void LuaState::InvalidateNamespaceCache()
+	{
+		if (isInitialized)
+		{
+			for (const auto& [name, cached] : namespaceCache)
+			{
+				luaL_unref(state, LUA_REGISTRYINDEX, cached.ref);
+			}
+		}
+
+		namespaceCache.clear();
+	}
+
+	bool LuaState::_PushNamespace(
+		string_view functionNamespace,
+		bool isCreated)
+	{
+		if (functionNamespace.empty())
+		{
+			lua_pushglobaltable(state);
+			return true;
+		}
+
+		auto it = namespaceCache.find(functionNamespace);
+		if (it != namespaceCache.end()
+			&& _PushCachedNamespace(it->second))
+		{
+			return true;
+		}
+
+		int depth = scast<int>(count(
+			functionNamespace.begin(),
+			functionNamespace.end(),
+			'.')) + 1;
+
+		//the cache entry is built along the walk, segment names and tables in turn
+		lua_createtable(state, depth * 2, 0);
+		lua_pushglobaltable(state);
+
+		//only namespaces whose every table is held raw by its parent are cached,
+		//since a hit checks each segment with lua_rawget
+		bool isCacheable = true;
+
+		//walk each namespace segment straight from the view,
+		//no split vector or per-segment string copies
+		int index{};
+		size_t start{};
+		while (start < functionNamespace.size())
+		{
+			size_t end = functionNamespace.find('.', start);
+			if (end == string_view::npos) end = functionNamespace.size();
+
+			lua_pushlstring(
+				state,
+				functionNamespace.data() + start,
+				end - start);
+			lua_pushvalue(state, -1);
+			lua_rawseti(state, -4, ++index);
+			lua_rawget(state, -2);
+
+			//a table reached through __index is still used, but never cached
+			if (!lua_istable(state, -1))
+			{
+				lua_pop(state, 1);
+				lua_rawgeti(state, -2, index);
+				lua_gettable(state, -2);
+
+				if (lua_istable(state, -1)) isCacheable = false;
+			}
+
+			if (!lua_istable(state, -1))
+			{
+				if (!isCreated)
+				{
+					lua_pop(state, 3);
+					return false;
+				}
+
+				lua_pop(state, 1);
+				lua_newtable(state);
+				lua_rawgeti(state, -3, index);
+				lua_pushvalue(state, -2);
+				lua_settable(state, -4);
+
+				//a __newindex metamethod may have put the new table elsewhere
+				lua_rawgeti(state, -3, index);
+				lua_rawget(state, -3);
+				if (!lua_rawequal(state, -1, -2)) isCacheable = false;
+				lua_pop(state, 1);
+			}
+
+			lua_pushvalue(state, -1);
+			lua_rawseti(state, -4, ++index);
+
+			//remove parent table
+			lua_remove(state, -2);
+
+			start = end + 1;
+		}
+
+		if (!isCacheable)
+		{
+			//remove the entry, a stale one would fail validation on every call
+			lua_remove(state, -2);
+
+			if (it != namespaceCache.end())
+			{
+				luaL_unref(state, LUA_REGISTRYINDEX, it->second.ref);
+				namespaceCache.erase(it);
+			}
+
+			return true;
+		}
+
+		//the entry goes below the namespace table and is popped into the registry,
+		//rewriting an existing entry lets go of the tables it held
+		lua_insert(state, -2);
+		if (it == namespaceCache.end())
+		{
+			CachedNamespace cached{};
+			cached.ref = luaL_ref(state, LUA_REGISTRYINDEX);
+			cached.depth = depth;
+			namespaceCache.emplace(string(functionNamespace), cached);
+		}
+		else
+		{
+			lua_rawseti(state, LUA_REGISTRYINDEX, it->second.ref);
+			it->second.depth = depth;
+		}
+
+		return true;
+	}
+
+	bool LuaState::_PushCachedNamespace(const CachedNamespace& cached)
+	{
+		lua_rawgeti(state, LUA_REGISTRYINDEX, cached.ref);
+		lua_pushglobaltable(state);
+
+		//raw lookups with the interned segment names, a table Lua replaced at any depth
+		//no longer matches what its parent holds
+		for (int i = 1; i <= cached.depth; ++i)
+		{
+			lua_rawgeti(state, -2, i * 2 - 1);
+			lua_rawget(state, -2);
+			lua_rawgeti(state, -3, i * 2);
+
+			if (!lua_rawequal(state, -1, -2))
+			{
+				lua_pop(state, 4);
+				return false;
+			}
+
+			lua_pop(state, 1);
+
+			//remove parent table
+			lua_remove(state, -2);
+		}
+
+		//remove the entry
+		lua_remove(state, -2);
+
+		return true;
+	}
+
+	bool LuaState::_ResolveFunction(
+		string_view functionName,
+		string_view functionNamespace)
+	{
+		//resolving is not protected, so it must not run into the memory limit
+		LuaLimitScope limitScope(state, false);
+
+		if (!_PushNamespace(
+			functionNamespace,
+			false))
+		{
+			Log::Print(
+				"Lua namespace '" + string(functionNamespace) + "' does not exist!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		//fetch function from resolved namespace
+		lua_pushlstring(
+			state,
+			functionName.data(),
+			functionName.size());
+		lua_gettable(state, -2);
+		lua_remove(state, -2);
+
+		if (lua_isfunction(state, -1)) return true;
+
+		lua_pop(state, 1);
+
+		Log::Print(
+			"Lua function '" + string(functionName) + "' does not exist!",
+			"KALALUA",
+			LogType::LOG_ERROR,
+			2);
+
+		return false;
+	}
+
+	bool LuaState::SetLazyLibraries(bool enabled)
+	{
+		if (isInitialized)
+		{
+			Log::Print(
+				"Failed to set lazy libraries because the Lua state is already initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		isLazyLibraries = enabled;
+
+		return true;
+	}
+
+	void LuaState::_OpenPendingLibrary(
+		lua_State* luaState,
+		LuaLibrary library)
+	{
+		const LibraryEntry* entry = FindLibraryEntry(library);
+
+		//removed first, so a library that touches its own global while opening can not recurse
+		erase(pendingLibraries, library);
+
+		luaL_requiref(luaState, entry->name, entry->open, 1);
+		if (library == LuaLibrary::LUA_COROUTINE) _WrapCoroutineLibrary(luaState);
+		loadedLibraries.push_back(library);
+
+		//nothing left to open, globals that do not exist go straight to nil again
+
+		if (pendingLibraries.empty())
+		{
+			lua_pushglobaltable(luaState);
+			if (lua_getmetatable(luaState, -1))
+			{
+				lua_getfield(luaState, -1, "__index");
+				bool isStub = lua_tocfunction(luaState, -1) == _LazyGlobalIndex;
+				lua_pop(luaState, 1);
+
+				if (isStub)
+				{
+					lua_pushnil(luaState);
+					lua_setfield(luaState, -2, "__index");
+				}
+
+				lua_pop(luaState, 1);
+			}
+			lua_pop(luaState, 1);
+		}
+
+		Log::Print(
+			"Added lazy Lua library '" + string(entry->name) + "'!",
+			"KALALUA",
+			LogType::LOG_INFO);
+	}
+
+	int LuaState::_LazyGlobalIndex(lua_State* luaState)
+	{
+		LuaState* owner = FromLuaState(luaState);
+		if (!owner
+			|| lua_type(luaState, 2) != LUA_TSTRING)
+		{
+			return 0;
+		}
+
+		size_t length{};
+		const char* key = lua_tolstring(luaState, 2, &length);
+		string_view name(key, length);
+
+		for (const auto& library : owner->pendingLibraries)
+		{
+			const LibraryEntry* entry = FindLibraryEntry(library);
+
+			if (name == entry->name
+				|| (library == LuaLibrary::LUA_PACKAGE
+				&& name == "require"))
+			{
+				owner->_OpenPendingLibrary(luaState, library);
+				lua_pop(luaState, 1);
+
+				//the library set its own global, require comes along with package
+				lua_pushvalue(luaState, 2);
+				lua_rawget(luaState, 1);
+
+				return 1;
+			}
+		}
+
+		return 0;
+	}
+
+	int LuaState::_LazyStringMetamethod(lua_State* luaState)
+	{
+		LuaState* owner = FromLuaState(luaState);
+		if (owner
+			&& ContainsValue(owner->pendingLibraries, LuaLibrary::LUA_STRING))
+		{
+			owner->_OpenPendingLibrary(luaState, LuaLibrary::LUA_STRING);
+			lua_pop(luaState, 1);
+		}
+
+		int argCount = lua_gettop(luaState);
+
+		//luaopen_string replaced the string metatable, forward to its metamethod
+
+		lua_pushliteral(luaState, "");
+		if (!lua_getmetatable(luaState, -1))
+		{
+			return luaL_error(luaState, "string metatable is missing");
+		}
+
+		lua_getfield(luaState, -1, lua_tostring(luaState, lua_upvalueindex(1)));
+		if (lua_tocfunction(luaState, -1) == _LazyStringMetamethod)
+		{
+			return luaL_error(luaState, "string library is not available");
+		}
+
+		//__index is the string table itself
+		if (lua_istable(luaState, -1))
+		{
+			lua_pushvalue(luaState, 2);
+			lua_gettable(luaState, -2);
+
+			return 1;
+		}
+
+		lua_replace(luaState, 1 + argCount);
+		lua_settop(luaState, 1 + argCount);
+		lua_insert(luaState, 1);
+		lua_call(luaState, argCount, LUA_MULTRET);
+
+		return lua_gettop(luaState);
+	}
+}
+
+int LuaPanic(lua_State* state)
+{
+	const char* msg = lua_tostring(state, -1);
+
+	KalaLuaCore::ForceClose(
+		"KalaLua error",
+		msg ? msg : "Unknown lua panic.");
+
+	return 0;
+}
+
+int LuaFunctionTrampolineCustom(lua_State* state)
+{
+	auto* f = scast<function<int(lua_State*)>*>(lua_touserdata(state, lua_upvalueindex(1)));
+
+	if (!f)
+	{
+		return luaL_error(
+			state,
+			"KALALUA ERROR: User-defined function has no target function!");
+	}
+
+	//a custom function that raises a Lua error never returns here, so only returning calls are recorded
+	LuaFunctionMetrics* functionMetrics = scast<LuaFunctionMetrics*>(lua_touserdata(state, lua_upvalueindex(2)));
+	uint64_t callStart = functionMetrics->BeginCall();
+
+	//call the function
+	int returnCount = (*f)(state);
+
+	functionMetrics->EndCall(callStart, false);
+
+	return returnCount;
+}
\ No newline at end of file
@@ -0,0 +1,298 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_template.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::move;
+using std::memory_order_relaxed;
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+namespace KalaLua::Core
+{
+	bool LuaStateTemplate::Initialize(
+		const vector<LuaLibrary>& libs,
+		const LuaAllocatorConfig& allocator)
+	{
+		if (prototype.IsInitialized())
+		{
+			Log::Print(
+				"Failed to initialize Lua state template because its already initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!prototype.SetAllocator(allocator)
+			|| !prototype.Initialize(libs))
+		{
+			Log::Print(
+				"Failed to initialize Lua state template because its prototype state could not be initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		libraries = libs;
+		allocatorConfig = allocator;
+		steps.clear();
+
+		return true;
+	}
+
+	bool LuaStateTemplate::LoadScript(
+		string_view script,
+		LuaLoadMode mode)
+	{
+		if (!prototype.IsInitialized())
+		{
+			Log::Print(
+				"Failed to record script '" + string(script) + "' because the Lua state template is not initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		vector<char> chunk{};
+
+		prototype.chunkRecorder = &chunk;
+		bool isLoaded = prototype.LoadScript(script, mode);
+		prototype.chunkRecorder = nullptr;
+
+		return _RecordChunk(
+			script,
+			isLoaded,
+			chunk);
+	}
+
+	bool LuaStateTemplate::LoadScriptFromBuffer(
+		string_view name,
+		span<const char> buffer,
+		LuaLoadMode mode)
+	{
+		if (!prototype.IsInitialized())
+		{
+			Log::Print(
+				"Failed to record script '" + string(name) + "' because the Lua state template is not initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		vector<char> chunk{};
+
+		prototype.chunkRecorder = &chunk;
+		bool isLoaded = prototype.LoadScriptFromBuffer(
+			name,
+			buffer,
+			mode);
+		prototype.chunkRecorder = nullptr;
+
+		return _RecordChunk(
+			name,
+			isLoaded,
+			chunk);
+	}
+
+	bool LuaStateTemplate::RegisterFunction(
+		string_view functionName,
+		string_view functionNamespace,
+		const function<int(lua_State*)>& targetFunction)
+	{
+		return AddSetupStep([
+			functionName = string(functionName),
+			functionNamespace = string(functionNamespace),
+			targetFunction](LuaState& state) -> bool
+			{
+				return state.RegisterFunction(
+					functionName,
+					functionNamespace,
+					targetFunction);
+			});
+	}
+
+	bool LuaStateTemplate::AddSetupStep(const function<bool(LuaState&)>& step)
+	{
+		if (!prototype.IsInitialized())
+		{
+			Log::Print(
+				"Failed to record setup step because the Lua state template is not initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (!step)
+		{
+			Log::Print(
+				"Failed to record setup step because it is empty!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		//a step that fails on the prototype would fail on every instance too
+		if (!step(prototype))
+		{
+			Log::Print(
+				"Failed to record setup step because it failed on the prototype state!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		SetupStep recorded{};
+		recorded.setup = step;
+		steps.push_back(move(recorded));
+
+		return true;
+	}
+
+	bool LuaStateTemplate::Instantiate(LuaState& outState)
+	{
+		if (!prototype.IsInitialized())
+		{
+			Log::Print(
+				"Failed to instantiate Lua state template because it is not initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		if (outState.IsInitialized())
+		{
+			Log::Print(
+				"Failed to instantiate Lua state template because the target state is already initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		auto start = steady_clock::now();
+
+		if (!outState.SetAllocator(allocatorConfig)
+			|| !outState.Initialize(libraries))
+		{
+			Log::Print(
+				"Failed to instantiate Lua state template because the target state could not be initialized!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		for (const auto& step : steps)
+		{
+			//recorded scripts are loaded as binary chunks, so nothing is parsed again
+			bool isSuccess = step.setup
+				? step.setup(outState)
+				: outState.LoadScriptFromBuffer(
+					step.chunkName,
+					span<const char>(step.chunk),
+					LuaLoadMode::LOAD_BINARY);
+
+			if (!isSuccess)
+			{
+				outState.Shutdown();
+
+				Log::Print(
+					"Failed to instantiate Lua state template because one of its recorded steps failed!",
+					"KALALUA_TEMPLATE",
+					LogType::LOG_ERROR,
+					2);
+
+				return false;
+			}
+		}
+
+		u64 elapsed = scast<u64>(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+
+		instanceCount.fetch_add(1, memory_order_relaxed);
+		lastInstanceNanoseconds.store(elapsed, memory_order_relaxed);
+		totalInstanceNanoseconds.fetch_add(elapsed, memory_order_relaxed);
+
+		return true;
+	}
+
+	LuaTemplateStats LuaStateTemplate::GetStats() const
+	{
+		LuaTemplateStats stats{};
+
+		stats.instances = instanceCount.load(memory_order_relaxed);
+		stats.lastInstanceNanoseconds = lastInstanceNanoseconds.load(memory_order_relaxed);
+		stats.totalInstanceNanoseconds = totalInstanceNanoseconds.load(memory_order_relaxed);
+
+		return stats;
+	}
+
+	void LuaStateTemplate::Shutdown()
+	{
+		steps.clear();
+		libraries.clear();
+		allocatorConfig = {};
+
+		if (prototype.IsInitialized()) prototype.Shutdown();
+	}
+
+	bool LuaStateTemplate::_RecordChunk(
+		string_view name,
+		bool isLoaded,
+		vector<char>& chunk)
+	{
+		//the load already logged why it failed
+		if (!isLoaded) return false;
+
+		if (chunk.empty())
+		{
+			Log::Print(
+				"Failed to record script '" + string(name) + "' because its compiled chunk could not be dumped!",
+				"KALALUA_TEMPLATE",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		SetupStep recorded{};
+		recorded.chunkName = string(name);
+		recorded.chunk = move(chunk);
+		steps.push_back(move(recorded));
+
+		return true;
+	}
+}
@@ -0,0 +1,226 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "core_utils.hpp"
+#include "log_utils.hpp"
+
+#include "core/kl_watcher.hpp"
+
+using KalaHeaders::KalaLog::Log;
+using KalaHeaders::KalaLog::LogType;
+
+using std::string;
+using std::vector;
+using std::find;
+using std::find_if;
+using std::error_code;
+using std::filesystem::path;
+using std::filesystem::file_time_type;
+using std::filesystem::absolute;
+using std::filesystem::last_write_time;
+
+namespace KalaLua::Core
+{
+#ifdef __linux__
+	//written in place, renamed or moved into the directory
+	static constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO;
+#endif
+
+	LuaFileWatcher::~LuaFileWatcher()
+	{
+		Stop();
+	}
+
+	bool LuaFileWatcher::Start()
+	{
+		if (isRunning) return true;
+
+#ifdef __linux__
+		inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotifyDescriptor < 0)
+		{
+			Log::Print(
+				"Failed to start file watcher because inotify could not be initialized!",
+				"KALALUA",
+				LogType::LOG_ERROR,
+				2);
+
+			return false;
+		}
+
+		for (const WatchedFile& watched : files)
+		{
+			_AddDirectoryWatch(watched.file);
+		}
+#endif
+
+		//writes that happened while stopped are found by comparing write times once
+		isScanPending = true;
+
+		isRunning = true;
+		return true;
+	}
+
+	path LuaFileWatcher::Watch(const path& file)
+	{
+		error_code ec{};
+		path absolutePath = absolute(file, ec);
+		if (ec) absolutePath = file;
+		absolutePath = absolutePath.lexically_normal();
+
+		auto it = find_if(files.begin(), files.end(), [&](const WatchedFile& watched)
+			{
+				return watched.file == absolutePath;
+			});
+		if (it != files.end()) return absolutePath;
+
+		files.push_back({ absolutePath, _GetLastWriteTime(absolutePath) });
+
+#ifdef __linux__
+		if (isRunning) _AddDirectoryWatch(absolutePath);
+#endif
+
+		return absolutePath;
+	}
+
+	void LuaFileWatcher::Poll(vector<path>& outChanged)
+	{
+		if (!isRunning) return;
+
+		auto add_once = [&outChanged](const WatchedFile& watched)
+			{
+				if (find(outChanged.begin(), outChanged.end(), watched.file) == outChanged.end())
+				{
+					outChanged.push_back(watched.file);
+				}
+			};
+
+		//file timestamps only advance every few milliseconds, so comparing them
+		//misses quick saves, it is only the fallback when there are no events
+		auto add_if_written = [&add_once](WatchedFile& watched)
+			{
+				file_time_type writeTime = _GetLastWriteTime(watched.file);
+				if (writeTime == watched.lastWriteTime) return;
+
+				watched.lastWriteTime = writeTime;
+				add_once(watched);
+			};
+
+#ifdef __linux__
+		alignas(inotify_event) char buffer[4096];
+
+		for (;;)
+		{
+			ssize_t length = read(inotifyDescriptor, buffer, sizeof(buffer));
+			if (length <= 0) break;
+
+			for (char* cursor = buffer; cursor < buffer + length; )
+			{
+				const inotify_event* event = reinterpret_cast<const inotify_event*>(cursor);
+				cursor += sizeof(inotify_event) + event->len;
+
+				//the kernel dropped events, only a full comparison finds what changed
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					isScanPending = true;
+					continue;
+				}
+
+				auto dir = directories.find(event->wd);
+				if (dir == directories.end()
+					|| event->len == 0)
+				{
+					continue;
+				}
+
+				path changedFile = dir->second / event->name;
+
+				auto it = find_if(files.begin(), files.end(), [&](const WatchedFile& watched)
+					{
+						return watched.file == changedFile;
+					});
+				if (it == files.end()) continue;
+
+				it->lastWriteTime = _GetLastWriteTime(it->file);
+				add_once(*it);
+			}
+		}
+
+		if (isScanPending)
+		{
+			for (WatchedFile& watched : files) add_if_written(watched);
+		}
+
+		isScanPending = false;
+#else
+		for (WatchedFile& watched : files) add_if_written(watched);
+#endif
+	}
+
+	void LuaFileWatcher::Stop()
+	{
+		if (!isRunning) return;
+
+#ifdef __linux__
+		//closing the descriptor drops every watch on it
+		close(inotifyDescriptor);
+		inotifyDescriptor = -1;
+		directories.clear();
+#endif
+
+		isRunning = false;
+	}
+
+	void LuaFileWatcher::Clear()
+	{
+		Stop();
+
+		files.clear();
+	}
+
+#ifdef __linux__
+	void LuaFileWatcher::_AddDirectoryWatch(const path& file)
+	{
+		path directory = file.parent_path();
+
+		//inotify hands out the same descriptor again for a directory it already watches
+		int watchDescriptor = inotify_add_watch(
+			inotifyDescriptor,
+			directory.c_str(),
+			WATCH_MASK);
+
+		if (watchDescriptor < 0)
+		{
+			Log::Print(
+				"Failed to watch directory '" + directory.string() + "' for script changes!",
+				"KALALUA",
+				LogType::LOG_WARNING);
+
+			return;
+		}
+
+		directories[watchDescriptor] = directory;
+	}
+#endif
+
+	file_time_type LuaFileWatcher::_GetLastWriteTime(const path& file)
+	{
+		//files that are missing mid-save compare as changed once they are back
+		error_code ec{};
+		file_time_type writeTime = last_write_time(file, ec);
+
+		return ec ? file_time_type::min() : writeTime;
+	}
+}
@@ -0,0 +1,724 @@
+//Copyright(C) 2026 Lost Empire Entertainment
+//This program comes with ABSOLUTELY NO WARRANTY.
+//This is free software, and you are welcome to redistribute it under certain conditions.
+//Read LICENSE.md for more information.
+
+//Behaviour tests for the parts of KalaLua that cross threads or keep state between calls.
+//Usage: kalalua-tests [name filter]
+//Failures are printed to stderr because KalaLua logs to stdout, the exit code is 1 if any check failed
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <future>
+#include <optional>
+#include <cstdio>
+#include <span>
+#include <thread>
+#include <variant>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+#include "core_utils.hpp"
+
+#include "core/kl_state.hpp"
+#include "core/kl_pool.hpp"
+#include "core/kl_scheduler.hpp"
+#include "core/kl_channel.hpp"
+
+using KalaLua::Core::LuaState;
+using KalaLua::Core::LuaLibrary;
+using KalaLua::Core::LuaAllocatorConfig;
+using KalaLua::Core::LuaAllocatorType;
+using KalaLua::Core::LuaStatePool;
+using KalaLua::Core::LuaPoolConfig;
+using KalaLua::Core::LuaWorkerStats;
+using KalaLua::Core::LuaScheduler;
+using KalaLua::Core::LuaSchedulerStats;
+using KalaLua::Core::LuaTaskID;
+using KalaLua::Core::LuaChannel;
+using KalaLua::Core::LuaMessage;
+using KalaLua::Core::LuaVar;
+
+using std::string;
+using std::string_view;
+using std::span;
+using std::vector;
+using std::function;
+using std::future;
+using std::optional;
+using std::thread;
+using std::get_if;
+using std::ofstream;
+using std::ios;
+using std::streamsize;
+using std::chrono::seconds;
+using std::filesystem::path;
+using std::filesystem::temp_directory_path;
+using std::filesystem::create_directories;
+using std::filesystem::remove_all;
+using std::filesystem::last_write_time;
+
+namespace this_thread = std::this_thread;
+
+using u32 = uint32_t;
+using u64 = uint64_t;
+
+struct TestCase
+{
+	const char* name;
+	function<void()> run;
+};
+
+//name of the test that is running, printed with every failed check
+static const char* currentTest{};
+static u32 checkCount{};
+static u32 failureCount{};
+
+static void Check(
+	bool isPassed,
+	const char* expectation)
+{
+	++checkCount;
+	if (isPassed) return;
+
+	++failureCount;
+	fprintf(stderr, "FAILED %s: %s\n", currentTest, expectation);
+}
+
+static bool LoadSource(
+	LuaState& state,
+	string_view name,
+	string_view source)
+{
+	return state.LoadScriptFromBuffer(
+		name,
+		span<const char>(source.data(), source.size()));
+}
+
+//
+// LuaStatePool
+//
+
+static constexpr const char* POOL_SCRIPT = R"(
+function add(a, b)
+	return a + b
+end
+)";
+
+static bool SetupPoolWorker(LuaState& state)
+{
+	return LoadSource(state, "pool", POOL_SCRIPT);
+}
+
+static void TestPoolSubmit()
+{
+	constexpr int JOB_COUNT = 1000;
+
+	LuaPoolConfig config{};
+	config.workerCount = 4;
+	config.onWorkerSetup = SetupPoolWorker;
+
+	LuaStatePool pool{};
+	Check(pool.Initialize(config), "the pool initializes");
+	Check(pool.GetWorkerCount() == 4, "the pool starts the requested number of workers");
+
+	vector<future<optional<int>>> results{};
+	for (int i = 0; i < JOB_COUNT; ++i)
+	{
+		results.push_back(pool.Submit<int>("add", "", i, 1));
+	}
+
+	bool isEveryResultCorrect = true;
+	for (int i = 0; i < JOB_COUNT; ++i)
+	{
+		optional<int> result = results[i].get();
+		if (!result || *result != i + 1) isEveryResultCorrect = false;
+	}
+	Check(isEveryResultCorrect, "every job returns the result of its own call");
+
+	u64 jobsExecuted{};
+	for (const LuaWorkerStats& stats : pool.GetWorkerStats())
+	{
+		jobsExecuted += stats.jobsExecuted;
+	}
+	Check(jobsExecuted == JOB_COUNT, "the worker stats count every job once");
+
+	pool.Shutdown();
+	Check(!pool.IsInitialized(), "the pool shuts down");
+}
+
+static void TestPoolNestedJobs()
+{
+	LuaPoolConfig config{};
+	config.workerCount = 2;
+	config.onWorkerSetup = SetupPoolWorker;
+
+	LuaStatePool pool{};
+	Check(pool.Initialize(config), "the pool initializes");
+
+	//a job submitted from inside a worker goes to that worker's own queue and still runs
+	auto outer = pool.SubmitJob([&pool](LuaState&)
+		{
+			return pool.SubmitJob([](LuaState& state)
+				{
+					return state.CallFunction<int>("add", "", 2, 3);
+				});
+		});
+
+	optional<int> result = outer.get().get();
+	Check(result && *result == 5, "a job submitted from a worker runs");
+
+	pool.Shutdown();
+}
+
+static void TestPoolShutdownFinishesJobs()
+{
+	constexpr int JOB_COUNT = 200;
+
+	LuaPoolConfig config{};
+	config.workerCount = 2;
+	config.onWorkerSetup = SetupPoolWorker;
+
+	LuaStatePool pool{};
+	Check(pool.Initialize(config), "the pool initializes");
+
+	vector<future<optional<int>>> results{};
+	for (int i = 0; i < JOB_COUNT; ++i)
+	{
+		results.push_back(pool.Submit<int>("add", "", i, i));
+	}
+
+	pool.Shutdown();
+
+	bool isEveryJobFinished = true;
+	for (int i = 0; i < JOB_COUNT; ++i)
+	{
+		optional<int> result = results[i].get();
+		if (!result || *result != i * 2) isEveryJobFinished = false;
+	}
+	Check(isEveryJobFinished, "Shutdown finishes every queued job first");
+}
+
+//
+// LuaAllocator memory limit
+//
+
+static constexpr const char* MEMORY_SCRIPT = R"(
+function grow()
+	local values = {}
+	for i = 1, 10000000 do
+		values[i] = { i }
+	end
+end
+
+function take(value)
+	return #value
+end
+
+function add_one(value)
+	return value + 1
+end
+
+function call_native(value)
+	return natives.math.twice(value)
+end
+)";
+
+static void TestMemoryLimit()
+{
+	LuaAllocatorConfig allocator{};
+	allocator.type = LuaAllocatorType::ALLOCATOR_POOL;
+	allocator.memoryLimit = 1024 * 1024;
+
+	LuaState state{};
+	Check(state.SetAllocator(allocator), "the allocator is set before Initialize");
+	Check(state.Initialize({}), "the state initializes under the memory limit");
+	Check(LoadSource(state, "memory", MEMORY_SCRIPT), "the script loads under the memory limit");
+
+	Check(!state.CallFunction<void>("grow", ""), "a call that grows past the memory limit fails");
+	Check(state.GetMemoryStats().failedAllocations > 0, "the allocation past the limit is counted as failed");
+
+	optional<int> result = state.CallFunction<int>("add_one", "", 1);
+	Check(result && *result == 2, "the state keeps working after a memory error");
+
+	state.Shutdown();
+}
+
+static void TestMemoryLimitOutsideProtectedCalls()
+{
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+	Check(LoadSource(state, "memory", MEMORY_SCRIPT), "the script loads");
+
+	//registering and pushing args allocate outside lua_pcall, a memory error there would
+	//reach the panic handler, so these go past the limit instead of aborting the program
+	state.SetMemoryLimit(state.GetMemoryStats().bytesInUse);
+
+	state.RegisterFunction(
+		"twice",
+		"natives.math",
+		function<int(int)>([](int value) { return value * 2; }));
+
+	string large(64 * 1024, 'x');
+	state.CallFunction<int>("take", "", large);
+
+	state.SetMemoryLimit(0);
+
+	optional<int> result = state.CallFunction<int>("call_native", "", 4);
+	Check(result && *result == 8, "a function registered at the memory limit can be called");
+
+	result = state.CallFunction<int>("take", "", large);
+	Check(result && *result == 64 * 1024, "the state keeps working after going past the limit outside a call");
+
+	state.Shutdown();
+}
+
+//
+// LuaScheduler
+//
+
+static constexpr const char* SCHEDULER_SCRIPT = R"(
+stage = 0
+
+function staged_task()
+	stage = 1
+	scheduler.wait_frames(2)
+	stage = 2
+	scheduler.wait_signal("go")
+	stage = 3
+	stage = scheduler.wait_value("final")
+end
+
+function cancelled_task()
+	scheduler.wait_frames(1)
+	cancel_current()
+	return 1, 2, 3
+end
+
+function echo_task(value)
+	scheduler.wait_frames(1)
+	echoed = value
+end
+
+function get_stage()
+	return stage
+end
+
+function get_echoed()
+	return echoed
+end
+)";
+
+static void TestSchedulerWaits()
+{
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+
+	LuaScheduler scheduler{};
+	Check(scheduler.Initialize(state), "the scheduler initializes");
+	Check(LoadSource(state, "scheduler", SCHEDULER_SCRIPT), "the script loads");
+
+	auto stage = [&state]() { return state.CallFunction<int>("get_stage", "").value_or(-1); };
+
+	LuaTaskID task = scheduler.Start("staged_task", "");
+	Check(task != 0, "the task starts");
+	Check(stage() == 1, "Start runs the task until its first wait");
+
+	scheduler.Tick();
+	Check(stage() == 1, "wait_frames(2) does not resume after one Tick");
+	scheduler.Tick();
+	Check(stage() == 2, "wait_frames(2) resumes on the second Tick");
+
+	scheduler.Tick();
+	Check(stage() == 2, "wait_signal does not resume without the signal");
+	scheduler.Signal("go");
+	scheduler.Tick();
+	Check(stage() == 3, "wait_signal resumes on the Tick after Signal");
+
+	scheduler.SetValue("final", 7);
+	scheduler.Tick();
+	Check(stage() == 7, "wait_value returns the value SetValue stored");
+	Check(!scheduler.IsRunning(task), "the task is gone once its function returned");
+	Check(scheduler.GetStats().tasksFinished == 1, "the finished task is counted");
+
+	scheduler.Shutdown();
+	state.Shutdown();
+}
+
+static void TestSchedulerCancelDuringResume()
+{
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+
+	LuaScheduler scheduler{};
+	Check(scheduler.Initialize(state), "the scheduler initializes");
+
+	LuaTaskID currentTask{};
+	state.RegisterFunction(
+		"cancel_current",
+		"",
+		function<void()>([&]() { scheduler.Cancel(currentTask); }));
+
+	Check(LoadSource(state, "scheduler", SCHEDULER_SCRIPT), "the script loads");
+
+	//the task cancels itself and then returns values, so it finishes inside the cancelled resume
+	currentTask = scheduler.Start("cancelled_task", "");
+	scheduler.Tick();
+
+	LuaSchedulerStats stats = scheduler.GetStats();
+	Check(!scheduler.IsRunning(currentTask), "a task cancelled during its resume stops");
+	Check(stats.tasksCancelled == 1, "the cancelled task is counted as cancelled");
+	Check(stats.pooledThreads == 1, "the thread of a task that finished while cancelled is pooled");
+
+	//the pooled thread must come back empty, or the next task would see the old return values
+	LuaTaskID echo = scheduler.Start("echo_task", "", 42);
+	Check(scheduler.GetStats().threadsReused == 1, "the next task reuses the pooled thread");
+
+	scheduler.Tick();
+	Check(!scheduler.IsRunning(echo), "the task on the reused thread finishes");
+	Check(state.CallFunction<int>("get_echoed", "").value_or(-1) == 42, "the task on the reused thread gets its own args");
+
+	scheduler.Shutdown();
+	state.Shutdown();
+}
+
+//
+// LuaChannel
+//
+
+static constexpr const char* CHANNEL_SEND_SCRIPT = R"(
+function send_table()
+	return channel.send({ hp = 10, name = "orc", list = { 1, 2, 3 } }, 5)
+end
+)";
+
+static constexpr const char* CHANNEL_RECEIVE_SCRIPT = R"(
+function receive_table()
+	local isReceived, unit, count = channel.try_receive()
+	return isReceived
+		and unit.hp == 10
+		and unit.name == "orc"
+		and unit.list[3] == 3
+		and count == 5
+end
+
+function receive_any()
+	return (channel.try_receive())
+end
+)";
+
+static int FirstInt(const LuaMessage& message)
+{
+	vector<LuaVar> values{};
+	if (!message.ToVars(values)
+		|| values.empty())
+	{
+		return -1;
+	}
+
+	const int* value = get_if<int>(&values[0]);
+	return value ? *value : -1;
+}
+
+static void TestChannelCapacity()
+{
+	LuaChannel channel(3);
+	Check(channel.GetCapacity() == 4, "the capacity is rounded up to a power of two");
+
+	LuaMessage message{};
+	bool isEverySendAccepted = true;
+	for (int i = 0; i < 4; ++i)
+	{
+		message.Clear();
+		message.Add(i);
+		if (!channel.TrySend(message)) isEverySendAccepted = false;
+	}
+	Check(isEverySendAccepted, "a channel accepts messages up to its capacity");
+
+	message.Clear();
+	message.Add(4);
+	Check(!channel.TrySend(message), "a full channel refuses the next message");
+	Check(message.GetValueCount() == 1, "a refused message is left untouched");
+	Check(channel.GetSize() == 4, "the size counts every waiting message");
+
+	bool isInOrder = true;
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!channel.TryReceive(message)
+			|| FirstInt(message) != i)
+		{
+			isInOrder = false;
+		}
+	}
+	Check(isInOrder, "messages are received in the order they were sent");
+	Check(!channel.TryReceive(message), "an empty channel has nothing to receive");
+}
+
+static void TestChannelBetweenStates()
+{
+	LuaChannel channel(16);
+
+	LuaState sender{};
+	LuaState receiver{};
+	Check(sender.Initialize({}) && receiver.Initialize({}), "both states initialize");
+	Check(channel.Bind(sender, "channel") && channel.Bind(receiver, "channel"), "the channel binds to both states");
+	Check(LoadSource(sender, "send", CHANNEL_SEND_SCRIPT), "the send script loads");
+	Check(LoadSource(receiver, "receive", CHANNEL_RECEIVE_SCRIPT), "the receive script loads");
+
+	Check(sender.CallFunction<bool>("send_table", "").value_or(false), "Lua sends a table and a number");
+	Check(receiver.CallFunction<bool>("receive_table", "").value_or(false), "the other state receives the same table and number");
+	Check(!receiver.CallFunction<bool>("receive_any", "").value_or(true), "try_receive returns false once the channel is empty");
+
+	sender.Shutdown();
+	receiver.Shutdown();
+}
+
+static void TestChannelThreads()
+{
+	constexpr int PRODUCER_COUNT = 4;
+	constexpr int MESSAGES_PER_PRODUCER = 10000;
+	constexpr int MESSAGE_COUNT = PRODUCER_COUNT * MESSAGES_PER_PRODUCER;
+
+	//smaller than the message count, so producers keep running into a full channel
+	LuaChannel channel(256);
+
+	vector<thread> producers{};
+	for (int producer = 0; producer < PRODUCER_COUNT; ++producer)
+	{
+		producers.emplace_back([&channel, producer]()
+			{
+				LuaMessage message{};
+				for (int i = 0; i < MESSAGES_PER_PRODUCER; ++i)
+				{
+					message.Clear();
+					message.Add(producer * MESSAGES_PER_PRODUCER + i);
+
+					while (!channel.TrySend(message)) this_thread::yield();
+				}
+			});
+	}
+
+	vector<bool> isSeen(MESSAGE_COUNT);
+	vector<int> lastValues(PRODUCER_COUNT, -1);
+	bool isEveryMessageValid = true;
+	bool isEveryProducerInOrder = true;
+
+	LuaMessage message{};
+	for (int received = 0; received < MESSAGE_COUNT;)
+	{
+		if (!channel.TryReceive(message))
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		int value = FirstInt(message);
+		if (value < 0
+			|| value >= MESSAGE_COUNT
+			|| isSeen[value])
+		{
+			//keep receiving so the producers can finish
+			isEveryMessageValid = false;
+			++received;
+			continue;
+		}
+
+		//one producer sends in order, so its messages must arrive in order
+		int producer = value / MESSAGES_PER_PRODUCER;
+		if (value < lastValues[producer]) isEveryProducerInOrder = false;
+		lastValues[producer] = value;
+
+		isSeen[value] = true;
+		++received;
+	}
+
+	for (thread& producer : producers)
+	{
+		producer.join();
+	}
+
+	Check(isEveryMessageValid, "every message arrives exactly once with the value it was sent with");
+	Check(isEveryProducerInOrder, "the messages of each producer arrive in the order they were sent");
+	Check(channel.GetSize() == 0, "the channel is empty once every message was received");
+}
+
+//
+// Namespace cache
+//
+
+static constexpr const char* NAMESPACE_SCRIPT = R"(
+game = { ai = {} }
+
+function game.ai.update()
+	game.ai = { update = function() return 2 end }
+	return 1
+end
+
+function replace_game()
+	game = { ai = { update = function() return 3 end } }
+end
+
+function call_native()
+	return game.ai.native()
+end
+)";
+
+static void TestNamespaceReplaced()
+{
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+	Check(LoadSource(state, "namespace", NAMESPACE_SCRIPT), "the script loads");
+
+	auto update = [&state]() { return state.CallFunction<int>("update", "game.ai").value_or(-1); };
+
+	//the first call replaces its own namespace table while the cache holds the old one
+	Check(update() == 1, "the first call resolves the namespace");
+	Check(update() == 2, "a namespace table replaced during a call is resolved again");
+	Check(update() == 2, "the replaced table is cached in turn");
+
+	Check(state.CallFunction<void>("replace_game", ""), "Lua replaces the root namespace table");
+
+	//registering goes through the cache too and must not write into the replaced table
+	state.RegisterFunction(
+		"native",
+		"game.ai",
+		function<int()>([]() { return 4; }));
+	Check(state.CallFunction<int>("call_native", "").value_or(-1) == 4, "registering goes into the current namespace table");
+	Check(update() == 3, "a namespace whose parent table was replaced is resolved again");
+
+	state.InvalidateNamespaceCache();
+	Check(update() == 3, "namespaces resolve again after the cache is dropped");
+
+	state.Shutdown();
+}
+
+static constexpr const char* PROXY_NAMESPACE_SCRIPT = R"(
+backing = { ai = { update = function() return 1 end } }
+proxy = setmetatable({}, { __index = backing })
+
+function replace_backing()
+	backing.ai = { update = function() return 2 end }
+end
+)";
+
+static void TestNamespaceThroughIndex()
+{
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+	Check(LoadSource(state, "proxy", PROXY_NAMESPACE_SCRIPT), "the script loads");
+
+	auto update = [&state]() { return state.CallFunction<int>("update", "proxy.ai").value_or(-1); };
+
+	Check(update() == 1, "a namespace reached through __index resolves");
+	Check(update() == 1, "it resolves again on the next call");
+
+	//the proxy never holds ai itself, so nothing cached may outlive the backing table
+	Check(state.CallFunction<void>("replace_backing", ""), "Lua replaces the backing table");
+	Check(update() == 2, "a namespace reached through __index follows its backing table");
+
+	state.Shutdown();
+}
+
+//
+// Hot reload
+//
+
+static constexpr const char* MODULE_SCRIPT_V1 = R"(
+local M = { version = 1 }
+
+function get_version()
+	return M.version
+end
+
+return M
+)";
+
+static constexpr const char* MODULE_SCRIPT_V2 = R"(
+local M = { version = 2 }
+
+function get_version()
+	return M.version
+end
+
+return M
+)";
+
+static void WriteScript(
+	const path& filePath,
+	string_view source)
+{
+	ofstream file(filePath, ios::binary | ios::trunc);
+	file.write(source.data(), scast<streamsize>(source.size()));
+}
+
+static void TestHotReloadReturningScript()
+{
+	path directory = temp_directory_path() / "kalalua_tests";
+	create_directories(directory);
+
+	path scriptPath = directory / "reload_module.lua";
+	WriteScript(scriptPath, MODULE_SCRIPT_V1);
+
+	LuaState state{};
+	Check(state.Initialize({}), "the state initializes");
+	Check(state.LoadScript(scriptPath.string()), "a script that returns a value loads");
+
+	//the LuaVar overload checks how many values the call left, so values a script
+	//returned and left on the stack would make every one of these fail
+	auto version = [&state]() { return state.CallFunction<int>("get_version", "", vector<LuaVar>{}).value_or(-1); };
+	Check(version() == 1, "a LuaVar call returns a value after loading a script that returns one");
+
+	Check(state.EnableHotReload(), "hot reload starts");
+
+	//moved forward explicitly so the poll fallback sees a new write time on coarse clocks
+	auto writeTime = last_write_time(scriptPath);
+	WriteScript(scriptPath, MODULE_SCRIPT_V2);
+	last_write_time(scriptPath, writeTime + seconds(2));
+
+	Check(state.PollHotReload() == 1, "the rewritten script is reloaded once");
+	Check(version() == 2, "a LuaVar call returns a value after reloading a script that returns one");
+
+	state.Shutdown();
+	remove_all(directory);
+}
+
+int main(int argc, char* argv[])
+{
+	string_view filter = argc > 1 ? argv[1] : "";
+
+	const vector<TestCase> tests =
+	{
+		{ "pool/submit",          TestPoolSubmit },
+		{ "pool/nested_jobs",     TestPoolNestedJobs },
+		{ "pool/shutdown",        TestPoolShutdownFinishesJobs },
+		{ "memory/limit",         TestMemoryLimit },
+		{ "memory/unprotected",   TestMemoryLimitOutsideProtectedCalls },
+		{ "scheduler/waits",      TestSchedulerWaits },
+		{ "scheduler/cancel",     TestSchedulerCancelDuringResume },
+		{ "channel/capacity",     TestChannelCapacity },
+		{ "channel/states",       TestChannelBetweenStates },
+		{ "channel/threads",      TestChannelThreads },
+		{ "namespace/replaced",   TestNamespaceReplaced },
+		{ "namespace/index",      TestNamespaceThroughIndex },
+		{ "hotreload/returning",  TestHotReloadReturningScript }
+	};
+
+	u32 testCount{};
+	for (const TestCase& test : tests)
+	{
+		if (!filter.empty()
+			&& string_view(test.name).find(filter) == string_view::npos)
+		{
+			continue;
+		}
+
+		currentTest = test.name;
+		test.run();
+		++testCount;
+	}
+
+	fprintf(stderr, "Ran %u tests with %u checks, %u failed.\n", testCount, checkCount, failureCount);
+	return failureCount == 0 ? 0 : 1;
+}